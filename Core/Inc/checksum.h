@@ -0,0 +1,84 @@
+/**
+  ******************************************************************************
+  * @file    checksum.h
+  * @brief   This file contains the function prototypes of the CRC engines
+  *          used to validate YMODEM packets.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __CHECKSUM_H__
+#define __CHECKSUM_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* CRC-16/XMODEM: polynomial 0x1021, initial value 0, no reflection */
+#define CRC16_POLY              ((uint32_t)0x1021)
+
+/* CRC-32 (zlib): reflected polynomial 0xEDB88320, initial value and final
+ * XOR 0xFFFFFFFF. Used for image digests, any host can recompute it. */
+#define CRC32_POLY              ((uint32_t)0xEDB88320)
+#define CRC32_POLY_NORMAL       ((uint32_t)0x04C11DB7)  /* same, not reflected */
+
+/* Available CRC-32 engines */
+#define CRC32_ENGINE_TABLE      0   /* one 256-entry table, one lookup per byte */
+#define CRC32_ENGINE_HW         1   /* CRC peripheral, borrowed from the CRC16 */
+
+/* Available CRC16 engines */
+#define CRC16_ENGINE_BITWISE    0   /* 8 shifts per byte, no table */
+#define CRC16_ENGINE_TABLE      1   /* one 256-entry table, one lookup per byte */
+#define CRC16_ENGINE_SLICE4     2   /* 4 tables, 4 bytes per iteration */
+#define CRC16_ENGINE_SLICE8     3   /* 8 tables, 8 bytes per iteration */
+#define CRC16_ENGINE_HW         4   /* CRC peripheral, fed 32 bits at a time */
+
+/* Engine selection, can be overridden from the build options.
+ * Builds without the device headers (host tools) use a software engine. */
+#ifndef CRC16_ENGINE
+#if defined(STM32U545xx)
+#define CRC16_ENGINE            CRC16_ENGINE_HW
+#else
+#define CRC16_ENGINE            CRC16_ENGINE_SLICE4
+#endif
+#endif
+
+/* The CRC-32 uses the peripheral whenever the CRC16 does */
+#ifndef CRC32_ENGINE
+#if (CRC16_ENGINE == CRC16_ENGINE_HW)
+#define CRC32_ENGINE            CRC32_ENGINE_HW
+#else
+#define CRC32_ENGINE            CRC32_ENGINE_TABLE
+#endif
+#endif
+
+/* Lookup tables placement: 0 = flash (.rodata), 1 = RAM (.data) */
+#ifndef CRC16_TABLES_IN_RAM
+#define CRC16_TABLES_IN_RAM     0
+#endif
+
+/* Exported functions ------------------------------------------------------- */
+void Crc16_Init(void);
+uint16_t Crc16_Update(uint16_t crc, const uint8_t *p_data, uint32_t size);
+uint16_t Crc16_Calc(const uint8_t *p_data, uint32_t size);
+uint32_t Crc32_Update(uint32_t crc, const uint8_t *p_data, uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CHECKSUM_H__ */
@@ -0,0 +1,76 @@
+/**
+  ******************************************************************************
+  * @file    delta.h
+  * @brief   This file contains the function prototypes of the streaming
+  *          delta patcher used for images sent as a patch of the running one.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __DELTA_H__
+#define __DELTA_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Patch format, see Tools/delta.py: a sequence of operations, each an opcode
+ * byte followed by its arguments as LEB128 numbers (7 bits per byte, least
+ * significant first, bit 7 set when more bytes follow).
+ *   DELTA_OP_COPY   offset, length: bytes of the base image
+ *   DELTA_OP_INSERT length, then the bytes themselves                     */
+#define DELTA_OP_COPY           0x01U
+#define DELTA_OP_INSERT         0x02U
+#define DELTA_CHUNK_SIZE        4096U   /* output chunk, RAM used for staging */
+#define DELTA_OUTPUT_ALIGN      16U     /* flash quadword */
+#define DELTA_ERROR             0xFFFFFFFFU /* corrupt patch, not a sink error */
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Patched data sink: returns 0 when the data was stored
+  */
+typedef uint32_t (*DELTA_OutputTypeDef)(const uint8_t *p_data, uint32_t length);
+
+/**
+  * @brief  Patcher state, kept between input chunks
+  */
+typedef struct
+{
+  uint8_t  buffer[DELTA_CHUNK_SIZE] __attribute__((aligned(4)));
+  const uint8_t *p_base; /* base image, memory mapped */
+  uint32_t base_size; /* bytes of the base image */
+  uint32_t pos;       /* next output byte in buffer */
+  uint32_t total;     /* bytes produced */
+  uint32_t state;     /* parser state */
+  uint32_t op;        /* operation being parsed */
+  uint32_t arg;       /* arguments parsed */
+  uint32_t value;     /* number being parsed */
+  uint32_t shift;     /* bits of value already parsed */
+  uint32_t offset;    /* copy offset */
+  uint32_t length;    /* bytes left to copy or insert */
+} DELTA_PatcherTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void DELTA_Init(DELTA_PatcherTypeDef *p_patcher, const uint8_t *p_base, uint32_t base_size);
+uint32_t DELTA_Patch(DELTA_PatcherTypeDef *p_patcher, const uint8_t *p_data, uint32_t size, DELTA_OutputTypeDef output);
+uint32_t DELTA_Finish(DELTA_PatcherTypeDef *p_patcher, DELTA_OutputTypeDef output);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DELTA_H__ */
@@ -38,7 +38,8 @@ enum {
 	FLASHIF_OK = 0,
 	FLASHIF_ERASEKO,
 	FLASHIF_WRITINGCTRL_ERROR,
-	FLASHIF_WRITING_ERROR
+	FLASHIF_WRITING_ERROR,
+	FLASHIF_BUSY
 };
 
 #if defined(STM32U535xx) || defined(STM32U545xx)
@@ -48,15 +49,140 @@ enum {
 #error "Not compatible"
 #endif
 
+/* The last page of a bank keeps the download checkpoints, images stop before it */
+#define FLASH_CHECKPOINT_PAGE   (FLASH_PAGE_NB - 1U)
+#define FLASH_IMAGE_SIZE        (FLASH_BANK_SIZE - FLASH_PAGE_SIZE)
+#define FLASH_CHECKPOINT_MAGIC  ((uint32_t)0x50434B43) /* "CKCP" */
+
+/* Programming granules: a quadword, or a burst of 8 quadwords aligned on
+ * its size, written with a single wait for the flash                     */
+#define FLASH_QUADWORD_SIZE     16U
+#define FLASH_BURST_SIZE        (FLASH_NB_WORDS_IN_BURST * 4U)   /* 128 bytes */
+#define FLASH_PROGRAM_QUADWORD  0U
+#define FLASH_PROGRAM_BURST     1U
+
+/* Flash session: the bank being written stays unlocked from begin to end.
+ * Set FLASH_SESSION_ICACHE to 0 to switch the ICACHE off around every
+ * operation instead, as outside a session, and compare the ICACHE report
+ * of the menu.                                                          */
+#define FLASH_SESSION_ICACHE    1U
+#define FLASH_SESSION_MPU_REGION MPU_REGION_NUMBER0  /* non-cacheable bank */
+#define FLASH_SESSION_MPU_ATTRIBUTES MPU_ATTRIBUTES_NUMBER7 /* its attributes */
+
+/* Deferred verification: in a session, the data programmed in order from
+ * the start of an image page goes in a CRC-32 of the page, checked against
+ * the flash by FLASH_Session_Verify(). Other writes are read back at once,
+ * as outside a session. Set FLASH_SESSION_VERIFY to 0 to read every write
+ * back at once.                                                         */
+#define FLASH_SESSION_VERIFY    1U
+#define FLASH_SESSION_PAGES     32U     /* image pages with a digest */
+
+/**
+  * @brief  Flash session report
+  */
+typedef struct
+{
+  uint32_t readbacks; /* writes read back at once */
+  uint32_t verified;  /* bytes checked against a page digest */
+  uint32_t verify_ms; /* time spent checking them */
+  uint32_t mismatches; /* pages that differ from their digest */
+  uint32_t erase_us;  /* flash busy erasing, needs the DWT cycle counter */
+  uint32_t program_us; /* flash busy programming, queued or not */
+} FLASH_SessionStatsTypeDef;
+
+/* Programming speed measure, on the checkpoint page of the inactive bank */
+#define FLASH_BENCH_RUNS        4U
+
+/**
+  * @brief  Programming speed, bytes per millisecond
+  */
+typedef struct
+{
+  uint32_t quadword;  /* one quadword per operation */
+  uint32_t burst;     /* bursts of 8 quadwords */
+} FLASH_BenchTypeDef;
+
+/**
+  * @brief  Download progress record, appended to the checkpoint page
+  */
+typedef struct
+{
+  uint32_t magic;     /* FLASH_CHECKPOINT_MAGIC */
+  uint32_t name;      /* CRC-32 of the file name */
+  uint32_t size;      /* file size */
+  uint32_t hash;      /* file CRC-32 announced by the sender */
+  uint32_t offset;    /* bytes programmed, page aligned */
+  uint32_t digest;    /* CRC-32 of the page CRC-32s up to offset */
+  uint32_t reserved;
+  uint32_t check;     /* CRC-32 of the fields above */
+} FLASH_CheckpointTypeDef;
+
+/* Asynchronous flash engine: erase and program operations are queued and
+ * run one after the other from the FLASH interrupt. The caller owns each
+ * operation and its data until the status leaves FLASHIF_BUSY.      */
+#define FLASH_QUEUE_DEPTH       8U
+#define FLASH_QUEUE_TIMEOUT     5000U   /* ms, longest wait for the queue */
+#define FLASH_OP_ERASE          0U
+#define FLASH_OP_PROGRAM        1U
+
+/**
+  * @brief  Queued flash operation
+  */
+typedef struct
+{
+  uint32_t type;      /* FLASH_OP_ERASE or FLASH_OP_PROGRAM */
+  uint32_t bank;      /* erase: bank */
+  uint32_t page;      /* erase: first page */
+  uint32_t nb_pages;  /* erase: number of pages */
+  uint32_t address;   /* program: destination, quadword aligned */
+  const uint8_t *p_data; /* program: source */
+  uint32_t length;    /* program: bytes, a multiple of 16 */
+  uint32_t done;      /* program: bytes programmed */
+  uint32_t check;     /* program: read each step back */
+  volatile uint32_t status; /* FLASHIF_BUSY, then FLASHIF_OK or the error */
+} FLASH_QueueOpTypeDef;
+
+/**
+  * @brief  Asynchronous flash engine statistics
+  */
+typedef struct
+{
+  uint32_t queued;    /* operations accepted */
+  uint32_t completed; /* operations done, errors included */
+  uint32_t errors;    /* operations failed */
+  uint32_t full;      /* operations refused, queue full */
+  uint32_t depth;     /* operations in the queue */
+  uint32_t depth_max; /* highest depth seen */
+} FLASH_QueueStatsTypeDef;
+
 /* USER CODE END Private defines */
 
 void MX_FLASH_Init(void);
 
 /* USER CODE BEGIN Prototypes */
 uint32_t FLASH_BankErase(uint32_t bank);
+uint32_t FLASH_PagesErase(uint32_t bank, uint32_t page, uint32_t nb_pages);
+uint32_t FLASH_CheckpointRead(uint32_t bank, FLASH_CheckpointTypeDef *p_checkpoint);
+uint32_t FLASH_CheckpointWrite(uint32_t bank, FLASH_CheckpointTypeDef *p_checkpoint, FLASH_QueueOpTypeDef *p_op);
+uint32_t FLASH_CheckpointClear(uint32_t bank);
 uint32_t FLASH_Write(uint32_t addr, const void *data, uint32_t cnt);
+uint32_t FLASH_Bench(uint32_t bank, FLASH_BenchTypeDef *p_bench);
 uint32_t Flash_Get_ActiveBank(void);
+uint32_t Flash_Get_BankAddress(uint32_t bank);
+uint32_t Flash_Get_ImageSize(uint32_t bank);
+uint32_t Flash_Is_Erased(uint32_t addr, uint32_t cnt);
 void Flash_BankSwap(void);
+uint32_t FLASH_Session_Begin(uint32_t bank);
+uint32_t FLASH_Session_Verify(void);
+uint32_t FLASH_Session_Digest(uint32_t addr, uint32_t *p_digest);
+void FLASH_Session_End(void);
+void FLASH_Session_GetStats(FLASH_SessionStatsTypeDef *p_stats);
+uint32_t FLASH_Queue_Erase(FLASH_QueueOpTypeDef *p_op, uint32_t bank, uint32_t page, uint32_t nb_pages);
+uint32_t FLASH_Queue_Program(FLASH_QueueOpTypeDef *p_op, uint32_t addr, const void *data, uint32_t cnt);
+uint32_t FLASH_Queue_Poll(void);
+uint32_t FLASH_Queue_Wait(FLASH_QueueOpTypeDef *p_op, uint32_t timeout);
+void FLASH_Queue_GetStats(FLASH_QueueStatsTypeDef *p_stats);
+void FLASH_Queue_IRQHandler(void);
 
 /* USER CODE END Prototypes */
 
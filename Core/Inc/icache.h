@@ -33,12 +33,30 @@ extern "C" {
 /* USER CODE END Includes */
 
 /* USER CODE BEGIN Private defines */
+/* Phases the hit/miss monitors are counted for */
+#define ICACHE_PHASE_MENU       0U      /* console, waiting for a choice */
+#define ICACHE_PHASE_HEADER     1U      /* download start, block 0 and erase */
+#define ICACHE_PHASE_DATA       2U      /* data packets streaming */
+#define ICACHE_PHASE_VERIFY     3U      /* end of file, checks of the image */
+#define ICACHE_PHASES           4U
 
+/**
+  * @brief  ICACHE monitors, per phase since ICACHE_Monitor_Init()
+  */
+typedef struct
+{
+  uint32_t hits[ICACHE_PHASES];
+  uint32_t misses[ICACHE_PHASES];
+  uint32_t associativity;   /* ICACHE_1WAY or ICACHE_2WAYS */
+} ICACHE_ReportTypeDef;
 /* USER CODE END Private defines */
 
 void MX_ICACHE_Init(void);
 
 /* USER CODE BEGIN Prototypes */
+void ICACHE_Monitor_Init(void);
+void ICACHE_Monitor_Phase(uint32_t phase);
+void ICACHE_Monitor_GetReport(ICACHE_ReportTypeDef *p_report);
 
 /* USER CODE END Prototypes */
 
@@ -0,0 +1,72 @@
+/**
+  ******************************************************************************
+  * @file    lzss.h
+  * @brief   This file contains the function prototypes of the streaming
+  *          LZSS decoder used for compressed images.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __LZSS_H__
+#define __LZSS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Compressed format, see Tools/lzss.py:
+ * a flag byte announces 8 items, LSB first. A set bit is a literal byte,
+ * a clear bit a match of 2 bytes: distance - 1 on 12 bits (low byte first,
+ * then the high nibble) and length - LZSS_MIN_MATCH on 4 bits. The length
+ * nibble 15 is followed by one more byte added to the length.            */
+#define LZSS_WINDOW_BITS        12U
+#define LZSS_WINDOW_SIZE        (1U << LZSS_WINDOW_BITS)   /* also the output chunk */
+#define LZSS_MIN_MATCH          3U
+#define LZSS_NIBBLE_MAX         15U
+#define LZSS_MAX_MATCH          (LZSS_MIN_MATCH + LZSS_NIBBLE_MAX + 255U)
+#define LZSS_OUTPUT_ALIGN       16U                        /* flash quadword */
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Decoded data sink: returns 0 when the data was stored
+  */
+typedef uint32_t (*LZSS_OutputTypeDef)(const uint8_t *p_data, uint32_t length);
+
+/**
+  * @brief  Decoder state, kept between input chunks
+  */
+typedef struct
+{
+  uint8_t  window[LZSS_WINDOW_SIZE] __attribute__((aligned(4)));
+  uint32_t pos;       /* next output byte in window */
+  uint32_t total;     /* bytes decoded */
+  uint32_t flags;     /* item flags, shifted as consumed */
+  uint32_t items;     /* items left under the flag byte */
+  uint32_t state;     /* parser state */
+  uint32_t match;     /* match being parsed */
+} LZSS_DecoderTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void LZSS_Init(LZSS_DecoderTypeDef *p_decoder);
+uint32_t LZSS_Decode(LZSS_DecoderTypeDef *p_decoder, const uint8_t *p_data, uint32_t size, LZSS_OutputTypeDef output);
+uint32_t LZSS_Finish(LZSS_DecoderTypeDef *p_decoder, LZSS_OutputTypeDef output);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LZSS_H__ */
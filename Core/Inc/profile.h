@@ -0,0 +1,87 @@
+/**
+  ******************************************************************************
+  * @file    profile.h
+  * @brief   This file contains the markers and the function prototypes of
+  *          the cycle counter profiler of the hot paths.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* Set PROFILE_ENABLED to 0 to compile the markers and the profiler out,
+ * it can be overridden from the build options.
+ * PROFILE_HISTOGRAM adds, per site, a histogram of the durations with one
+ * bin per power of two cycles: bin n counts 2^n to 2^(n+1) - 1 cycles. */
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED         1U
+#endif
+#define PROFILE_HISTOGRAM       1U
+#define PROFILE_BINS            24U     /* longer durations go in the last bin */
+
+/* Profiled sites */
+#define PROFILE_SITE_PACKET     0U      /* ReceivePacket(), first byte excluded */
+#define PROFILE_SITE_CRC16      1U      /* Crc16_Calc() */
+#define PROFILE_SITE_WRITE      2U      /* FLASH_Write() */
+#define PROFILE_SITE_ERASE      3U      /* FLASH_BankErase() and FLASH_PagesErase() */
+#define PROFILE_SITES           4U
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Durations of a site, in DWT cycles
+  */
+typedef struct
+{
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t total;     /* mean = total / count */
+#if (PROFILE_HISTOGRAM != 0U)
+  uint32_t bins[PROFILE_BINS];
+#endif
+} PROFILE_SiteTypeDef;
+
+/* Exported macro ------------------------------------------------------------*/
+#if (PROFILE_ENABLED != 0U)
+/* Scoped markers: BEGIN opens the measure of a site in a block, END closes
+ * it in the same block. A path leaving the block in between is not counted. */
+#define PROFILE_BEGIN(site)     const uint32_t profile_start_##site = DWT->CYCCNT
+#define PROFILE_END(site)       Profile_Record((site), DWT->CYCCNT - profile_start_##site)
+#else
+#define PROFILE_BEGIN(site)     do { } while (0)
+#define PROFILE_END(site)       do { } while (0)
+#endif
+
+/* Exported functions ------------------------------------------------------- */
+void Profile_CycleCounterInit(void);
+#if (PROFILE_ENABLED != 0U)
+void Profile_Init(void);
+void Profile_Reset(void);
+void Profile_Record(uint32_t site, uint32_t cycles);
+void Profile_Get(uint32_t site, PROFILE_SiteTypeDef *p_site);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PROFILE_H__ */
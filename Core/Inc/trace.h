@@ -0,0 +1,100 @@
+/**
+  ******************************************************************************
+  * @file    trace.h
+  * @brief   This file contains the events and the function prototypes of the
+  *          binary event trace kept in SRAM4.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* Set TRACE_ENABLED to 0 to compile the trace points and the ring out.
+ * The ring lives in the .trace section, NOLOAD in SRAM4: it is neither
+ * loaded nor cleared by the startup, so it survives a reset. Decode a dump
+ * of it with Tools/trace.py.                                            */
+#define TRACE_ENABLED           1U
+#define TRACE_MAGIC             ((uint32_t)0x45434154) /* "TACE" */
+#define TRACE_VERSION           1U
+#define TRACE_SIZE              (16U * 1024U)          /* SRAM4 */
+#define TRACE_RECORDS           ((TRACE_SIZE - sizeof(TRACE_HeaderTypeDef)) / sizeof(TRACE_RecordTypeDef))
+
+/* Events: arg16 / arg */
+#define TRACE_EV_SESSION        0x01U   /* reception start: options / bank */
+#define TRACE_EV_END            0x02U   /* reception end: - / COM_StatusTypeDef */
+#define TRACE_EV_PACKET         0x03U   /* packet in: block number / length */
+#define TRACE_EV_ACK            0x04U   /* ACK sent: block number / - */
+#define TRACE_EV_NAK            0x05U   /* retransmission asked: block number / - */
+#define TRACE_EV_BAD_PACKET     0x06U   /* packet refused: - / HAL_StatusTypeDef */
+#define TRACE_EV_RETRY          0x07U   /* no valid packet: errors in a row / - */
+#define TRACE_EV_BAUD           0x08U   /* baud rate switched: - / rate */
+#define TRACE_EV_ERASE          0x10U   /* erase started: pages / first page */
+#define TRACE_EV_PROGRAM        0x11U   /* programming started: quadwords / address */
+#define TRACE_EV_FLASH_DONE     0x12U   /* flash operation done: type / FLASHIF_xxx */
+#define TRACE_EV_ERROR          0x20U   /* transfer ended in error: - / FLASHIF_xxx */
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Ring header, at the start of SRAM4
+  */
+typedef struct
+{
+  uint32_t magic;     /* TRACE_MAGIC once cleared */
+  uint16_t version;   /* TRACE_VERSION */
+  uint16_t record_size; /* sizeof(TRACE_RecordTypeDef) */
+  uint32_t capacity;  /* records in the ring */
+  uint32_t written;   /* records since the clear, the ring keeps the last ones */
+  uint32_t clock;     /* timestamp rate, Hz */
+  uint32_t reserved[3];
+} TRACE_HeaderTypeDef;
+
+/**
+  * @brief  Trace record, written as is
+  */
+typedef struct
+{
+  uint32_t time;      /* DWT cycle counter */
+  uint16_t event;     /* TRACE_EV_xxx */
+  uint16_t arg16;
+  uint32_t arg;
+} TRACE_RecordTypeDef;
+
+/* Exported macro ------------------------------------------------------------*/
+#if (TRACE_ENABLED != 0U)
+#define TRACE(event, arg16, arg) Trace_Event((event), (uint32_t)(arg16), (uint32_t)(arg))
+#else
+#define TRACE(event, arg16, arg) do { } while (0)
+#endif
+
+/* Exported functions ------------------------------------------------------- */
+#if (TRACE_ENABLED != 0U)
+void Trace_Init(void);
+void Trace_Clear(void);
+void Trace_Event(uint32_t event, uint32_t arg16, uint32_t arg);
+const uint8_t *Trace_Buffer(uint32_t *p_size);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TRACE_H__ */
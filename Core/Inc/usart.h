@@ -35,6 +35,25 @@ extern "C" {
 extern UART_HandleTypeDef huart1;
 
 /* USER CODE BEGIN Private defines */
+/* RX ring size, must be a power of two */
+#define UART_RX_RING_SIZE       ((uint32_t)16384) /* two 8K frames, for flash writes at 2 Mbaud */
+/* Line silence, in bit times, that ends a burst (about 20 ms) */
+#define UART_RX_TIMEOUT_BITS    (huart1.Init.BaudRate / 50U)
+/* Console rate, restored at the end of every transfer session */
+#define UART_BAUD_DEFAULT       ((uint32_t)115200)
+/* Largest baud rate error accepted, in per mille */
+#define UART_BAUD_TOLERANCE     ((uint32_t)15)
+
+/**
+  * @brief  Reception counters, since uart_rx_stats_reset()
+  */
+typedef struct
+{
+  uint32_t overruns;  /* bytes lost, the ring restarted */
+  uint32_t framing;   /* framing errors */
+  uint32_t noise;     /* noise and parity errors */
+  uint32_t wait_us;   /* time spent in uart_read() waiting for bytes */
+} UART_StatsTypeDef;
 
 /* USER CODE END Private defines */
 
@@ -43,6 +62,21 @@ void MX_USART1_UART_Init(void);
 /* USER CODE BEGIN Prototypes */
 void uart_write_byte(uint8_t byte);
 void uart_write_string(void *p_buffer, uint16_t size);
+HAL_StatusTypeDef uart_write_dma(const uint8_t *p_buffer, uint16_t size);
+HAL_StatusTypeDef uart_tx_wait(uint32_t timeout);
+HAL_StatusTypeDef uart_rx_start(void);
+void uart_rx_stop(void);
+uint32_t uart_rx_available(void);
+void uart_rx_flush(void);
+void uart_rx_purge(uint32_t quiet);
+HAL_StatusTypeDef uart_read(uint8_t *p_data, uint32_t size, uint32_t timeout);
+HAL_StatusTypeDef uart_read_frame(uint8_t *p_data, uint32_t size, uint32_t timeout);
+void uart_rx_irq(void);
+uint32_t uart_baud_supported(uint32_t baud);
+uint32_t uart_get_baud(void);
+HAL_StatusTypeDef uart_set_baud(uint32_t baud);
+void uart_rx_stats_reset(void);
+void uart_rx_stats(UART_StatsTypeDef *p_stats);
 
 /* USER CODE END Prototypes */
 
@@ -34,8 +34,35 @@ typedef enum
   COM_ABORT    = 0x02,
   COM_TIMEOUT  = 0x03,
   COM_DATA     = 0x04,
-  COM_LIMIT    = 0x05
+  COM_LIMIT    = 0x05,
+  COM_BASE     = 0x06
 } COM_StatusTypeDef;
+
+/**
+  * @brief  Flash work of the last Ymodem_Receive() session
+  */
+typedef struct
+{
+  uint32_t pages_written;   /* pages erased, then programmed or copied */
+  uint32_t pages_skipped;   /* pages already holding the data */
+  uint32_t packets;         /* data packets */
+  uint32_t handling_us;     /* from a data packet in to the receiver ready */
+  uint32_t handling_max_us; /* for the next one, total and worst case */
+  uint32_t result;          /* COM_StatusTypeDef of the reception */
+  uint32_t bytes;           /* file bytes received, padding excluded */
+  uint32_t naks;            /* retransmissions asked */
+  uint32_t crc_errors;      /* packets with a bad CRC */
+  uint32_t uart_overruns;   /* ring restarts, bytes lost */
+  uint32_t uart_framing;    /* framing, noise and parity errors */
+  uint32_t uart_wait_us;    /* waiting for bytes from the sender */
+  uint32_t crc_us;          /* checking the packet CRCs */
+  uint32_t erase_us;        /* flash busy erasing */
+  uint32_t program_us;      /* flash busy programming */
+  uint32_t verify_ms;       /* checking the flash against the digests */
+  uint32_t duration_ms;     /* whole reception */
+  uint32_t throughput;      /* file bytes per second over the reception */
+  uint32_t ack_max_us;      /* worst data packet in to its acknowledgement */
+} YMODEM_StatsTypeDef;
 /**
   * @}
   */
@@ -48,9 +75,16 @@ typedef enum
 #define PACKET_NUMBER_INDEX     ((uint32_t)2)
 #define PACKET_CNUMBER_INDEX    ((uint32_t)3)
 #define PACKET_TRAILER_SIZE     ((uint32_t)2)
+#define PACKET_CONTROL_SIZE     ((uint32_t)3)     /* windowed ACK/NAK: code, number, ~number */
 #define PACKET_OVERHEAD_SIZE    (PACKET_HEADER_SIZE + PACKET_TRAILER_SIZE - 1)
 #define PACKET_SIZE             ((uint32_t)128)
 #define PACKET_1K_SIZE          ((uint32_t)1024)
+#define PACKET_4K_SIZE          ((uint32_t)4096)  /* extended frame, negotiated */
+#define PACKET_8K_SIZE          ((uint32_t)8192)  /* extended frame, one flash page */
+#define PACKET_MAX_SIZE         PACKET_8K_SIZE
+#define PACKET_BUFFER_SIZE      ((PACKET_MAX_SIZE + PACKET_DATA_INDEX + PACKET_TRAILER_SIZE + 3U) & ~3U)
+#define PACKET_BUFFERS          ((uint32_t)2)     /* packets received while earlier ones are programmed */
+#define COMBINE_BUFFERS         ((uint32_t)2)     /* raw image pages, one fills while one programs */
 
 /* /-------- Packet in IAP memory ------------------------------------------\
  * | 0      |  1    |  2     |  3   |  4      | ... | n+4     | n+5  | n+6  | 
@@ -64,11 +98,14 @@ typedef enum
 
 #define SOH                     ((uint8_t)0x01)  /* start of 128-byte data packet */
 #define STX                     ((uint8_t)0x02)  /* start of 1024-byte data packet */
+#define STX_4K                  ((uint8_t)0x03)  /* start of 4096-byte data packet (extension) */
+#define STX_8K                  ((uint8_t)0x05)  /* start of 8192-byte data packet (extension) */
 #define EOT                     ((uint8_t)0x04)  /* end of transmission */
 #define ACK                     ((uint8_t)0x06)  /* acknowledge */
 #define NAK                     ((uint8_t)0x15)  /* negative acknowledge */
 #define CA                      ((uint32_t)0x18) /* two of these in succession aborts transfer */
 #define CRC16                   ((uint8_t)0x43)  /* 'C' == 0x43, request 16-bit CRC */
+#define CRC_G                   ((uint8_t)0x47)  /* 'G' == 0x47, request YMODEM-g streaming */
 #define NEGATIVE_BYTE           ((uint8_t)0xFF)
 
 #define ABORT1                  ((uint8_t)0x41)  /* 'A' == 0x41, abort by user */
@@ -76,11 +113,61 @@ typedef enum
 
 #define NAK_TIMEOUT             ((uint32_t)0x100000)
 #define DOWNLOAD_TIMEOUT        ((uint32_t)10000) /* 10 second retry delay */
+#define PACKET_TX_TIMEOUT       ((uint32_t)1000)  /* longest time to send one packet */
+#define PACKET_PURGE_TIMEOUT    ((uint32_t)50)    /* line quiet time before re-requesting a packet */
 #define MAX_ERRORS              ((uint32_t)5)
+#define YMODEM_G_POLLS          ((uint32_t)3)     /* 'G' polls before falling back to 'C' */
+
+/* Session extensions: " @key=value" items after the file size in block 0.
+ * The receiver echoes the accepted value as "@key=value\n" right after
+ * the header ACK. Stock peers neither send nor expect them.          */
+#define YMODEM_EXT_PREFIX       ((uint8_t)'@')
+#define YMODEM_EXT_END          ((uint8_t)'\n')
+#define YMODEM_EXT_LENGTH       ((uint32_t)32)
+#define YMODEM_KEY_BLOCK        "blk"             /* largest data frame, in bytes */
+#define YMODEM_KEY_BAUD         "baud"            /* line rate for the rest of the session */
+#define YMODEM_KEY_WINDOW       "win"             /* frames in flight, windowed engine */
+#define YMODEM_KEY_HASH         "hash"            /* CRC-32 of the whole file, enables resuming */
+#define YMODEM_KEY_RESUME       "resume"          /* file offset of data block 1 */
+#define YMODEM_KEY_LZSS         "lzss"            /* LZSS compressed file, decoded image size */
+#define YMODEM_KEY_DELTA        "delta"           /* patch of the running image, new image size */
+#define YMODEM_KEY_BASE         "base"            /* CRC-32 of the image the patch was made against */
+#define YMODEM_KEY_PAGEHASH     "pagehash"        /* empty file asking for the page hashes, page count */
+#define YMODEM_KEY_PAGE_ACTIVE  "pa"              /* CRC-32 of a page of the running image */
+#define YMODEM_KEY_PAGE_INACTIVE "pi"             /* CRC-32 of the same page in the other bank */
+#define YMODEM_KEY_PAGES        "pages"           /* file of changed pages, new image size */
+#define YMODEM_KEY_SEND         "send"            /* pages in the file, bit n for page n */
+#define YMODEM_KEY_COPY         "copy"            /* pages copied from the running image */
+
+/* Paged update: a first, empty file with "@pagehash" gets the CRC-32 of
+ * every page of both banks, as "@pagehash=n" then n pairs of "@pa" and
+ * "@pi" lines. The sender then sends only the pages that differ from
+ * both, whole and in page order, in a file with "@pages", "@send" and
+ * "@copy". The other pages of the image are kept as they are.       */
+#define YMODEM_PAGES_MAX        ((uint32_t)32)    /* page masks are 32 bits */
+
+/* Windowed engine: every frame but the last one has the negotiated size.
+ * The receiver answers ACK n ~n (blocks up to n received) and asks for a
+ * lost block with NAK n ~n; the sender retransmits only that block.
+ * The window is bounded so the frames in flight fit in the RX ring. */
+#define YMODEM_WINDOW_MAX       ((uint32_t)8)
+
+/* Baud rate negotiation: the receiver switches after its "@baud" line and
+ * polls at the new rate. Both sides go back to UART_BAUD_DEFAULT after
+ * YMODEM_BAUD_FALLBACK failures at the negotiated rate.              */
+#define YMODEM_BAUD_SWITCH_DELAY ((uint32_t)20)   /* ms for the sender to follow */
+#define YMODEM_BAUD_PROBE_TIMEOUT ((uint32_t)1000) /* first packet at the new rate */
+#define YMODEM_BAUD_FALLBACK    ((uint32_t)2)
+#define YMODEM_BAUD_STREAMING_MAX ((uint32_t)921600) /* YMODEM-g has no flow control */
+
+/* Ymodem_Receive() options */
+#define YMODEM_OPT_STREAMING    ((uint32_t)0x01)  /* YMODEM-g, needs an error-free line */
+#define YMODEM_OPT_COMPARE      ((uint32_t)0x02)  /* skip the pages already holding the data */
 
 /* Exported functions ------------------------------------------------------- */
-COM_StatusTypeDef Ymodem_Receive(uint32_t *p_size, uint32_t bank);
+COM_StatusTypeDef Ymodem_Receive(uint32_t *p_size, uint32_t bank, uint32_t options);
 COM_StatusTypeDef Ymodem_Transmit(uint8_t *p_buf, const uint8_t *p_file_name, uint32_t file_size);
+void Ymodem_GetStats(YMODEM_StatsTypeDef *p_stats);
 
 #endif  /* __YMODEM_H_ */
 
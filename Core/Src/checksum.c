@@ -0,0 +1,256 @@
+/**
+  ******************************************************************************
+  * @file    checksum.c
+  * @brief   This file provides the CRC16 engines used to validate YMODEM
+  *          packets, selected at build time with CRC16_ENGINE, and the
+  *          CRC-32 used for image digests.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "checksum.h"
+#include "profile.h"
+#if (CRC16_ENGINE == CRC16_ENGINE_HW) || (CRC32_ENGINE == CRC32_ENGINE_HW)
+#include "main.h"
+#endif
+
+/* Private define ------------------------------------------------------------*/
+#if (CRC16_ENGINE == CRC16_ENGINE_HW)
+#define CRC16_TABLES            0U
+#elif (CRC16_ENGINE == CRC16_ENGINE_SLICE8)
+#define CRC16_TABLES            8U
+#elif (CRC16_ENGINE == CRC16_ENGINE_SLICE4)
+#define CRC16_TABLES            4U
+#elif (CRC16_ENGINE == CRC16_ENGINE_TABLE)
+#define CRC16_TABLES            1U
+#elif (CRC16_ENGINE != CRC16_ENGINE_BITWISE)
+#error "Unknown CRC16_ENGINE"
+#endif
+#if (CRC32_ENGINE != CRC32_ENGINE_TABLE) && (CRC32_ENGINE != CRC32_ENGINE_HW)
+#error "Unknown CRC32_ENGINE"
+#endif
+
+#if (CRC16_TABLES_IN_RAM == 1)
+#define CRC16_TABLE_CONST
+#else
+#define CRC16_TABLE_CONST       const
+#endif
+
+/* Private macro -------------------------------------------------------------*/
+/* The tables are generated by the compiler:
+ * aCrc16Table[k][n] is the CRC register after feeding byte n followed by k
+ * zero bytes, starting from 0. The CRC is linear, so each entry is the XOR of
+ * the basis values of the bits set in n. The basis values are enumerators,
+ * which keeps the macro expansion small. */
+#define CRC16_SHIFT(c)          ((((c) << 1) ^ (((c) & 0x8000U) ? CRC16_POLY : 0U)) & 0xFFFFU)
+#define CRC16_SHIFT2(c)         CRC16_SHIFT(CRC16_SHIFT(c))
+#define CRC16_SHIFT4(c)         CRC16_SHIFT2(CRC16_SHIFT2(c))
+#define CRC16_SHIFT8(c)         CRC16_SHIFT4(CRC16_SHIFT4(c))
+
+#define CRC16_BASIS(n, p)       CRC16_B##n##_0 = CRC16_SHIFT8(CRC16_B##p##_0), \
+                                CRC16_B##n##_1 = CRC16_SHIFT8(CRC16_B##p##_1), \
+                                CRC16_B##n##_2 = CRC16_SHIFT8(CRC16_B##p##_2), \
+                                CRC16_B##n##_3 = CRC16_SHIFT8(CRC16_B##p##_3), \
+                                CRC16_B##n##_4 = CRC16_SHIFT8(CRC16_B##p##_4), \
+                                CRC16_B##n##_5 = CRC16_SHIFT8(CRC16_B##p##_5), \
+                                CRC16_B##n##_6 = CRC16_SHIFT8(CRC16_B##p##_6), \
+                                CRC16_B##n##_7 = CRC16_SHIFT8(CRC16_B##p##_7)
+
+#define CRC16_ENTRY(k, n)       ((((n) & 0x01U) ? CRC16_B##k##_0 : 0U) ^ (((n) & 0x02U) ? CRC16_B##k##_1 : 0U) ^ \
+                                 (((n) & 0x04U) ? CRC16_B##k##_2 : 0U) ^ (((n) & 0x08U) ? CRC16_B##k##_3 : 0U) ^ \
+                                 (((n) & 0x10U) ? CRC16_B##k##_4 : 0U) ^ (((n) & 0x20U) ? CRC16_B##k##_5 : 0U) ^ \
+                                 (((n) & 0x40U) ? CRC16_B##k##_6 : 0U) ^ (((n) & 0x80U) ? CRC16_B##k##_7 : 0U))
+#define CRC16_ROW4(k, n)        CRC16_ENTRY(k, (n)), CRC16_ENTRY(k, (n) + 1U), \
+                                CRC16_ENTRY(k, (n) + 2U), CRC16_ENTRY(k, (n) + 3U)
+#define CRC16_ROW16(k, n)       CRC16_ROW4(k, (n)), CRC16_ROW4(k, (n) + 4U), \
+                                CRC16_ROW4(k, (n) + 8U), CRC16_ROW4(k, (n) + 12U)
+#define CRC16_ROW64(k, n)       CRC16_ROW16(k, (n)), CRC16_ROW16(k, (n) + 16U), \
+                                CRC16_ROW16(k, (n) + 32U), CRC16_ROW16(k, (n) + 48U)
+#define CRC16_TABLE(k)          { CRC16_ROW64(k, 0U), CRC16_ROW64(k, 64U), \
+                                  CRC16_ROW64(k, 128U), CRC16_ROW64(k, 192U) }
+
+/* CRC-32 table: same construction, reflected. The basis values are the
+ * table entries for the single-bit bytes 0x01 to 0x80. */
+#define CRC32_B0                0x77073096U
+#define CRC32_B1                0xEE0E612CU
+#define CRC32_B2                0x076DC419U
+#define CRC32_B3                0x0EDB8832U
+#define CRC32_B4                0x1DB71064U
+#define CRC32_B5                0x3B6E20C8U
+#define CRC32_B6                0x76DC4190U
+#define CRC32_B7                0xEDB88320U
+#define CRC32_ENTRY(n)          ((((n) & 0x01U) ? CRC32_B0 : 0U) ^ (((n) & 0x02U) ? CRC32_B1 : 0U) ^ \
+                                 (((n) & 0x04U) ? CRC32_B2 : 0U) ^ (((n) & 0x08U) ? CRC32_B3 : 0U) ^ \
+                                 (((n) & 0x10U) ? CRC32_B4 : 0U) ^ (((n) & 0x20U) ? CRC32_B5 : 0U) ^ \
+                                 (((n) & 0x40U) ? CRC32_B6 : 0U) ^ (((n) & 0x80U) ? CRC32_B7 : 0U))
+#define CRC32_ROW4(n)           CRC32_ENTRY(n), CRC32_ENTRY((n) + 1U), CRC32_ENTRY((n) + 2U), CRC32_ENTRY((n) + 3U)
+#define CRC32_ROW16(n)          CRC32_ROW4(n), CRC32_ROW4((n) + 4U), CRC32_ROW4((n) + 8U), CRC32_ROW4((n) + 12U)
+#define CRC32_ROW64(n)          CRC32_ROW16(n), CRC32_ROW16((n) + 16U), CRC32_ROW16((n) + 32U), CRC32_ROW16((n) + 48U)
+
+/* Private variables ---------------------------------------------------------*/
+#if (CRC32_ENGINE == CRC32_ENGINE_TABLE)
+static const uint32_t aCrc32Table[256] =
+{
+  CRC32_ROW64(0U), CRC32_ROW64(64U), CRC32_ROW64(128U), CRC32_ROW64(192U)
+};
+#endif
+
+#if (CRC16_ENGINE != CRC16_ENGINE_BITWISE) && (CRC16_ENGINE != CRC16_ENGINE_HW)
+enum
+{
+  CRC16_B0_0 = CRC16_SHIFT8(0x0100U), CRC16_B0_1 = CRC16_SHIFT8(0x0200U),
+  CRC16_B0_2 = CRC16_SHIFT8(0x0400U), CRC16_B0_3 = CRC16_SHIFT8(0x0800U),
+  CRC16_B0_4 = CRC16_SHIFT8(0x1000U), CRC16_B0_5 = CRC16_SHIFT8(0x2000U),
+  CRC16_B0_6 = CRC16_SHIFT8(0x4000U), CRC16_B0_7 = CRC16_SHIFT8(0x8000U),
+  CRC16_BASIS(1, 0), CRC16_BASIS(2, 1), CRC16_BASIS(3, 2),
+  CRC16_BASIS(4, 3), CRC16_BASIS(5, 4), CRC16_BASIS(6, 5), CRC16_BASIS(7, 6)
+};
+
+static CRC16_TABLE_CONST uint16_t aCrc16Table[CRC16_TABLES][256] =
+{
+  CRC16_TABLE(0),
+#if (CRC16_TABLES > 1U)
+  CRC16_TABLE(1), CRC16_TABLE(2), CRC16_TABLE(3),
+#endif
+#if (CRC16_TABLES > 4U)
+  CRC16_TABLE(4), CRC16_TABLE(5), CRC16_TABLE(6), CRC16_TABLE(7),
+#endif
+};
+#endif
+
+/* Public functions ---------------------------------------------------------*/
+/**
+ * @brief  Prepare the CRC engine.
+ * @note   The HAL CRC driver is not part of this project, the peripheral is
+ *         programmed directly: 16-bit polynomial 0x1021, no bit reversal.
+ * @retval None
+ */
+void Crc16_Init(void) {
+#if (CRC16_ENGINE == CRC16_ENGINE_HW) || (CRC32_ENGINE == CRC32_ENGINE_HW)
+	__HAL_RCC_CRC_CLK_ENABLE();
+#endif
+#if (CRC16_ENGINE == CRC16_ENGINE_HW)
+	CRC->POL = CRC16_POLY;
+	CRC->CR = CRC_CR_POLYSIZE_0;
+#endif
+}
+
+/**
+ * @brief  Continue a CRC16 over a buffer.
+ * @param  crc: CRC of the preceding data, 0 to start
+ * @param  p_data: data
+ * @param  size: data length in bytes
+ * @retval uint16_t updated CRC
+ */
+uint16_t Crc16_Update(uint16_t crc, const uint8_t *p_data, uint32_t size) {
+	uint32_t c = crc;
+#if (CRC16_ENGINE == CRC16_ENGINE_HW)
+	/* Restart the unit from the running value */
+	CRC->INIT = c;
+	CRC->CR |= CRC_CR_RESET;
+	while ((size != 0) && (((uint32_t)p_data & 3U) != 0)) {
+		*(__IO uint8_t *)&CRC->DR = *p_data++;
+		size--;
+	}
+	/* The unit consumes a word MSB first, memory holds it little-endian */
+	while (size >= 4) {
+		CRC->DR = __REV(*(const uint32_t *)p_data);
+		p_data += 4;
+		size -= 4;
+	}
+	while (size--) *(__IO uint8_t *)&CRC->DR = *p_data++;
+	c = CRC->DR & 0xFFFFU;
+#elif (CRC16_ENGINE == CRC16_ENGINE_BITWISE)
+	uint32_t bit;
+	while (size--) {
+		c ^= (uint32_t)*p_data++ << 8;
+		for (bit = 0; bit < 8; bit++) c = CRC16_SHIFT(c);
+	}
+#else
+#if (CRC16_TABLES == 8U)
+	while (size >= 8) {
+		c ^= ((uint32_t)p_data[0] << 8) | p_data[1];
+		c = aCrc16Table[7][c >> 8] ^ aCrc16Table[6][c & 0xFFU] ^ aCrc16Table[5][p_data[2]] ^ aCrc16Table[4][p_data[3]] ^
+		    aCrc16Table[3][p_data[4]] ^ aCrc16Table[2][p_data[5]] ^ aCrc16Table[1][p_data[6]] ^ aCrc16Table[0][p_data[7]];
+		p_data += 8;
+		size -= 8;
+	}
+#endif
+#if (CRC16_TABLES >= 4U)
+	while (size >= 4) {
+		c ^= ((uint32_t)p_data[0] << 8) | p_data[1];
+		c = aCrc16Table[3][c >> 8] ^ aCrc16Table[2][c & 0xFFU] ^ aCrc16Table[1][p_data[2]] ^ aCrc16Table[0][p_data[3]];
+		p_data += 4;
+		size -= 4;
+	}
+#endif
+	while (size--) c = ((c << 8) & 0xFFFFU) ^ aCrc16Table[0][(c >> 8) ^ *p_data++];
+#endif
+	return (uint16_t)c;
+}
+
+/**
+ * @brief  Continue a CRC-32 over a buffer.
+ * @note   Same convention as zlib crc32(): start from 0, feed the result of
+ *         the previous call to continue. The peripheral engine borrows the
+ *         unit from the CRC16 and gives it back: never call it from an
+ *         interrupt.
+ * @param  crc: CRC of the preceding data, 0 to start
+ * @param  p_data: data
+ * @param  size: data length in bytes
+ * @retval uint32_t updated CRC
+ */
+uint32_t Crc32_Update(uint32_t crc, const uint8_t *p_data, uint32_t size) {
+#if (CRC32_ENGINE == CRC32_ENGINE_HW)
+	uint32_t pol = CRC->POL, cr = CRC->CR, c;
+	/* The unit runs the polynomial unreflected: bytes and result are bit
+	 * reversed, the running value goes in reversed too */
+	CRC->POL = CRC32_POLY_NORMAL;
+	CRC->CR = CRC_CR_REV_IN_0 | CRC_CR_REV_OUT;
+	CRC->INIT = __RBIT(~crc);
+	CRC->CR |= CRC_CR_RESET;
+	while ((size != 0) && (((uint32_t)p_data & 3U) != 0)) {
+		*(__IO uint8_t *)&CRC->DR = *p_data++;
+		size--;
+	}
+	while (size >= 4) {
+		CRC->DR = __REV(*(const uint32_t *)p_data);
+		p_data += 4;
+		size -= 4;
+	}
+	while (size--) *(__IO uint8_t *)&CRC->DR = *p_data++;
+	c = ~CRC->DR;
+	/* Back to the CRC16 settings */
+	CRC->POL = pol;
+	CRC->CR = cr;
+	return c;
+#else
+	uint32_t c = ~crc;
+	while (size--) c = (c >> 8) ^ aCrc32Table[(c ^ *p_data++) & 0xFFU];
+	return ~c;
+#endif
+}
+
+/**
+ * @brief  Cal CRC16 for YModem Packet
+ * @param  p_data: data
+ * @param  size: data length in bytes
+ * @retval uint16_t CRC
+ */
+uint16_t Crc16_Calc(const uint8_t *p_data, uint32_t size) {
+	uint16_t crc;
+	PROFILE_BEGIN(PROFILE_SITE_CRC16);
+	crc = Crc16_Update(0, p_data, size);
+	PROFILE_END(PROFILE_SITE_CRC16);
+	return crc;
+}
@@ -0,0 +1,163 @@
+/**
+  ******************************************************************************
+  * @file    delta.c
+  * @brief   This file provides the streaming delta patcher: the new image is
+  *          rebuilt from the base image and a patch taken in chunks of any
+  *          size; output leaves in chunk-sized, quadword-aligned pieces.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "delta.h"
+#include "string.h"
+
+/* Private define ------------------------------------------------------------*/
+/* Parser states */
+#define DELTA_STATE_OP          0U  /* waiting for an opcode */
+#define DELTA_STATE_ARG         1U  /* waiting for an argument byte */
+#define DELTA_STATE_DATA        2U  /* waiting for inserted bytes */
+
+#define DELTA_VALUE_BITS        32U
+
+/* Private functions ---------------------------------------------------------*/
+/**
+ * @brief  Append bytes to the staging buffer, flush it when full.
+ * @param  p_patcher: patcher
+ * @param  p_data: bytes
+ * @param  length: number of bytes
+ * @param  output: sink for the full chunks
+ * @retval 0, or the sink error
+ */
+static uint32_t DELTA_Put(DELTA_PatcherTypeDef *p_patcher, const uint8_t *p_data, uint32_t length, DELTA_OutputTypeDef output) {
+	uint32_t error = 0, count;
+	while ((length != 0U) && (error == 0U)) {
+		count = DELTA_CHUNK_SIZE - p_patcher->pos;
+		if (count > length) count = length;
+		memcpy(&p_patcher->buffer[p_patcher->pos], p_data, count);
+		p_patcher->pos += count;
+		p_patcher->total += count;
+		p_data += count;
+		length -= count;
+		if (p_patcher->pos == DELTA_CHUNK_SIZE) {
+			error = output(p_patcher->buffer, DELTA_CHUNK_SIZE);
+			p_patcher->pos = 0;
+		}
+	}
+	return error;
+}
+
+/**
+ * @brief  An operation has all its arguments, start it.
+ * @param  p_patcher: patcher
+ * @param  output: sink for the full chunks
+ * @retval 0, DELTA_ERROR or the sink error
+ */
+static uint32_t DELTA_Execute(DELTA_PatcherTypeDef *p_patcher, DELTA_OutputTypeDef output) {
+	if (p_patcher->op == DELTA_OP_INSERT) {
+		p_patcher->state = (p_patcher->length != 0U) ? DELTA_STATE_DATA : DELTA_STATE_OP;
+		return 0;
+	}
+	p_patcher->state = DELTA_STATE_OP;
+	/* Copies stay inside the base image */
+	if ((p_patcher->length > p_patcher->base_size) || (p_patcher->offset > (p_patcher->base_size - p_patcher->length))) return DELTA_ERROR;
+	return DELTA_Put(p_patcher, &p_patcher->p_base[p_patcher->offset], p_patcher->length, output);
+}
+
+/* Public functions ---------------------------------------------------------*/
+/**
+ * @brief  Reset the patcher for a new patch.
+ * @param  p_patcher: patcher
+ * @param  p_base: base image, read in place
+ * @param  base_size: bytes of the base image
+ * @retval None
+ */
+void DELTA_Init(DELTA_PatcherTypeDef *p_patcher, const uint8_t *p_base, uint32_t base_size) {
+	p_patcher->p_base = p_base;
+	p_patcher->base_size = base_size;
+	p_patcher->pos = 0;
+	p_patcher->total = 0;
+	p_patcher->state = DELTA_STATE_OP;
+	p_patcher->op = 0;
+	p_patcher->arg = 0;
+	p_patcher->value = 0;
+	p_patcher->shift = 0;
+	p_patcher->offset = 0;
+	p_patcher->length = 0;
+}
+
+/**
+ * @brief  Apply a chunk of the patch.
+ * @param  p_patcher: patcher
+ * @param  p_data: patch bytes
+ * @param  size: number of bytes, any split of the patch is allowed
+ * @param  output: sink for the full chunks
+ * @retval 0, DELTA_ERROR or the sink error
+ */
+uint32_t DELTA_Patch(DELTA_PatcherTypeDef *p_patcher, const uint8_t *p_data, uint32_t size, DELTA_OutputTypeDef output) {
+	uint32_t error = 0, count;
+	uint8_t byte;
+	while ((size != 0U) && (error == 0U)) {
+		if (p_patcher->state == DELTA_STATE_DATA) {
+			/* Inserted bytes go to the buffer in one piece */
+			count = (size < p_patcher->length) ? size : p_patcher->length;
+			error = DELTA_Put(p_patcher, p_data, count, output);
+			p_data += count;
+			size -= count;
+			p_patcher->length -= count;
+			if (p_patcher->length == 0U) p_patcher->state = DELTA_STATE_OP;
+			continue;
+		}
+		byte = *p_data++;
+		size--;
+		if (p_patcher->state == DELTA_STATE_OP) {
+			if ((byte != DELTA_OP_COPY) && (byte != DELTA_OP_INSERT)) return DELTA_ERROR;
+			p_patcher->op = byte;
+			p_patcher->arg = 0;
+			p_patcher->value = 0;
+			p_patcher->shift = 0;
+			p_patcher->state = DELTA_STATE_ARG;
+			continue;
+		}
+		/* LEB128 argument */
+		if (p_patcher->shift >= DELTA_VALUE_BITS) return DELTA_ERROR;
+		p_patcher->value |= (uint32_t)(byte & 0x7FU) << p_patcher->shift;
+		p_patcher->shift += 7U;
+		if ((byte & 0x80U) != 0U) continue;
+		if ((p_patcher->op == DELTA_OP_COPY) && (p_patcher->arg == 0U)) {
+			p_patcher->offset = p_patcher->value;
+			p_patcher->arg = 1;
+			p_patcher->value = 0;
+			p_patcher->shift = 0;
+			continue;
+		}
+		p_patcher->length = p_patcher->value;
+		error = DELTA_Execute(p_patcher, output);
+	}
+	return error;
+}
+
+/**
+ * @brief  Flush the patched bytes still in the buffer.
+ * @note   The last chunk is padded with 0xFF (erased flash) to a quadword.
+ * @param  p_patcher: patcher
+ * @param  output: sink
+ * @retval 0, DELTA_ERROR when the patch stops inside an operation, or the
+ *         sink error
+ */
+uint32_t DELTA_Finish(DELTA_PatcherTypeDef *p_patcher, DELTA_OutputTypeDef output) {
+	uint32_t length = (p_patcher->pos + DELTA_OUTPUT_ALIGN - 1U) & ~(DELTA_OUTPUT_ALIGN - 1U);
+	if (p_patcher->state != DELTA_STATE_OP) return DELTA_ERROR;
+	if (length == 0U) return 0;
+	memset(&p_patcher->buffer[p_patcher->pos], 0xFF, length - p_patcher->pos);
+	return output(p_patcher->buffer, length);
+}
@@ -22,7 +22,64 @@
 
 /* USER CODE BEGIN 0 */
 #include "string.h"
+#include "stddef.h"
 #include "icache.h"
+#include "checksum.h"
+#include "profile.h"
+#include "trace.h"
+
+/* Events reported by the HAL callbacks to FLASH_Queue_IRQHandler() */
+#define FLASH_EVENT_NONE        0U
+#define FLASH_EVENT_DONE        1U
+#define FLASH_EVENT_ERROR       2U
+
+/**
+  * @brief  Asynchronous flash engine state
+  */
+static struct
+{
+  FLASH_QueueOpTypeDef *ap_op[FLASH_QUEUE_DEPTH]; /* ring, head runs */
+  uint32_t head;
+  volatile uint32_t count;       /* operations in the ring */
+  volatile uint32_t event;       /* FLASH_EVENT_xxx of the running operation */
+  uint32_t open;                 /* FLASH_Open() done */
+  uint32_t data[FLASH_BURST_SIZE / 4U]; /* quadword or burst being programmed */
+  uint32_t size;                 /* bytes in data */
+  uint32_t started;              /* DWT cycle the head operation started */
+  FLASH_QueueStatsTypeDef stats;
+} flash_queue;
+
+/**
+  * @brief  Flash session state
+  */
+static struct
+{
+  uint32_t open;                 /* flash unlocked until FLASH_Session_End() */
+  uint32_t start;                /* bank being written */
+  uint32_t end;
+  uint32_t digest[FLASH_SESSION_PAGES];  /* CRC-32 of the page start programmed */
+  uint16_t cursor[FLASH_SESSION_PAGES];  /* bytes covered by the digest */
+  uint16_t checked[FLASH_SESSION_PAGES]; /* bytes verified */
+  volatile uint16_t programmed[FLASH_SESSION_PAGES]; /* digest bytes in the flash */
+  uint32_t mpu_ctrl;             /* MPU set up before the session */
+  uint32_t mpu_mair[2];
+  uint32_t mpu_rbar;             /* FLASH_SESSION_MPU_REGION before the session */
+  uint32_t mpu_rlar;
+  FLASH_SessionStatsTypeDef stats;
+} flash_session;
+
+static void FLASH_Open(void);
+static void FLASH_Close(void);
+static uint32_t FLASH_Session_Allows(uint32_t addr, uint32_t cnt);
+static uint32_t FLASH_Session_InOrder(uint32_t addr, uint32_t cnt);
+static void FLASH_Session_Account(uint32_t addr, const void *data, uint32_t cnt);
+static void FLASH_Session_Erased(uint32_t bank, uint32_t page, uint32_t nb_pages);
+static void FLASH_Queue_Issue(void);
+static void FLASH_Queue_Complete(uint32_t status);
+static uint32_t FLASH_Queue_Submit(FLASH_QueueOpTypeDef *p_op);
+static uint32_t FLASH_Program(uint32_t addr, const uint8_t *p_data, uint32_t cnt, uint32_t mode);
+static uint32_t FLASH_Burst_Size(uint32_t addr, const uint8_t *p_data, uint32_t cnt);
+static uint32_t FLASH_Elapsed_us(uint32_t start);
 
 /* USER CODE END 0 */
 
@@ -45,6 +102,10 @@ void MX_FLASH_Init(void)
   {
     Error_Handler();
   }
+
+  /* FLASH interrupt Init */
+  HAL_NVIC_SetPriority(FLASH_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(FLASH_IRQn);
   /* USER CODE BEGIN FLASH_Init 2 */
 
   /* USER CODE END FLASH_Init 2 */
@@ -61,29 +122,77 @@ void MX_FLASH_Init(void)
 uint32_t FLASH_BankErase(uint32_t bank) {
 	FLASH_EraseInitTypeDef desc;
 	uint32_t result = FLASHIF_OK;
-	uint32_t pageerror;
+	uint32_t pageerror, start;
 	/* Check the parameters */
 	if(!IS_FLASH_BANK_EXCLUSIVE(bank)) return FLASHIF_ERASEKO;
+	if (!FLASH_Session_Allows(Flash_Get_BankAddress(bank), FLASH_BANK_SIZE)) return FLASHIF_ERASEKO;
+	/* Queued operations first */
+	if (FLASH_Queue_Wait(NULL, FLASH_QUEUE_TIMEOUT) != FLASHIF_OK) return FLASHIF_ERASEKO;
+	PROFILE_BEGIN(PROFILE_SITE_ERASE);
 	/* Unlock the Flash to enable the flash control register access */
-	HAL_FLASH_Unlock();
-	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+	FLASH_Open();
 	/* Setting erase options */
 	desc.NbPages = FLASH_BANK_SIZE;
 	desc.Page = 0U;
 	desc.TypeErase = FLASH_TYPEERASE_MASSERASE;
 	desc.Banks = bank;
 	/* Erase bank */
-	HAL_ICACHE_Disable();
+	TRACE(TRACE_EV_ERASE, FLASH_PAGE_NB, 0);
+	start = DWT->CYCCNT;
     if (HAL_FLASHEx_Erase(&desc, &pageerror) != HAL_OK) result = FLASHIF_ERASEKO;
+	TRACE(TRACE_EV_FLASH_DONE, FLASH_OP_ERASE, result);
+	if (flash_session.open) flash_session.stats.erase_us += FLASH_Elapsed_us(start);
     /* Lock the Flash to disable the flash control register access */
-    MX_ICACHE_Init();
-	HAL_FLASH_Lock();
+	FLASH_Close();
+	FLASH_Session_Erased(bank, 0U, FLASH_PAGE_NB);
+	PROFILE_END(PROFILE_SITE_ERASE);
+	return result;
+}
+
+/**
+ * @brief  This function erases consecutive pages of a bank
+ * @param  bank: Flash bank to be erased.
+ * @param  page: first page, in the bank
+ * @param  nb_pages: number of pages
+ * @retval FLASHIF_OK : pages successfully erased
+ *         FLASHIF_ERASEKO : error occurred
+ */
+uint32_t FLASH_PagesErase(uint32_t bank, uint32_t page, uint32_t nb_pages) {
+	FLASH_EraseInitTypeDef desc;
+	uint32_t result = FLASHIF_OK;
+	uint32_t pageerror, start;
+	/* Check the parameters */
+	if(!IS_FLASH_BANK_EXCLUSIVE(bank) || ((page + nb_pages) > FLASH_PAGE_NB)) return FLASHIF_ERASEKO;
+	if (nb_pages == 0U) return FLASHIF_OK;
+	if (!FLASH_Session_Allows(Flash_Get_BankAddress(bank) + page * FLASH_PAGE_SIZE, nb_pages * FLASH_PAGE_SIZE)) return FLASHIF_ERASEKO;
+	/* Queued operations first */
+	if (FLASH_Queue_Wait(NULL, FLASH_QUEUE_TIMEOUT) != FLASHIF_OK) return FLASHIF_ERASEKO;
+	PROFILE_BEGIN(PROFILE_SITE_ERASE);
+	/* Unlock the Flash to enable the flash control register access */
+	FLASH_Open();
+	/* Setting erase options */
+	desc.NbPages = nb_pages;
+	desc.Page = page;
+	desc.TypeErase = FLASH_TYPEERASE_PAGES;
+	desc.Banks = bank;
+	/* Erase pages */
+	TRACE(TRACE_EV_ERASE, nb_pages, page);
+	start = DWT->CYCCNT;
+	if (HAL_FLASHEx_Erase(&desc, &pageerror) != HAL_OK) result = FLASHIF_ERASEKO;
+	TRACE(TRACE_EV_FLASH_DONE, FLASH_OP_ERASE, result);
+	if (flash_session.open) flash_session.stats.erase_us += FLASH_Elapsed_us(start);
+	/* Lock the Flash to disable the flash control register access */
+	FLASH_Close();
+	FLASH_Session_Erased(bank, page, nb_pages);
+	PROFILE_END(PROFILE_SITE_ERASE);
 	return result;
 }
 
 /**
  * @brief  This function writes a data buffer in flash (data are 32-bit aligned).
- * @note   After writing data buffer, the flash content is checked.
+ * @note   After writing data buffer, the flash content is checked, at once
+ *         or, in a session, by FLASH_Session_Verify(). Aligned runs of 8
+ *         quadwords go in burst mode, the rest quadword by quadword.
  * @param  addr: start address for target location
  * @param  data: pointer on buffer with data to write
  * @param  cnt: length of data buffer in bytes
@@ -92,32 +201,65 @@ uint32_t FLASH_BankErase(uint32_t bank) {
  *         FLASHIF_WRITING_ERROR: Written Data in flash memory is different from expected one
  */
 uint32_t FLASH_Write(uint32_t addr, const void *data, uint32_t cnt) {
-	HAL_StatusTypeDef err;
-    uint32_t loop = 0;
-    void *dest = (void *)addr;
+    uint32_t result, deferred, start;
     /* Check if data is aligned */
     if (cnt % 4 != 0) return FLASHIF_WRITINGCTRL_ERROR;
+    if (!FLASH_Session_Allows(addr, cnt)) return FLASHIF_WRITINGCTRL_ERROR;
+    /* Queued operations first */
+    if (FLASH_Queue_Wait(NULL, FLASH_QUEUE_TIMEOUT) != FLASHIF_OK) return FLASHIF_WRITINGCTRL_ERROR;
+    PROFILE_BEGIN(PROFILE_SITE_WRITE);
     /* Unlock the Flash to enable the flash control register access */
-	HAL_FLASH_Unlock();
-	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
-    HAL_ICACHE_Disable();
-    /* Flash Program loop for QUADWORD type */
-    do {
-    	uint64_t dword[2];
-    	memcpy(dword, (void *)((uint32_t)data + loop), sizeof(dword));
-    	if ((dword[0] != -1) || (dword[1] != -1))
-    		err = HAL_FLASH_Program(FLASH_TYPEPROGRAM_QUADWORD, addr, (uint32_t)&dword[0]);
-    	else
-    		err = HAL_OK;
-    	loop += sizeof(dword);
-    	addr += sizeof(dword);
-    } while ((loop != cnt) && (err == HAL_OK));
+    FLASH_Open();
+    TRACE(TRACE_EV_PROGRAM, cnt / FLASH_QUADWORD_SIZE, addr);
+    start = DWT->CYCCNT;
+    result = FLASH_Program(addr, (const uint8_t *)data, cnt, FLASH_PROGRAM_BURST);
+    TRACE(TRACE_EV_FLASH_DONE, FLASH_OP_PROGRAM, result);
+    if (flash_session.open) flash_session.stats.program_us += FLASH_Elapsed_us(start);
     /* Lock the Flash to disable the flash control register access */
-    MX_ICACHE_Init();
-    HAL_FLASH_Lock();
-    /* Check written data */
-	if ((err == HAL_OK) && memcmp(dest, data, cnt)) return FLASHIF_WRITING_ERROR;
-    return (err == HAL_OK) ? FLASHIF_OK : FLASHIF_WRITINGCTRL_ERROR;
+    FLASH_Close();
+    /* Check written data, now or at the end of the session */
+    deferred = FLASH_Session_InOrder(addr, cnt);
+    if (deferred) {
+    	FLASH_Session_Account(addr, data, cnt);
+    	if (result == FLASHIF_OK) flash_session.programmed[(addr - flash_session.start) / FLASH_PAGE_SIZE] += cnt;
+    } else if (flash_session.open) flash_session.stats.readbacks++;
+	if ((result == FLASHIF_OK) && !deferred && memcmp((void *)addr, data, cnt)) result = FLASHIF_WRITING_ERROR;
+    PROFILE_END(PROFILE_SITE_WRITE);
+    return result;
+}
+
+/**
+ * @brief  This function measures the programming speed of both modes.
+ * @note   The start of the running image is programmed FLASH_BENCH_RUNS
+ *         times per mode on the checkpoint page of the bank, erased before
+ *         each run: the download checkpoints of the bank are lost. Erase
+ *         time is not counted. A page programs in a few milliseconds:
+ *         it is timed with the DWT cycle counter, not the tick.
+ * @param  bank: Flash bank used, the inactive one
+ * @param  p_bench: bytes per millisecond of each mode
+ * @retval FLASHIF_OK or the erase/write error
+ */
+uint32_t FLASH_Bench(uint32_t bank, FLASH_BenchTypeDef *p_bench) {
+	const uint8_t *p_data = (const uint8_t *)Flash_Get_BankAddress((bank == FLASH_BANK_1) ? FLASH_BANK_2 : FLASH_BANK_1);
+	uint32_t addr = Flash_Get_BankAddress(bank) + FLASH_CHECKPOINT_PAGE * FLASH_PAGE_SIZE;
+	uint32_t mode, run, start, elapsed[2] = {0, 0}, result = FLASHIF_OK;
+	for (mode = FLASH_PROGRAM_QUADWORD; (mode <= FLASH_PROGRAM_BURST) && (result == FLASHIF_OK); mode++) {
+		for (run = 0; (run < FLASH_BENCH_RUNS) && (result == FLASHIF_OK); run++) {
+			result = FLASH_PagesErase(bank, FLASH_CHECKPOINT_PAGE, 1U);
+			if (result != FLASHIF_OK) break;
+			FLASH_Open();
+			start = DWT->CYCCNT;
+			result = FLASH_Program(addr, p_data, FLASH_PAGE_SIZE, mode);
+			elapsed[mode] += FLASH_Elapsed_us(start);
+			FLASH_Close();
+			if ((result == FLASHIF_OK) && memcmp((const void *)addr, p_data, FLASH_PAGE_SIZE)) result = FLASHIF_WRITING_ERROR;
+		}
+	}
+	/* Leave no half checkpoint behind */
+	if (FLASH_CheckpointClear(bank) != FLASHIF_OK) result = FLASHIF_ERASEKO;
+	p_bench->quadword = (FLASH_BENCH_RUNS * FLASH_PAGE_SIZE * 1000U) / ((elapsed[0] != 0U) ? elapsed[0] : 1U);
+	p_bench->burst = (FLASH_BENCH_RUNS * FLASH_PAGE_SIZE * 1000U) / ((elapsed[1] != 0U) ? elapsed[1] : 1U);
+	return result;
 }
 
 /**
@@ -129,6 +271,8 @@ uint32_t FLASH_Write(uint32_t addr, const void *data, uint32_t cnt) {
 uint32_t Flash_Get_ActiveBank(void){
 	FLASH_OBProgramInitTypeDef OBInit = {0};
 	uint32_t bank = 0;
+	/* The lock below would stop queued operations */
+	FLASH_Queue_Wait(NULL, FLASH_QUEUE_TIMEOUT);
     /* Unlock the Flash to enable the flash control register access */
 	HAL_FLASH_Unlock();
 	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
@@ -141,10 +285,107 @@ uint32_t Flash_Get_ActiveBank(void){
 		bank = FLASH_BANK_2;
 	}
 	/* Lock the Flash to disable the flash control register access */
-    HAL_FLASH_Lock();
+    if (!flash_session.open) HAL_FLASH_Lock();
     return bank;
 }
 
+/**
+ * @brief  This function gives the start address of a flash bank.
+ * @param  bank: FLASH_BANK_1 or FLASH_BANK_2.
+ * @retval uint32_t first address of the bank
+ */
+uint32_t Flash_Get_BankAddress(uint32_t bank){
+	return (bank == FLASH_BANK_2) ? FLASH_START_BANK2 : FLASH_START_BANK1;
+}
+
+/**
+ * @brief  This function gives the size of the image held by a flash bank.
+ * @note   The erased end of the image area is not counted, by quadwords.
+ * @param  bank: FLASH_BANK_1 or FLASH_BANK_2.
+ * @retval uint32_t image size in bytes, a multiple of 16
+ */
+uint32_t Flash_Get_ImageSize(uint32_t bank){
+	const uint32_t *p_word = (const uint32_t *)Flash_Get_BankAddress(bank);
+	uint32_t size = FLASH_IMAGE_SIZE / 4U;
+	while ((size >= 4U) && (p_word[size - 1U] == 0xFFFFFFFFU) && (p_word[size - 2U] == 0xFFFFFFFFU)
+			&& (p_word[size - 3U] == 0xFFFFFFFFU) && (p_word[size - 4U] == 0xFFFFFFFFU)) {
+		size -= 4U;
+	}
+	return size * 4U;
+}
+
+/**
+ * @brief  This function checks that a flash area is erased.
+ * @param  addr: start address, 32-bit aligned
+ * @param  cnt: length in bytes, a multiple of 4
+ * @retval uint32_t 1 if every byte reads 0xFF, 0 otherwise
+ */
+uint32_t Flash_Is_Erased(uint32_t addr, uint32_t cnt){
+	const uint32_t *p_word = (const uint32_t *)addr;
+	for (cnt /= 4U; cnt != 0U; cnt--) {
+		if (*p_word++ != 0xFFFFFFFFU) return 0;
+	}
+	return 1;
+}
+
+/**
+ * @brief  This function reads the latest download checkpoint of a bank.
+ * @note   Records are appended to the checkpoint page, the last one whose
+ *         check field matches wins.
+ * @param  bank: Flash bank receiving the image.
+ * @param  p_checkpoint: latest record
+ * @retval FLASHIF_OK: record found
+ *         FLASHIF_ERASEKO: no valid record
+ */
+uint32_t FLASH_CheckpointRead(uint32_t bank, FLASH_CheckpointTypeDef *p_checkpoint) {
+	const FLASH_CheckpointTypeDef *p_slot = (const FLASH_CheckpointTypeDef *)(Flash_Get_BankAddress(bank) + (FLASH_CHECKPOINT_PAGE * FLASH_PAGE_SIZE));
+	uint32_t i, result = FLASHIF_ERASEKO;
+	for (i = 0; (i < (FLASH_PAGE_SIZE / sizeof(FLASH_CheckpointTypeDef))) && (p_slot[i].magic != 0xFFFFFFFFU); i++) {
+		if ((p_slot[i].magic == FLASH_CHECKPOINT_MAGIC) &&
+				(p_slot[i].check == Crc32_Update(0, (const uint8_t *)&p_slot[i], offsetof(FLASH_CheckpointTypeDef, check)))) {
+			*p_checkpoint = p_slot[i];
+			result = FLASHIF_OK;
+		}
+	}
+	return result;
+}
+
+/**
+ * @brief  This function queues the append of a download checkpoint to a bank.
+ * @note   A full page is erased first, after the queued operations. The
+ *         record is read back once programmed.
+ * @param  bank: Flash bank receiving the image.
+ * @param  p_checkpoint: record, magic and check fields are filled in, kept
+ *         until the status of p_op is final
+ * @param  p_op: operation, owned by the caller until its status is final
+ * @retval FLASHIF_OK: queued, p_op->status tells the result
+ *         FLASHIF_BUSY: queue full, try again later
+ *         or the FLASH_PagesErase() error
+ */
+uint32_t FLASH_CheckpointWrite(uint32_t bank, FLASH_CheckpointTypeDef *p_checkpoint, FLASH_QueueOpTypeDef *p_op) {
+	const FLASH_CheckpointTypeDef *p_slot = (const FLASH_CheckpointTypeDef *)(Flash_Get_BankAddress(bank) + (FLASH_CHECKPOINT_PAGE * FLASH_PAGE_SIZE));
+	uint32_t i, result = FLASHIF_OK;
+	for (i = 0; (i < (FLASH_PAGE_SIZE / sizeof(FLASH_CheckpointTypeDef))) && (p_slot[i].magic != 0xFFFFFFFFU); i++);
+	if (i == (FLASH_PAGE_SIZE / sizeof(FLASH_CheckpointTypeDef))) {
+		result = FLASH_CheckpointClear(bank);
+		i = 0;
+	}
+	p_checkpoint->magic = FLASH_CHECKPOINT_MAGIC;
+	p_checkpoint->reserved = 0xFFFFFFFFU;
+	p_checkpoint->check = Crc32_Update(0, (const uint8_t *)p_checkpoint, offsetof(FLASH_CheckpointTypeDef, check));
+	if (result == FLASHIF_OK) result = FLASH_Queue_Program(p_op, (uint32_t)&p_slot[i], p_checkpoint, sizeof(FLASH_CheckpointTypeDef));
+	return result;
+}
+
+/**
+ * @brief  This function drops every download checkpoint of a bank.
+ * @param  bank: Flash bank receiving the image.
+ * @retval FLASHIF_OK or FLASHIF_ERASEKO
+ */
+uint32_t FLASH_CheckpointClear(uint32_t bank) {
+	return FLASH_PagesErase(bank, FLASH_CHECKPOINT_PAGE, 1U);
+}
+
 /**
  * @brief  This function swaps the active flash bank.
  * @param  None.
@@ -152,6 +393,8 @@ uint32_t Flash_Get_ActiveBank(void){
  */
 void Flash_BankSwap(void){
 	FLASH_OBProgramInitTypeDef OBInit = {0};
+	/* Queued operations first */
+	FLASH_Queue_Wait(NULL, FLASH_QUEUE_TIMEOUT);
     /* Unlock the Flash to enable the flash control register access */
     if (HAL_FLASH_Unlock() != HAL_OK) Error_Handler();
     __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
@@ -180,4 +423,540 @@ void Flash_BankSwap(void){
     if (HAL_FLASH_OB_Launch() != HAL_OK) Error_Handler();
 }
 
+/**
+ * @brief  This function opens a flash session on the inactive bank.
+ * @note   The flash stays unlocked until FLASH_Session_End(), and writes
+ *         elsewhere are refused. The ICACHE stays on: the bank is made
+ *         non-cacheable with an MPU region, so the ICACHE holds none of
+ *         its lines while it changes and the running code keeps its cache.
+ * @param  bank: Flash bank to be written, not the running one
+ * @retval FLASHIF_OK, FLASHIF_BUSY if the queue does not drain, or
+ *         FLASHIF_WRITINGCTRL_ERROR for a wrong bank
+ */
+uint32_t FLASH_Session_Begin(uint32_t bank) {
+	MPU_Attributes_InitTypeDef attributes = {0};
+	MPU_Region_InitTypeDef region = {0};
+	if (!IS_FLASH_BANK_EXCLUSIVE(bank) || flash_session.open || (bank == Flash_Get_ActiveBank())) return FLASHIF_WRITINGCTRL_ERROR;
+	if (FLASH_Queue_Wait(NULL, FLASH_QUEUE_TIMEOUT) != FLASHIF_OK) return FLASHIF_BUSY;
+	flash_session.start = Flash_Get_BankAddress(bank);
+	flash_session.end = flash_session.start + FLASH_BANK_SIZE;
+	memset(flash_session.cursor, 0, sizeof(flash_session.cursor));
+	memset(flash_session.checked, 0, sizeof(flash_session.checked));
+	memset((void *)flash_session.programmed, 0, sizeof(flash_session.programmed));
+	memset(&flash_session.stats, 0, sizeof(flash_session.stats));
+	/* Normal memory, not cached, never executed: only the session region
+	 * and its attributes change, the rest of the MPU set up stays */
+	flash_session.mpu_ctrl = MPU->CTRL;
+	flash_session.mpu_mair[0] = MPU->MAIR0;
+	flash_session.mpu_mair[1] = MPU->MAIR1;
+	MPU->RNR = FLASH_SESSION_MPU_REGION;
+	flash_session.mpu_rbar = MPU->RBAR;
+	flash_session.mpu_rlar = MPU->RLAR;
+	HAL_MPU_DisableRegion(FLASH_SESSION_MPU_REGION);
+	attributes.Number = FLASH_SESSION_MPU_ATTRIBUTES;
+	attributes.Attributes = INNER_OUTER(MPU_NOT_CACHEABLE);
+	HAL_MPU_ConfigMemoryAttributes(&attributes);
+	region.Enable = MPU_REGION_ENABLE;
+	region.Number = FLASH_SESSION_MPU_REGION;
+	region.BaseAddress = flash_session.start;
+	region.LimitAddress = flash_session.end - 1U;
+	region.AttributesIndex = FLASH_SESSION_MPU_ATTRIBUTES;
+	region.AccessPermission = MPU_REGION_ALL_RW;
+	region.DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
+	region.IsShareable = MPU_ACCESS_NOT_SHAREABLE;
+	HAL_MPU_ConfigRegion(&region);
+	/* Enabled as it was, or with the default map for the rest */
+	HAL_MPU_Enable(((flash_session.mpu_ctrl & MPU_CTRL_ENABLE_Msk) != 0U) ? flash_session.mpu_ctrl : MPU_PRIVILEGED_DEFAULT);
+	/* Lines of the bank cached before the session go */
+	HAL_ICACHE_Invalidate();
+	/* Unlock the Flash to enable the flash control register access */
+	HAL_FLASH_Unlock();
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+	flash_session.open = 1;
+	return FLASHIF_OK;
+}
+
+/**
+ * @brief  This function checks the flash against the session digests.
+ * @note   Waits for the queued operations. Only the pages programmed since
+ *         the last call are read.
+ * @param  None.
+ * @retval FLASHIF_OK, FLASHIF_WRITING_ERROR if a page differs, or
+ *         FLASHIF_BUSY if the queue does not drain
+ */
+uint32_t FLASH_Session_Verify(void) {
+	uint32_t page, tickstart = HAL_GetTick(), result = FLASHIF_OK;
+	if (!flash_session.open) return FLASHIF_OK;
+	if (FLASH_Queue_Wait(NULL, FLASH_QUEUE_TIMEOUT) != FLASHIF_OK) return FLASHIF_BUSY;
+	for (page = 0; page < FLASH_SESSION_PAGES; page++) {
+		if (flash_session.checked[page] == flash_session.cursor[page]) continue;
+		flash_session.checked[page] = flash_session.cursor[page];
+		flash_session.stats.verified += flash_session.cursor[page];
+		if (Crc32_Update(0, (const uint8_t *)(flash_session.start + page * FLASH_PAGE_SIZE), flash_session.cursor[page]) != flash_session.digest[page]) {
+			flash_session.stats.mismatches++;
+			result = FLASHIF_WRITING_ERROR;
+		}
+	}
+	flash_session.stats.verify_ms += HAL_GetTick() - tickstart;
+	return result;
+}
+
+/**
+ * @brief  This function closes the flash session.
+ * @note   Waits for the queued operations, locks the flash and puts the
+ *         MPU region and attributes back. Nothing is done without a session.
+ * @param  None.
+ * @retval None.
+ */
+void FLASH_Session_End(void) {
+	if (!flash_session.open) return;
+	FLASH_Queue_Wait(NULL, FLASH_QUEUE_TIMEOUT);
+	flash_session.open = 0;
+	/* Lock the Flash to disable the flash control register access */
+	HAL_FLASH_Lock();
+	if (!HAL_ICACHE_IsEnabled()) MX_ICACHE_Init();
+	/* The MPU as it was before the session */
+	if ((flash_session.mpu_ctrl & MPU_CTRL_ENABLE_Msk) == 0U) HAL_MPU_Disable();
+	HAL_MPU_DisableRegion(FLASH_SESSION_MPU_REGION);
+	MPU->MAIR0 = flash_session.mpu_mair[0];
+	MPU->MAIR1 = flash_session.mpu_mair[1];
+	MPU->RBAR = flash_session.mpu_rbar;
+	MPU->RLAR = flash_session.mpu_rlar;
+	if ((flash_session.mpu_ctrl & MPU_CTRL_ENABLE_Msk) != 0U) HAL_MPU_Enable(flash_session.mpu_ctrl);
+}
+
+/**
+ * @brief  This function gives the verification report of the last session.
+ * @param  p_stats: copy of the monitors
+ * @retval None.
+ */
+void FLASH_Session_GetStats(FLASH_SessionStatsTypeDef *p_stats) {
+	*p_stats = flash_session.stats;
+}
+
+/**
+ * @brief  This function gives the digest of a whole image page.
+ * @note   The digest is the CRC-32 of the source data, computed when it was
+ *         queued: the flash is not read. It is ready once the page was
+ *         programmed in order, up to its end, and every operation done.
+ *         The programmed data is checked later, by FLASH_Session_Verify().
+ * @param  addr: first address of the page, in the session bank
+ * @param  p_digest: CRC-32 of the page
+ * @retval FLASHIF_OK, or FLASHIF_BUSY while the page has no whole digest
+ */
+uint32_t FLASH_Session_Digest(uint32_t addr, uint32_t *p_digest) {
+	uint32_t page;
+	if (!flash_session.open || (addr < flash_session.start) || (addr >= flash_session.end)) return FLASHIF_BUSY;
+	page = (addr - flash_session.start) / FLASH_PAGE_SIZE;
+	if ((page >= FLASH_SESSION_PAGES) || (flash_session.cursor[page] != FLASH_PAGE_SIZE) ||
+			(flash_session.programmed[page] != FLASH_PAGE_SIZE)) return FLASHIF_BUSY;
+	*p_digest = flash_session.digest[page];
+	return FLASHIF_OK;
+}
+
+/**
+ * @brief  This function queues the erase of consecutive pages.
+ * @param  p_op: operation, owned by the caller until its status is final
+ * @param  bank: Flash bank to be erased.
+ * @param  page: first page, in the bank
+ * @param  nb_pages: number of pages
+ * @retval FLASHIF_OK: queued, p_op->status tells the result
+ *         FLASHIF_BUSY: queue full, try again after FLASH_Queue_Poll()
+ *         FLASHIF_ERASEKO: bad parameters
+ */
+uint32_t FLASH_Queue_Erase(FLASH_QueueOpTypeDef *p_op, uint32_t bank, uint32_t page, uint32_t nb_pages) {
+	if(!IS_FLASH_BANK_EXCLUSIVE(bank) || (nb_pages == 0U) || ((page + nb_pages) > FLASH_PAGE_NB)) return FLASHIF_ERASEKO;
+	if (!FLASH_Session_Allows(Flash_Get_BankAddress(bank) + page * FLASH_PAGE_SIZE, nb_pages * FLASH_PAGE_SIZE)) return FLASHIF_ERASEKO;
+	p_op->type = FLASH_OP_ERASE;
+	p_op->bank = bank;
+	p_op->page = page;
+	p_op->nb_pages = nb_pages;
+	if (FLASH_Queue_Submit(p_op) != FLASHIF_OK) return FLASHIF_BUSY;
+	/* Programs queued from now on run after the erase */
+	FLASH_Session_Erased(bank, page, nb_pages);
+	return FLASHIF_OK;
+}
+
+/**
+ * @brief  This function queues the programming of a data buffer.
+ * @note   Erased quadwords are skipped and the data is checked as
+ *         FLASH_Write() does: after each step, or by FLASH_Session_Verify().
+ * @param  p_op: operation, owned by the caller until its status is final
+ * @param  addr: start address for target location, quadword aligned
+ * @param  data: buffer with data to write, kept until the status is final
+ * @param  cnt: length of data buffer in bytes, a multiple of 16
+ * @retval FLASHIF_OK: queued, p_op->status tells the result
+ *         FLASHIF_BUSY: queue full, try again after FLASH_Queue_Poll()
+ *         FLASHIF_WRITINGCTRL_ERROR: bad parameters
+ */
+uint32_t FLASH_Queue_Program(FLASH_QueueOpTypeDef *p_op, uint32_t addr, const void *data, uint32_t cnt) {
+	if (((addr % FLASH_QUADWORD_SIZE) != 0U) || ((cnt % FLASH_QUADWORD_SIZE) != 0U)) return FLASHIF_WRITINGCTRL_ERROR;
+	if (!FLASH_Session_Allows(addr, cnt)) return FLASHIF_WRITINGCTRL_ERROR;
+	p_op->type = FLASH_OP_PROGRAM;
+	p_op->address = addr;
+	p_op->p_data = (const uint8_t *)data;
+	p_op->length = cnt;
+	p_op->done = 0;
+	p_op->check = !FLASH_Session_InOrder(addr, cnt);
+	if (FLASH_Queue_Submit(p_op) != FLASHIF_OK) return FLASHIF_BUSY;
+	if (!p_op->check) FLASH_Session_Account(addr, data, cnt);
+	else if (flash_session.open) flash_session.stats.readbacks++;
+	return FLASHIF_OK;
+}
+
+/**
+ * @brief  This function does the housekeeping of the queue.
+ * @note   Once the queue is empty, the flash is locked again and the ICACHE
+ *         enabled, unless a session runs. Call it from the main loop, never
+ *         from an interrupt.
+ * @param  None.
+ * @retval uint32_t operations still in the queue
+ */
+uint32_t FLASH_Queue_Poll(void) {
+	if ((flash_queue.count == 0U) && flash_queue.open) {
+		flash_queue.open = 0;
+		FLASH_Close();
+	}
+	return flash_queue.count;
+}
+
+/**
+ * @brief  This function waits for an operation, or for the whole queue.
+ * @param  p_op: operation, NULL for the whole queue
+ * @param  timeout: ms
+ * @retval FLASHIF_BUSY on timeout, else the operation status
+ *         (FLASHIF_OK for the whole queue)
+ */
+uint32_t FLASH_Queue_Wait(FLASH_QueueOpTypeDef *p_op, uint32_t timeout) {
+	uint32_t tickstart = HAL_GetTick();
+	while (((p_op != NULL) ? (p_op->status == FLASHIF_BUSY) : (flash_queue.count != 0U)) && ((HAL_GetTick() - tickstart) < timeout));
+	FLASH_Queue_Poll();
+	if (p_op != NULL) return p_op->status;
+	return (flash_queue.count != 0U) ? FLASHIF_BUSY : FLASHIF_OK;
+}
+
+/**
+ * @brief  This function gives the statistics of the queue.
+ * @param  p_stats: copy of the statistics
+ * @retval None.
+ */
+void FLASH_Queue_GetStats(FLASH_QueueStatsTypeDef *p_stats) {
+	*p_stats = flash_queue.stats;
+	p_stats->depth = flash_queue.count;
+}
+
+/**
+ * @brief  This function moves the queue on after a FLASH interrupt.
+ * @note   Called from FLASH_IRQHandler() after HAL_FLASH_IRQHandler(), once
+ *         the HAL has released its lock.
+ * @param  None.
+ * @retval None.
+ */
+void FLASH_Queue_IRQHandler(void) {
+	FLASH_QueueOpTypeDef *p_op;
+	uint32_t event = flash_queue.event;
+	if ((event == FLASH_EVENT_NONE) || (flash_queue.count == 0U)) return;
+	flash_queue.event = FLASH_EVENT_NONE;
+	p_op = flash_queue.ap_op[flash_queue.head];
+	if (event == FLASH_EVENT_ERROR) {
+		FLASH_Queue_Complete((p_op->type == FLASH_OP_ERASE) ? FLASHIF_ERASEKO : FLASHIF_WRITINGCTRL_ERROR);
+	} else if (p_op->type == FLASH_OP_ERASE) {
+		FLASH_Queue_Complete(FLASHIF_OK);
+	} else if (p_op->check && (memcmp((const void *)(p_op->address + p_op->done), flash_queue.data, flash_queue.size) != 0)) {
+		FLASH_Queue_Complete(FLASHIF_WRITING_ERROR);
+	} else {
+		p_op->done += flash_queue.size;
+	}
+	FLASH_Queue_Issue();
+}
+
+/**
+ * @brief  FLASH end of operation callback.
+ * @param  ReturnValue: page erased (0xFFFFFFFF once the last one is), or
+ *         address programmed
+ * @retval None.
+ */
+void HAL_FLASH_EndOfOperationCallback(uint32_t ReturnValue) {
+	/* A page erase reports every page, wait for the last one */
+	if ((flash_queue.count != 0U) && (flash_queue.ap_op[flash_queue.head]->type == FLASH_OP_ERASE) && (ReturnValue != 0xFFFFFFFFU)) return;
+	if (flash_queue.event == FLASH_EVENT_NONE) flash_queue.event = FLASH_EVENT_DONE;
+}
+
+/**
+ * @brief  FLASH operation error callback.
+ * @param  ReturnValue: page or address of the failed operation
+ * @retval None.
+ */
+void HAL_FLASH_OperationErrorCallback(uint32_t ReturnValue) {
+	UNUSED(ReturnValue);
+	flash_queue.event = FLASH_EVENT_ERROR;
+}
+
+/**
+ * @brief  This function adds an operation to the queue, starts it if idle.
+ * @param  p_op: operation
+ * @retval FLASHIF_OK or FLASHIF_BUSY when the queue is full
+ */
+static uint32_t FLASH_Queue_Submit(FLASH_QueueOpTypeDef *p_op) {
+	uint32_t primask = __get_PRIMASK(), idle;
+	p_op->status = FLASHIF_BUSY;
+	__disable_irq();
+	if (flash_queue.count == FLASH_QUEUE_DEPTH) {
+		__set_PRIMASK(primask);
+		flash_queue.stats.full++;
+		p_op->status = FLASHIF_OK;
+		return FLASHIF_BUSY;
+	}
+	flash_queue.ap_op[(flash_queue.head + flash_queue.count) % FLASH_QUEUE_DEPTH] = p_op;
+	idle = (flash_queue.count++ == 0U);
+	__set_PRIMASK(primask);
+	flash_queue.stats.queued++;
+	if (flash_queue.count > flash_queue.stats.depth_max) flash_queue.stats.depth_max = flash_queue.count;
+	if (idle) {
+		/* Nothing runs: no interrupt can come before this one starts */
+		if (!flash_queue.open) {
+			flash_queue.open = 1;
+			FLASH_Open();
+		}
+		flash_queue.started = DWT->CYCCNT;
+		FLASH_Queue_Issue();
+	}
+	return FLASHIF_OK;
+}
+
+/**
+ * @brief  This function starts the next step of the queue head.
+ * @note   Operations that need no flash access complete at once.
+ * @param  None.
+ * @retval None.
+ */
+static void FLASH_Queue_Issue(void) {
+	FLASH_EraseInitTypeDef desc;
+	FLASH_QueueOpTypeDef *p_op;
+	const uint32_t *p_word;
+	uint32_t type;
+	while (flash_queue.count != 0U) {
+		p_op = flash_queue.ap_op[flash_queue.head];
+		if (p_op->type == FLASH_OP_ERASE) {
+			desc.TypeErase = FLASH_TYPEERASE_PAGES;
+			desc.Banks = p_op->bank;
+			desc.Page = p_op->page;
+			desc.NbPages = p_op->nb_pages;
+			TRACE(TRACE_EV_ERASE, p_op->nb_pages, p_op->page);
+			if (HAL_FLASHEx_Erase_IT(&desc) == HAL_OK) return;
+			FLASH_Queue_Complete(FLASHIF_ERASEKO);
+			continue;
+		}
+		if (p_op->done == 0U) TRACE(TRACE_EV_PROGRAM, p_op->length / FLASH_QUADWORD_SIZE, p_op->address);
+		/* Skip the erased quadwords */
+		while (p_op->done != p_op->length) {
+			memcpy(flash_queue.data, &p_op->p_data[p_op->done], FLASH_QUADWORD_SIZE);
+			p_word = flash_queue.data;
+			if ((p_word[0] & p_word[1] & p_word[2] & p_word[3]) != 0xFFFFFFFFU) break;
+			p_op->done += FLASH_QUADWORD_SIZE;
+		}
+		if (p_op->done == p_op->length) {
+			FLASH_Queue_Complete(FLASHIF_OK);
+			continue;
+		}
+		flash_queue.size = FLASH_Burst_Size(p_op->address + p_op->done, &p_op->p_data[p_op->done], p_op->length - p_op->done);
+		type = (flash_queue.size == FLASH_BURST_SIZE) ? FLASH_TYPEPROGRAM_BURST : FLASH_TYPEPROGRAM_QUADWORD;
+		memcpy(flash_queue.data, &p_op->p_data[p_op->done], flash_queue.size);
+		if (HAL_FLASH_Program_IT(type, p_op->address + p_op->done, (uint32_t)flash_queue.data) == HAL_OK) return;
+		FLASH_Queue_Complete(FLASHIF_WRITINGCTRL_ERROR);
+	}
+}
+
+/**
+ * @brief  This function ends the queue head operation.
+ * @param  status: FLASHIF_OK or the error
+ * @retval None.
+ */
+static void FLASH_Queue_Complete(uint32_t status) {
+	FLASH_QueueOpTypeDef *p_op = flash_queue.ap_op[flash_queue.head];
+	uint32_t us = FLASH_Elapsed_us(flash_queue.started);
+	if (flash_session.open) {
+		if (p_op->type == FLASH_OP_ERASE) flash_session.stats.erase_us += us;
+		else flash_session.stats.program_us += us;
+	}
+	TRACE(TRACE_EV_FLASH_DONE, p_op->type, status);
+	/* The data of a page digest is in the flash */
+	if ((status == FLASHIF_OK) && (p_op->type == FLASH_OP_PROGRAM) && !p_op->check && flash_session.open) {
+		flash_session.programmed[(p_op->address - flash_session.start) / FLASH_PAGE_SIZE] += p_op->length;
+	}
+	/* The next operation starts now */
+	flash_queue.started = DWT->CYCCNT;
+	flash_queue.head = (flash_queue.head + 1U) % FLASH_QUEUE_DEPTH;
+	flash_queue.stats.completed++;
+	if (status != FLASHIF_OK) flash_queue.stats.errors++;
+	flash_queue.count--;
+	p_op->status = status;
+}
+
+/**
+ * @brief  This function gives access to the flash control registers.
+ * @note   Outside a session, the flash is unlocked and the ICACHE switched
+ *         off; in a session, the flash is already unlocked.
+ * @param  None.
+ * @retval None.
+ */
+static void FLASH_Open(void) {
+	if (!flash_session.open) HAL_FLASH_Unlock();
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+	if (!flash_session.open || (FLASH_SESSION_ICACHE == 0U)) HAL_ICACHE_Disable();
+}
+
+/**
+ * @brief  This function ends what FLASH_Open() started.
+ * @param  None.
+ * @retval None.
+ */
+static void FLASH_Close(void) {
+	if (!flash_session.open || (FLASH_SESSION_ICACHE == 0U)) MX_ICACHE_Init();
+	if (!flash_session.open) HAL_FLASH_Lock();
+}
+
+/**
+ * @brief  This function checks that a flash range may be changed.
+ * @param  addr: first address
+ * @param  cnt: length in bytes
+ * @retval 1 outside a session or inside the session bank, else 0
+ */
+static uint32_t FLASH_Session_Allows(uint32_t addr, uint32_t cnt) {
+	if (!flash_session.open) return 1;
+	return ((addr >= flash_session.start) && (cnt <= (flash_session.end - addr))) ? 1U : 0U;
+}
+
+/**
+ * @brief  This function tells if a write can be checked by its page digest.
+ * @param  addr: first address
+ * @param  cnt: length in bytes
+ * @retval 1 when the write continues the digest of an image page, else 0
+ */
+static uint32_t FLASH_Session_InOrder(uint32_t addr, uint32_t cnt) {
+	uint32_t page, offset;
+	if (!flash_session.open || (FLASH_SESSION_VERIFY == 0U)) return 0;
+	page = (addr - flash_session.start) / FLASH_PAGE_SIZE;
+	offset = (addr - flash_session.start) % FLASH_PAGE_SIZE;
+	/* The checkpoint page changes by small records, read back at once */
+	if ((page >= FLASH_SESSION_PAGES) || (page >= FLASH_CHECKPOINT_PAGE)) return 0;
+	return ((offset == flash_session.cursor[page]) && (cnt <= (FLASH_PAGE_SIZE - offset))) ? 1U : 0U;
+}
+
+/**
+ * @brief  This function adds a write to its page digest.
+ * @param  addr: first address, FLASH_Session_InOrder() checked
+ * @param  data: data programmed
+ * @param  cnt: length in bytes
+ * @retval None.
+ */
+static void FLASH_Session_Account(uint32_t addr, const void *data, uint32_t cnt) {
+	uint32_t page = (addr - flash_session.start) / FLASH_PAGE_SIZE;
+	flash_session.digest[page] = Crc32_Update(flash_session.digest[page], (const uint8_t *)data, cnt);
+	flash_session.cursor[page] += cnt;
+}
+
+/**
+ * @brief  This function restarts the digests of erased pages.
+ * @param  bank: Flash bank erased
+ * @param  page: first page
+ * @param  nb_pages: number of pages
+ * @retval None.
+ */
+static void FLASH_Session_Erased(uint32_t bank, uint32_t page, uint32_t nb_pages) {
+	if (!flash_session.open || (Flash_Get_BankAddress(bank) != flash_session.start)) return;
+	for (; (nb_pages != 0U) && (page < FLASH_SESSION_PAGES); page++, nb_pages--) {
+		flash_session.digest[page] = 0;
+		flash_session.cursor[page] = 0;
+		flash_session.checked[page] = 0;
+		flash_session.programmed[page] = 0;
+	}
+}
+
+/**
+ * @brief  This function gives the time since a DWT cycle count.
+ * @param  start: DWT->CYCCNT at the start
+ * @retval us, 0 when the cycle counter does not run
+ */
+static uint32_t FLASH_Elapsed_us(uint32_t start) {
+	return (DWT->CYCCNT - start) / (SystemCoreClock / 1000000U);
+}
+
+/**
+ * @brief  This function gives the size of the next programming step.
+ * @note   A burst needs its address aligned on its size and no erased
+ *         quadword: those are left blank for later writes.
+ * @param  addr: flash destination, quadword aligned
+ * @param  p_data: data, its first quadword not erased
+ * @param  cnt: bytes left
+ * @retval FLASH_BURST_SIZE or FLASH_QUADWORD_SIZE
+ */
+static uint32_t FLASH_Burst_Size(uint32_t addr, const uint8_t *p_data, uint32_t cnt) {
+	uint32_t word[4], offset;
+	if (((addr % FLASH_BURST_SIZE) != 0U) || (cnt < FLASH_BURST_SIZE)) return FLASH_QUADWORD_SIZE;
+	for (offset = FLASH_QUADWORD_SIZE; offset < FLASH_BURST_SIZE; offset += FLASH_QUADWORD_SIZE) {
+		memcpy(word, &p_data[offset], sizeof(word));
+		if ((word[0] & word[1] & word[2] & word[3]) == 0xFFFFFFFFU) return FLASH_QUADWORD_SIZE;
+	}
+	return FLASH_BURST_SIZE;
+}
+
+/**
+ * @brief  This function programs a buffer, flash unlocked and ICACHE off.
+ * @note   Register level: the data is written straight to the flash, one
+ *         wait on BSY/WDW per quadword or burst. Erased quadwords are
+ *         skipped. Interrupts are masked while a quadword or burst is
+ *         being written, as the HAL does.
+ * @param  addr: start address for target location, quadword aligned
+ * @param  p_data: data, a multiple of 16 bytes
+ * @param  cnt: length of data buffer in bytes
+ * @param  mode: FLASH_PROGRAM_QUADWORD, or FLASH_PROGRAM_BURST to use
+ *         bursts where possible
+ * @retval FLASHIF_OK or FLASHIF_WRITINGCTRL_ERROR
+ */
+static uint32_t FLASH_Program(uint32_t addr, const uint8_t *p_data, uint32_t cnt, uint32_t mode) {
+	uint32_t data[FLASH_BURST_SIZE / 4U], step, size, index, primask, tickstart, cr, error = 0;
+	volatile uint32_t *p_dest;
+	if ((addr % FLASH_QUADWORD_SIZE) != 0U) return FLASHIF_WRITINGCTRL_ERROR;
+	/* As HAL_FLASH_Program(): the last operation over, its error flags cleared */
+	tickstart = HAL_GetTick();
+	while (((FLASH->NSSR & (FLASH_FLAG_BSY | FLASH_FLAG_WDW)) != 0U) && ((HAL_GetTick() - tickstart) < FLASH_TIMEOUT_VALUE));
+	if ((FLASH->NSSR & (FLASH_FLAG_BSY | FLASH_FLAG_WDW)) != 0U) return FLASHIF_WRITINGCTRL_ERROR;
+	FLASH->NSSR = FLASH_FLAG_SR_ERRORS;
+	while ((cnt != 0U) && (error == 0U)) {
+		/* A short tail is padded with 0xFF, as erased */
+		step = FLASH_QUADWORD_SIZE;
+		size = (cnt < step) ? cnt : step;
+		memset(data, 0xFF, step);
+		memcpy(data, p_data, size);
+		if ((data[0] & data[1] & data[2] & data[3]) != 0xFFFFFFFFU) {
+			if ((mode == FLASH_PROGRAM_BURST) && (FLASH_Burst_Size(addr, p_data, cnt) == FLASH_BURST_SIZE)) {
+				step = size = FLASH_BURST_SIZE;
+				memcpy(data, p_data, size);
+			}
+			/* PG, and BWR for a burst, stay set while the step size does not change */
+			cr = (step == FLASH_BURST_SIZE) ? (FLASH_NSCR_PG | FLASH_NSCR_BWR) : FLASH_NSCR_PG;
+			if ((FLASH->NSCR & (FLASH_NSCR_PG | FLASH_NSCR_BWR)) != cr) MODIFY_REG(FLASH->NSCR, FLASH_NSCR_PG | FLASH_NSCR_BWR, cr);
+			p_dest = (volatile uint32_t *)addr;
+			primask = __get_PRIMASK();
+			__disable_irq();
+			for (index = 0; index < (step / 4U); index++) p_dest[index] = data[index];
+			__set_PRIMASK(primask);
+			tickstart = HAL_GetTick();
+			while (((FLASH->NSSR & (FLASH_FLAG_BSY | FLASH_FLAG_WDW)) != 0U) && ((HAL_GetTick() - tickstart) < FLASH_TIMEOUT_VALUE));
+			error = FLASH->NSSR & (FLASH_FLAG_SR_ERRORS | FLASH_FLAG_BSY | FLASH_FLAG_WDW);
+		}
+		addr += step;
+		p_data += size;
+		cnt -= size;
+	}
+	CLEAR_BIT(FLASH->NSCR, FLASH_NSCR_PG | FLASH_NSCR_BWR);
+	if (error != 0U) {
+		FLASH->NSSR = error & FLASH_FLAG_SR_ERRORS;
+		return FLASHIF_WRITINGCTRL_ERROR;
+	}
+	FLASH->NSSR = FLASH_FLAG_EOP;
+	return FLASHIF_OK;
+}
+
 /* USER CODE END 1 */
@@ -21,7 +21,11 @@
 #include "icache.h"
 
 /* USER CODE BEGIN 0 */
+#include "string.h"
 
+/* Monitors counted so far, and the phase the hardware counters belong to */
+static ICACHE_ReportTypeDef icache_report;
+static uint32_t icache_phase = ICACHE_PHASE_MENU;
 /* USER CODE END 0 */
 
 /* ICACHE init function */
@@ -36,12 +40,8 @@ void MX_ICACHE_Init(void)
 
   /* USER CODE END ICACHE_Init 1 */
 
-  /** Enable instruction cache in 1-way (direct mapped cache)
+  /** Enable instruction cache (default 2-ways set associative cache)
   */
-  if (HAL_ICACHE_ConfigAssociativityMode(ICACHE_1WAY) != HAL_OK)
-  {
-    Error_Handler();
-  }
   if (HAL_ICACHE_Enable() != HAL_OK)
   {
     Error_Handler();
@@ -53,5 +53,44 @@ void MX_ICACHE_Init(void)
 }
 
 /* USER CODE BEGIN 1 */
+/**
+ * @brief  This function clears the report and starts the hit/miss monitors.
+ * @note   The monitors keep counting across MX_ICACHE_Init(), while the
+ *         cache is on, and stop with HAL_ICACHE_DeInit().
+ * @param  None.
+ * @retval None.
+ */
+void ICACHE_Monitor_Init(void) {
+	memset(&icache_report, 0, sizeof(icache_report));
+	icache_phase = ICACHE_PHASE_MENU;
+	HAL_ICACHE_Monitor_Reset(ICACHE_MONITOR_HIT_MISS);
+	HAL_ICACHE_Monitor_Start(ICACHE_MONITOR_HIT_MISS);
+}
 
+/**
+ * @brief  This function adds the monitors to the current phase, then
+ *         counts for the given one.
+ * @note   The miss counter stops at 0xFFFF: a long phase should call this
+ *         function with the same phase now and then, once per packet for
+ *         the data.
+ * @param  phase: ICACHE_PHASE_xxx
+ * @retval None.
+ */
+void ICACHE_Monitor_Phase(uint32_t phase) {
+	icache_report.hits[icache_phase] += HAL_ICACHE_Monitor_GetHitValue();
+	icache_report.misses[icache_phase] += HAL_ICACHE_Monitor_GetMissValue();
+	HAL_ICACHE_Monitor_Reset(ICACHE_MONITOR_HIT_MISS);
+	if (phase < ICACHE_PHASES) icache_phase = phase;
+}
+
+/**
+ * @brief  This function gives the monitors counted per phase.
+ * @param  p_report: copy of the report, the current phase brought up to date
+ * @retval None.
+ */
+void ICACHE_Monitor_GetReport(ICACHE_ReportTypeDef *p_report) {
+	ICACHE_Monitor_Phase(icache_phase);
+	icache_report.associativity = READ_BIT(ICACHE->CR, ICACHE_CR_WAYSEL);
+	*p_report = icache_report;
+}
 /* USER CODE END 1 */
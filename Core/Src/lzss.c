@@ -0,0 +1,144 @@
+/**
+  ******************************************************************************
+  * @file    lzss.c
+  * @brief   This file provides the streaming LZSS decoder used for compressed
+  *          images. Input is taken in chunks of any size, as packets arrive;
+  *          output leaves in window-sized, quadword-aligned chunks.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "lzss.h"
+#include "string.h"
+
+/* Private define ------------------------------------------------------------*/
+/* Parser states */
+#define LZSS_STATE_FLAGS        0U  /* waiting for a flag byte */
+#define LZSS_STATE_ITEM         1U  /* waiting for a literal or a match */
+#define LZSS_STATE_MATCH        2U  /* waiting for the second match byte */
+#define LZSS_STATE_LENGTH       3U  /* waiting for the length extension */
+
+#define LZSS_WINDOW_MASK        (LZSS_WINDOW_SIZE - 1U)
+
+/* Private macro -------------------------------------------------------------*/
+/* Match bytes b0 | b1 << 8: distance - 1 is b0 and the high nibble of b1 */
+#define LZSS_DISTANCE(m)        ((((m) & 0xFFU) | (((m) >> 4) & 0xF00U)) + 1U)
+
+/* Private functions ---------------------------------------------------------*/
+/**
+ * @brief  Copy a match from the window.
+ * @param  p_decoder: decoder
+ * @param  distance: bytes back, 1 to LZSS_WINDOW_SIZE
+ * @param  length: bytes to copy
+ * @param  output: sink for the full windows
+ * @retval 0, or the sink error
+ */
+static uint32_t LZSS_Copy(LZSS_DecoderTypeDef *p_decoder, uint32_t distance, uint32_t length, LZSS_OutputTypeDef output) {
+	uint32_t pos = p_decoder->pos, from = (pos - distance) & LZSS_WINDOW_MASK, error = 0;
+	p_decoder->total += length;
+	while ((length--) && (error == 0U)) {
+		p_decoder->window[pos] = p_decoder->window[from];
+		from = (from + 1U) & LZSS_WINDOW_MASK;
+		if (++pos == LZSS_WINDOW_SIZE) {
+			/* The full window goes out and stays as history */
+			error = output(p_decoder->window, LZSS_WINDOW_SIZE);
+			pos = 0;
+		}
+	}
+	p_decoder->pos = pos;
+	return error;
+}
+
+/* Public functions ---------------------------------------------------------*/
+/**
+ * @brief  Reset the decoder for a new stream.
+ * @param  p_decoder: decoder
+ * @retval None
+ */
+void LZSS_Init(LZSS_DecoderTypeDef *p_decoder) {
+	/* Matches never reach before the start, the window needs no clearing */
+	p_decoder->pos = 0;
+	p_decoder->total = 0;
+	p_decoder->flags = 0;
+	p_decoder->items = 0;
+	p_decoder->state = LZSS_STATE_FLAGS;
+	p_decoder->match = 0;
+}
+
+/**
+ * @brief  Decode a chunk of the compressed stream.
+ * @param  p_decoder: decoder
+ * @param  p_data: compressed bytes
+ * @param  size: number of bytes, any split of the stream is allowed
+ * @param  output: sink for the full windows
+ * @retval 0, or the sink error
+ */
+uint32_t LZSS_Decode(LZSS_DecoderTypeDef *p_decoder, const uint8_t *p_data, uint32_t size, LZSS_OutputTypeDef output) {
+	uint32_t error = 0, length;
+	uint8_t byte;
+	while ((size--) && (error == 0U)) {
+		byte = *p_data++;
+		switch (p_decoder->state) {
+		case LZSS_STATE_FLAGS:
+			p_decoder->flags = byte;
+			p_decoder->items = 8;
+			p_decoder->state = LZSS_STATE_ITEM;
+			continue;
+		case LZSS_STATE_ITEM:
+			if ((p_decoder->flags & 1U) != 0U) {
+				/* Literal */
+				p_decoder->window[p_decoder->pos] = byte;
+				p_decoder->total++;
+				if (++p_decoder->pos == LZSS_WINDOW_SIZE) {
+					error = output(p_decoder->window, LZSS_WINDOW_SIZE);
+					p_decoder->pos = 0;
+				}
+				break;
+			}
+			p_decoder->match = byte;
+			p_decoder->state = LZSS_STATE_MATCH;
+			continue;
+		case LZSS_STATE_MATCH:
+			p_decoder->match |= (uint32_t)byte << 8;
+			if ((byte & LZSS_NIBBLE_MAX) == LZSS_NIBBLE_MAX) {
+				p_decoder->state = LZSS_STATE_LENGTH;
+				continue;
+			}
+			length = (byte & LZSS_NIBBLE_MAX) + LZSS_MIN_MATCH;
+			error = LZSS_Copy(p_decoder, LZSS_DISTANCE(p_decoder->match), length, output);
+			break;
+		default:
+			length = LZSS_NIBBLE_MAX + LZSS_MIN_MATCH + byte;
+			error = LZSS_Copy(p_decoder, LZSS_DISTANCE(p_decoder->match), length, output);
+			break;
+		}
+		/* Item done, next one or next flag byte */
+		p_decoder->flags >>= 1;
+		p_decoder->state = (--p_decoder->items != 0U) ? LZSS_STATE_ITEM : LZSS_STATE_FLAGS;
+	}
+	return error;
+}
+
+/**
+ * @brief  Flush the decoded bytes still in the window.
+ * @note   The last chunk is padded with 0xFF (erased flash) to a quadword.
+ * @param  p_decoder: decoder
+ * @param  output: sink
+ * @retval 0, or the sink error
+ */
+uint32_t LZSS_Finish(LZSS_DecoderTypeDef *p_decoder, LZSS_OutputTypeDef output) {
+	uint32_t length = (p_decoder->pos + LZSS_OUTPUT_ALIGN - 1U) & ~(LZSS_OUTPUT_ALIGN - 1U);
+	if (length == 0U) return 0;
+	memset(&p_decoder->window[p_decoder->pos], 0xFF, length - p_decoder->pos);
+	return output(p_decoder->window, length);
+}
@@ -18,6 +18,7 @@
 /* USER CODE END Header */
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
+#include "gpdma.h"
 #include "icache.h"
 #include "memorymap.h"
 #include "usart.h"
@@ -27,6 +28,9 @@
 /* USER CODE BEGIN Includes */
 #include "flash.h"
 #include "menu.h"
+#include "checksum.h"
+#include "profile.h"
+#include "trace.h"
 
 /* USER CODE END Includes */
 
@@ -99,9 +103,26 @@ int main(void)
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  MX_GPDMA1_Init();
   MX_ICACHE_Init();
   MX_USART1_UART_Init();
   /* USER CODE BEGIN 2 */
+  /* Not generated by CubeMX: enables the FLASH interrupt of the queue */
+  MX_FLASH_Init();
+  /* DWT cycle counter of the timings, the profiler and the trace */
+  Profile_CycleCounterInit();
+  ICACHE_Monitor_Init();
+#if (PROFILE_ENABLED != 0U)
+  Profile_Init();
+#endif
+#if (TRACE_ENABLED != 0U)
+  Trace_Init();
+#endif
+  Crc16_Init();
+  if (uart_rx_start() != HAL_OK)
+  {
+    Error_Handler();
+  }
 
   /* USER CODE END 2 */
 
@@ -156,7 +177,9 @@ void SystemClock_Config(void)
 
   /** Initializes the CPU, AHB and APB buses clocks
   */
-  RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_MSI;
+  RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSI|RCC_OSCILLATORTYPE_MSI;
+  RCC_OscInitStruct.HSIState = RCC_HSI_ON;
+  RCC_OscInitStruct.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
   RCC_OscInitStruct.MSIState = RCC_MSI_ON;
   RCC_OscInitStruct.MSICalibrationValue = RCC_MSICALIBRATION_DEFAULT;
   RCC_OscInitStruct.MSIClockRange = RCC_MSIRANGE_4;
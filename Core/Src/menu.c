@@ -33,9 +33,23 @@
 #include "ymodem.h"
 #include "stdio.h"
 #include "usart.h"
+#include "icache.h"
+#include "profile.h"
+#include "trace.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
+/* Menu keys compiled in or out */
+#if (PROFILE_ENABLED != 0U)
+#define MENU_KEY_PROFILE        ", 0"
+#else
+#define MENU_KEY_PROFILE        ""
+#endif
+#if (TRACE_ENABLED != 0U)
+#define MENU_KEY_TRACE          ", t"
+#else
+#define MENU_KEY_TRACE          ""
+#endif
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 uint32_t FlashProtection = 0;
@@ -43,27 +57,55 @@ uint8_t aFileName[FILE_NAME_LENGTH];
 uint32_t BankActive = 0U, BankInactive = 0U;
 
 /* Private function prototypes -----------------------------------------------*/
-void SerialDownload(void);
+void SerialDownload(uint32_t options);
+void SerialUpload(void);
+void FlashBench(void);
+void CacheReport(void);
+void Telemetry(void);
+#if (PROFILE_ENABLED != 0U)
+void ProfileReport(void);
+#endif
+#if (TRACE_ENABLED != 0U)
+void SerialTrace(void);
+#endif
 
 /* Private functions ---------------------------------------------------------*/
 /**
  * @brief  Download a file via serial port
- * @param  None
+ * @param  options: Ymodem_Receive() options
  * @retval None
  */
-void SerialDownload(void) {
-	uint32_t size = 0;
+void SerialDownload(uint32_t options) {
+	uint32_t size = 0, tickstart;
+	FLASH_QueueStatsTypeDef queue;
+	YMODEM_StatsTypeDef stats;
+	FLASH_SessionStatsTypeDef session;
 	COM_StatusTypeDef result;
 	printf("Waiting for the file to be sent ... (press 'a' to abort)\n\r");
-	result = Ymodem_Receive(&size, BankInactive);
+	tickstart = HAL_GetTick();
+	result = Ymodem_Receive(&size, BankInactive, options);
+	tickstart = HAL_GetTick() - tickstart;
 	if (result == COM_OK) {
 		printf("\n\n\r Programming Completed Successfully!\n\r--------------------------------\r\n Name: %s", aFileName);
 		printf("\n\r Size: %lu Bytes\r\n", size);
+		/* End to end, from the menu choice to the last ACK */
+		printf(" Time: %lu ms\r\n", tickstart);
+		FLASH_Queue_GetStats(&queue);
+		printf(" Flash queue: %lu operations, %lu errors, depth max %lu, %lu times full\r\n",
+				queue.completed, queue.errors, queue.depth_max, queue.full);
+		Ymodem_GetStats(&stats);
+		printf(" Pages: %lu written, %lu skipped\r\n", stats.pages_written, stats.pages_skipped);
+		FLASH_Session_GetStats(&session);
+		printf(" Verify: %lu bytes in %lu ms at the end, %lu writes read back\r\n", session.verified, session.verify_ms, session.readbacks);
+		printf(" Packets: %lu, handled in %lu us average, %lu us max\r\n", stats.packets,
+				(stats.packets != 0U) ? (stats.handling_us / stats.packets) : 0U, stats.handling_max_us);
 		printf("-------------------\n");
 	} else if (result == COM_LIMIT) {
 		printf("\n\n\rThe image size is higher than the allowed space memory!\n\r");
 	} else if (result == COM_DATA) {
 		printf("\n\n\rVerification failed!\n\r");
+	} else if (result == COM_BASE) {
+		printf("\n\n\rThe patch was not made for the running image!\n\r");
 	} else if (result == COM_ABORT) {
 		printf("\r\n\nAborted by user.\n\r");
 	} else {
@@ -71,6 +113,146 @@ void SerialDownload(void) {
 	}
 }
 
+/**
+ * @brief  Upload the active bank via serial port, for a backup
+ * @note   Trailing erased quadwords are not sent.
+ * @param  None
+ * @retval None
+ */
+void SerialUpload(void) {
+	uint32_t address = Flash_Get_BankAddress(BankActive);
+	uint32_t size = Flash_Get_ImageSize(BankActive);
+	COM_StatusTypeDef result;
+	const uint8_t *p_name = (BankActive == FLASH_BANK_2) ? (const uint8_t *)"bank2.bin" : (const uint8_t *)"bank1.bin";
+	printf("Select Receive File in the drop-down menu... (press 'a' to abort)\n\r");
+	result = Ymodem_Transmit((uint8_t *)address, p_name, size);
+	if (result == COM_OK) {
+		printf("\n\n\r Upload Completed Successfully!\n\r--------------------------------\r\n Name: %s", p_name);
+		printf("\n\r Size: %lu Bytes\r\n", size);
+		printf("-------------------\n");
+	} else if (result == COM_ABORT) {
+		printf("\r\n\nAborted by user.\n\r");
+	} else {
+		printf("\n\rFailed to send the file!\n\r");
+	}
+}
+
+/**
+ * @brief  Measure the flash programming speed
+ * @note   Uses the checkpoint page of the inactive bank: refused while an
+ *         interrupted download can be resumed, the bench would drop it.
+ * @param  None
+ * @retval None
+ */
+void FlashBench(void) {
+	FLASH_BenchTypeDef bench;
+	FLASH_CheckpointTypeDef checkpoint;
+	if (FLASH_CheckpointRead(BankInactive, &checkpoint) == FLASHIF_OK) {
+		printf("\n\rAn interrupted download can be resumed, complete it first!\n\r");
+		return;
+	}
+	printf("Programming %lu x %lu bytes per mode...\n\r", (uint32_t)FLASH_BENCH_RUNS, (uint32_t)FLASH_PAGE_SIZE);
+	if (FLASH_Bench(BankInactive, &bench) == FLASHIF_OK) {
+		printf(" Quadword: %lu bytes/ms\r\n", bench.quadword);
+		printf(" Burst:    %lu bytes/ms\r\n", bench.burst);
+	} else {
+		printf("\n\rFlash programming failed!\n\r");
+	}
+}
+
+/**
+ * @brief  Display the ICACHE monitors per phase since reset
+ * @param  None
+ * @retval None
+ */
+void CacheReport(void) {
+	static const char *const aPhase[ICACHE_PHASES] = { "Menu", "Header/erase", "Data", "Verify" };
+	ICACHE_ReportTypeDef report;
+	uint32_t phase, total, rate;
+	ICACHE_Monitor_GetReport(&report);
+	printf("ICACHE %s\r\n", (report.associativity == ICACHE_1WAY) ? "1-way (direct mapped)" : "2-ways set associative");
+	for (phase = 0; phase < ICACHE_PHASES; phase++) {
+		total = report.hits[phase] + report.misses[phase];
+		/* Hit rate in tenths of a percent */
+		rate = (total != 0U) ? (uint32_t)(((uint64_t)report.hits[phase] * 1000U) / total) : 0U;
+		printf(" %-13s %10lu hits, %8lu misses, %3lu.%lu %%\r\n", aPhase[phase], report.hits[phase], report.misses[phase],
+				rate / 10U, rate % 10U);
+	}
+}
+
+/**
+ * @brief  Print the record of the last download for the fleet tooling
+ * @note   One line of key=value pairs, times in us unless the key says ms,
+ *         throughput in bytes/s. The record stays until the next download,
+ *         failed ones included.
+ * @param  None
+ * @retval None
+ */
+void Telemetry(void) {
+	YMODEM_StatsTypeDef stats;
+	Ymodem_GetStats(&stats);
+	printf("ymodem result=%lu bytes=%lu packets=%lu naks=%lu crc_errors=%lu overruns=%lu framing=%lu",
+			stats.result, stats.bytes, stats.packets, stats.naks, stats.crc_errors, stats.uart_overruns, stats.uart_framing);
+	printf(" uart_wait=%lu crc=%lu erase=%lu program=%lu verify_ms=%lu time_ms=%lu throughput=%lu ack_max=%lu",
+			stats.uart_wait_us, stats.crc_us, stats.erase_us, stats.program_us, stats.verify_ms, stats.duration_ms,
+			stats.throughput, stats.ack_max_us);
+	printf(" handling_max=%lu pages_written=%lu pages_skipped=%lu\r\n", stats.handling_max_us, stats.pages_written, stats.pages_skipped);
+}
+
+#if (PROFILE_ENABLED != 0U)
+/**
+ * @brief  Print the cycles spent in the profiled sites, then clear them
+ * @note   The histogram lists the bins that counted something, by the
+ *         power of two of cycles they start at.
+ * @param  None
+ * @retval None
+ */
+void ProfileReport(void) {
+	static const char *const aSite[PROFILE_SITES] = { "ReceivePacket", "Crc16_Calc", "FLASH_Write", "FLASH_Erase" };
+	PROFILE_SiteTypeDef site;
+	uint32_t i, mean, mhz = SystemCoreClock / 1000000U;
+#if (PROFILE_HISTOGRAM != 0U)
+	uint32_t bin;
+#endif
+	printf("Cycles at %lu MHz:   count        min       mean        max    mean us\r\n", mhz);
+	for (i = 0; i < PROFILE_SITES; i++) {
+		Profile_Get(i, &site);
+		mean = (site.count != 0U) ? (uint32_t)(site.total / site.count) : 0U;
+		printf(" %-14s %8lu %10lu %10lu %10lu %10lu\r\n", aSite[i], site.count, site.min, mean, site.max, mean / mhz);
+#if (PROFILE_HISTOGRAM != 0U)
+		for (bin = 0; bin < PROFILE_BINS; bin++) {
+			if (site.bins[bin] != 0U) printf("   >= 2^%-2lu %8lu\r\n", bin, site.bins[bin]);
+		}
+#endif
+	}
+	Profile_Reset();
+}
+#endif
+
+#if (TRACE_ENABLED != 0U)
+/**
+ * @brief  Upload the event trace of the last download via serial port
+ * @note   The ring is sent as laid out in SRAM4, decode it on the host with
+ *         Tools/trace.py.
+ * @param  None
+ * @retval None
+ */
+void SerialTrace(void) {
+	uint32_t size;
+	const uint8_t *p_trace = Trace_Buffer(&size);
+	COM_StatusTypeDef result;
+	printf("Select Receive File in the drop-down menu... (press 'a' to abort)\n\r");
+	result = Ymodem_Transmit((uint8_t *)p_trace, (const uint8_t *)"trace.bin", size);
+	if (result == COM_OK) {
+		printf("\n\n\r Trace uploaded: %lu Bytes\r\n", size);
+	} else if (result == COM_ABORT) {
+		printf("\r\n\nAborted by user.\n\r");
+	} else {
+		printf("\n\rFailed to send the file!\n\r");
+	}
+}
+#endif
+
 /**
  * @brief  Display the Main Menu on HyperTerminal
  * @param  None
@@ -103,7 +285,19 @@ void Main_Menu(void) {
 //		FlashProtection = FLASH_GetWriteProtectionStatus();
 		printf("\r\n=================== Main Menu ============================\r\n\n");
 		printf("  Download image to the internal Flash ----------------- 1\r\n\n");
+		printf("  Upload image from the internal Flash ----------------- 2\r\n\n");
 		printf("  Exit menu -------------------------------------------- 3\r\n\n");
+		printf("  Download image, YMODEM-g streaming ------------------- 5\r\n\n");
+		printf("  Download image, skip unchanged pages ----------------- 6\r\n\n");
+		printf("  Measure flash programming speed ---------------------- 7\r\n\n");
+		printf("  ICACHE hits and misses per phase --------------------- 8\r\n\n");
+		printf("  Last download record, key=value ---------------------- 9\r\n\n");
+#if (PROFILE_ENABLED != 0U)
+		printf("  Cycles of the hot paths ------------------------------ 0\r\n\n");
+#endif
+#if (TRACE_ENABLED != 0U)
+		printf("  Upload the event trace of the last download ---------- t\r\n\n");
+#endif
 //		if(FlashProtection) {
 //			printf("  Disable the write protection ------------------------- 4\r\n\n");
 //		} else {
@@ -111,16 +305,59 @@ void Main_Menu(void) {
 //		}
 		printf("==========================================================\r\n\n");
 		/* Clean the input path */
-		__HAL_UART_FLUSH_DRREGISTER(&huart1);
-	    __HAL_UART_CLEAR_IT(&huart1, UART_CLEAR_OREF);
+		uart_rx_flush();
 		/* Receive key */
-		HAL_UART_Receive(&huart1, &key, 1, HAL_MAX_DELAY);
+		uart_read(&key, 1, HAL_MAX_DELAY);
 		switch (key) {
 		case '1': {
 			/* Download user application in the Flash */
-			SerialDownload();
+			SerialDownload(0);
+		}
+		break;
+		case '2': {
+			/* Upload the running image from the Flash */
+			SerialUpload();
+		}
+		break;
+		case '5': {
+			/* Download without per-packet ACKs, for clean links */
+			SerialDownload(YMODEM_OPT_STREAMING);
+		}
+		break;
+		case '6': {
+			/* Rewrite only the pages that differ from the bank */
+			SerialDownload(YMODEM_OPT_COMPARE);
+		}
+		break;
+		case '7': {
+			/* Quadword against burst programming */
+			FlashBench();
+		}
+		break;
+		case '8': {
+			/* Cache efficiency, to choose the mode and the code placement */
+			CacheReport();
+		}
+		break;
+		case '9': {
+			/* Collected by the fleet tooling after every update */
+			Telemetry();
+		}
+		break;
+#if (PROFILE_ENABLED != 0U)
+		case '0': {
+			/* Where the cycles go, since the last report */
+			ProfileReport();
+		}
+		break;
+#endif
+#if (TRACE_ENABLED != 0U)
+		case 't': {
+			/* Binary trace, no printf during the transfer */
+			SerialTrace();
 		}
 		break;
+#endif
 		case '3': {
 			printf("Press BUTTON_USER to swap Banks\r\n\n");
 			return;
@@ -146,7 +383,7 @@ void Main_Menu(void) {
 //		}
 //		break;
 		default:{
-			printf("Invalid Number ! ==> The number should be either 1, 2, 3 or 4\r");
+			printf("Invalid Number ! ==> The number should be one of 1, 2, 3, 5, 6, 7, 8, 9" MENU_KEY_PROFILE MENU_KEY_TRACE "\r");
 		}
 		break;
 		}
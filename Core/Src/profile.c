@@ -0,0 +1,101 @@
+/**
+  ******************************************************************************
+  * @file    profile.c
+  * @brief   This file provides the cycle counter profiler of the hot paths:
+  *          per-site count, min, max and mean of the durations measured
+  *          between PROFILE_BEGIN() and PROFILE_END(), and a histogram.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "profile.h"
+#include "string.h"
+
+#if (PROFILE_ENABLED != 0U)
+/* Private variables ---------------------------------------------------------*/
+static PROFILE_SiteTypeDef aProfileSite[PROFILE_SITES];
+#endif
+
+/* Public functions ---------------------------------------------------------*/
+/**
+ * @brief  Start the DWT cycle counter.
+ * @note   Called once at start up: the profiler, the trace and the timings
+ *         of the flash driver and of the downloads read DWT->CYCCNT.
+ * @param  None
+ * @retval None
+ */
+void Profile_CycleCounterInit(void) {
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+#if (PROFILE_ENABLED != 0U)
+/**
+ * @brief  Clear the sites.
+ * @note   The cycle counter runs from Profile_CycleCounterInit().
+ * @param  None
+ * @retval None
+ */
+void Profile_Init(void) {
+	Profile_Reset();
+}
+
+/**
+ * @brief  Clear the durations of every site.
+ * @param  None
+ * @retval None
+ */
+void Profile_Reset(void) {
+	uint32_t site;
+	memset(aProfileSite, 0, sizeof(aProfileSite));
+	for (site = 0; site < PROFILE_SITES; site++) aProfileSite[site].min = UINT32_MAX;
+}
+
+/**
+ * @brief  Account a duration to a site.
+ * @note   Main loop only: the sites are not protected from interrupts.
+ * @param  site: PROFILE_SITE_xxx
+ * @param  cycles: duration in DWT cycles
+ * @retval None
+ */
+void Profile_Record(uint32_t site, uint32_t cycles) {
+	PROFILE_SiteTypeDef *p_site;
+#if (PROFILE_HISTOGRAM != 0U)
+	uint32_t bin;
+#endif
+	if (site >= PROFILE_SITES) return;
+	p_site = &aProfileSite[site];
+	p_site->count++;
+	p_site->total += cycles;
+	if (cycles < p_site->min) p_site->min = cycles;
+	if (cycles > p_site->max) p_site->max = cycles;
+#if (PROFILE_HISTOGRAM != 0U)
+	/* Power of two below the duration */
+	bin = (cycles != 0U) ? (31U - __CLZ(cycles)) : 0U;
+	if (bin >= PROFILE_BINS) bin = PROFILE_BINS - 1U;
+	p_site->bins[bin]++;
+#endif
+}
+
+/**
+ * @brief  Durations of a site.
+ * @param  site: PROFILE_SITE_xxx
+ * @param  p_site: copy of the durations, min is 0 when count is 0
+ * @retval None
+ */
+void Profile_Get(uint32_t site, PROFILE_SiteTypeDef *p_site) {
+	if (site >= PROFILE_SITES) return;
+	*p_site = aProfileSite[site];
+	if (p_site->count == 0U) p_site->min = 0;
+}
+#endif /* PROFILE_ENABLED */
@@ -0,0 +1,98 @@
+/**
+  ******************************************************************************
+  * @file    trace.c
+  * @brief   This file provides the binary event trace: timestamped records
+  *          of fixed size, written without formatting in a ring in SRAM4,
+  *          so the protocol can be followed while the console carries it.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "trace.h"
+#include "string.h"
+
+#if (TRACE_ENABLED != 0U)
+/* Private typedef -----------------------------------------------------------*/
+/**
+  * @brief  SRAM4 layout, read by Tools/trace.py
+  */
+typedef struct
+{
+  TRACE_HeaderTypeDef header;
+  TRACE_RecordTypeDef aRecord[TRACE_RECORDS];
+} TRACE_RingTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static TRACE_RingTypeDef trace __attribute__((section(".trace"), aligned(4)));
+
+/* Public functions ---------------------------------------------------------*/
+/**
+ * @brief  Start the SRAM4 clock.
+ * @note   The trace of the previous run is kept when it is valid, to be
+ *         read after a reset.
+ * @param  None
+ * @retval None
+ */
+void Trace_Init(void) {
+	__HAL_RCC_SRAM4_CLK_ENABLE();
+	if ((trace.header.magic != TRACE_MAGIC) || (trace.header.version != TRACE_VERSION)
+			|| (trace.header.record_size != sizeof(TRACE_RecordTypeDef)) || (trace.header.capacity != TRACE_RECORDS)) {
+		Trace_Clear();
+	}
+}
+
+/**
+ * @brief  Empty the ring.
+ * @param  None
+ * @retval None
+ */
+void Trace_Clear(void) {
+	memset(&trace.header, 0, sizeof(trace.header));
+	trace.header.magic = TRACE_MAGIC;
+	trace.header.version = TRACE_VERSION;
+	trace.header.record_size = sizeof(TRACE_RecordTypeDef);
+	trace.header.capacity = TRACE_RECORDS;
+	trace.header.clock = SystemCoreClock;
+}
+
+/**
+ * @brief  Append a record, the oldest one goes when the ring is full.
+ * @note   Callable from interrupts: the flash engine traces its operations.
+ * @param  event: TRACE_EV_xxx
+ * @param  arg16: 16-bit argument of the event
+ * @param  arg: 32-bit argument of the event
+ * @retval None
+ */
+void Trace_Event(uint32_t event, uint32_t arg16, uint32_t arg) {
+	TRACE_RecordTypeDef *p_record;
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	p_record = &trace.aRecord[trace.header.written % TRACE_RECORDS];
+	trace.header.written++;
+	p_record->time = DWT->CYCCNT;
+	p_record->event = (uint16_t)event;
+	p_record->arg16 = (uint16_t)arg16;
+	p_record->arg = arg;
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief  The ring as it is laid out in SRAM4, to send to the host.
+ * @param  p_size: receives its size in bytes
+ * @retval start of the ring
+ */
+const uint8_t *Trace_Buffer(uint32_t *p_size) {
+	*p_size = sizeof(trace);
+	return (const uint8_t *)&trace;
+}
+#endif /* TRACE_ENABLED */
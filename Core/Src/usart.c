@@ -21,6 +21,26 @@
 #include "usart.h"
 
 /* USER CODE BEGIN 0 */
+#include "string.h"
+
+/* RX ring buffer, filled by GPDMA1 channel 0 in circular linked-list mode */
+static uint8_t aRxRing[UART_RX_RING_SIZE] __attribute__((aligned(4)));
+static uint32_t rx_tail = 0;                /* bytes consumed, free running */
+static __IO uint32_t rx_laps = 0;           /* ring wraps of the DMA */
+static __IO uint32_t rx_timeout_events = 0;
+static __IO uint32_t rx_overrun_events = 0;
+static UART_StatsTypeDef rx_stats;
+static uint64_t rx_wait_cycles = 0;    /* DWT cycles, when the counter runs */
+
+/* The .ioc only enables GPDMA1 and its interrupts: the USART1 channels and
+ * the RX linked-list queue are set up here, out of the generated code */
+DMA_HandleTypeDef handle_GPDMA1_Channel0;   /* RX, circular linked list */
+DMA_HandleTypeDef handle_GPDMA1_Channel1;   /* TX */
+static DMA_NodeTypeDef UART_RX_Node;
+static DMA_QListTypeDef UART_RX_Queue;
+
+static void UART_DMA_Init(UART_HandleTypeDef *uartHandle);
+static HAL_StatusTypeDef UART_RX_Queue_Config(void);
 
 /* USER CODE END 0 */
 
@@ -61,7 +81,7 @@ void MX_USART1_UART_Init(void)
   {
     Error_Handler();
   }
-  if (HAL_UARTEx_DisableFifoMode(&huart1) != HAL_OK)
+  if (HAL_UARTEx_EnableFifoMode(&huart1) != HAL_OK)
   {
     Error_Handler();
   }
@@ -85,7 +105,7 @@ void HAL_UART_MspInit(UART_HandleTypeDef* uartHandle)
   /** Initializes the peripherals clock
   */
     PeriphClkInit.PeriphClockSelection = RCC_PERIPHCLK_USART1;
-    PeriphClkInit.Usart1ClockSelection = RCC_USART1CLKSOURCE_SYSCLK;
+    PeriphClkInit.Usart1ClockSelection = RCC_USART1CLKSOURCE_HSI;
     if (HAL_RCCEx_PeriphCLKConfig(&PeriphClkInit) != HAL_OK)
     {
       Error_Handler();
@@ -106,7 +126,11 @@ void HAL_UART_MspInit(UART_HandleTypeDef* uartHandle)
     GPIO_InitStruct.Alternate = GPIO_AF7_USART1;
     HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
 
+    /* USART1 interrupt Init */
+    HAL_NVIC_SetPriority(USART1_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(USART1_IRQn);
   /* USER CODE BEGIN USART1_MspInit 1 */
+    UART_DMA_Init(uartHandle);
 
   /* USER CODE END USART1_MspInit 1 */
   }
@@ -129,19 +153,467 @@ void HAL_UART_MspDeInit(UART_HandleTypeDef* uartHandle)
     */
     HAL_GPIO_DeInit(GPIOB, GPIO_PIN_6|GPIO_PIN_7);
 
+    /* USART1 interrupt Deinit */
+    HAL_NVIC_DisableIRQ(USART1_IRQn);
   /* USER CODE BEGIN USART1_MspDeInit 1 */
+    HAL_DMA_DeInit(uartHandle->hdmarx);
+    HAL_DMA_DeInit(uartHandle->hdmatx);
 
   /* USER CODE END USART1_MspDeInit 1 */
   }
 }
 
 /* USER CODE BEGIN 1 */
+/**
+ * @brief  Set up the GPDMA1 channels of USART1, as MX_GPDMA1_Init() only
+ *         clocks the controller and enables its interrupts.
+ * @param  uartHandle: USART1 handle
+ * @retval None
+ */
+static void UART_DMA_Init(UART_HandleTypeDef *uartHandle)
+{
+  /* GPDMA1_REQUEST_USART1_RX Init */
+  handle_GPDMA1_Channel0.Instance = GPDMA1_Channel0;
+  handle_GPDMA1_Channel0.InitLinkedList.Priority = DMA_HIGH_PRIORITY;
+  handle_GPDMA1_Channel0.InitLinkedList.LinkStepMode = DMA_LSM_FULL_EXECUTION;
+  handle_GPDMA1_Channel0.InitLinkedList.LinkAllocatedPort = DMA_LINK_ALLOCATED_PORT1;
+  handle_GPDMA1_Channel0.InitLinkedList.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+  handle_GPDMA1_Channel0.InitLinkedList.LinkedListMode = DMA_LINKEDLIST_CIRCULAR;
+  if (HAL_DMAEx_List_Init(&handle_GPDMA1_Channel0) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  __HAL_LINKDMA(uartHandle, hdmarx, handle_GPDMA1_Channel0);
+
+  if (HAL_DMA_ConfigChannelAttributes(&handle_GPDMA1_Channel0, DMA_CHANNEL_NPRIV) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  /* GPDMA1_REQUEST_USART1_TX Init */
+  handle_GPDMA1_Channel1.Instance = GPDMA1_Channel1;
+  handle_GPDMA1_Channel1.Init.Request = GPDMA1_REQUEST_USART1_TX;
+  handle_GPDMA1_Channel1.Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+  handle_GPDMA1_Channel1.Init.Direction = DMA_MEMORY_TO_PERIPH;
+  handle_GPDMA1_Channel1.Init.SrcInc = DMA_SINC_INCREMENTED;
+  handle_GPDMA1_Channel1.Init.DestInc = DMA_DINC_FIXED;
+  handle_GPDMA1_Channel1.Init.SrcDataWidth = DMA_SRC_DATAWIDTH_BYTE;
+  handle_GPDMA1_Channel1.Init.DestDataWidth = DMA_DEST_DATAWIDTH_BYTE;
+  handle_GPDMA1_Channel1.Init.Priority = DMA_LOW_PRIORITY_HIGH_WEIGHT;
+  handle_GPDMA1_Channel1.Init.SrcBurstLength = 1;
+  handle_GPDMA1_Channel1.Init.DestBurstLength = 1;
+  handle_GPDMA1_Channel1.Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0|DMA_DEST_ALLOCATED_PORT1;
+  handle_GPDMA1_Channel1.Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+  handle_GPDMA1_Channel1.Init.Mode = DMA_NORMAL;
+  if (HAL_DMA_Init(&handle_GPDMA1_Channel1) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  __HAL_LINKDMA(uartHandle, hdmatx, handle_GPDMA1_Channel1);
+
+  if (HAL_DMA_ConfigChannelAttributes(&handle_GPDMA1_Channel1, DMA_CHANNEL_NPRIV) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  /* Build the circular RX queue and attach it to the channel */
+  if (UART_RX_Queue_Config() != HAL_OK)
+  {
+    Error_Handler();
+  }
+  if (HAL_DMAEx_List_LinkQ(&handle_GPDMA1_Channel0, &UART_RX_Queue) != HAL_OK)
+  {
+    Error_Handler();
+  }
+}
+
+/**
+ * @brief  Build the RX queue: one node looping on itself.
+ * @param  None
+ * @retval HAL status
+ */
+static HAL_StatusTypeDef UART_RX_Queue_Config(void)
+{
+  HAL_StatusTypeDef ret = HAL_OK;
+  /* DMA node configuration declaration */
+  DMA_NodeConfTypeDef pNodeConfig;
+
+  /* Set node configuration ################################################*/
+  pNodeConfig.NodeType = DMA_GPDMA_LINEAR_NODE;
+  pNodeConfig.Init.Request = GPDMA1_REQUEST_USART1_RX;
+  pNodeConfig.Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+  pNodeConfig.Init.Direction = DMA_PERIPH_TO_MEMORY;
+  pNodeConfig.Init.SrcInc = DMA_SINC_FIXED;
+  pNodeConfig.Init.DestInc = DMA_DINC_INCREMENTED;
+  pNodeConfig.Init.SrcDataWidth = DMA_SRC_DATAWIDTH_BYTE;
+  pNodeConfig.Init.DestDataWidth = DMA_DEST_DATAWIDTH_BYTE;
+  pNodeConfig.Init.SrcBurstLength = 1;
+  pNodeConfig.Init.DestBurstLength = 1;
+  pNodeConfig.Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0|DMA_DEST_ALLOCATED_PORT1;
+  pNodeConfig.Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+  pNodeConfig.Init.Mode = DMA_NORMAL;
+  pNodeConfig.TriggerConfig.TriggerPolarity = DMA_TRIG_POLARITY_MASKED;
+  pNodeConfig.DataHandlingConfig.DataExchange = DMA_EXCHANGE_NONE;
+  pNodeConfig.DataHandlingConfig.DataAlignment = DMA_DATA_RIGHTALIGN_ZEROPADDED;
+  pNodeConfig.SrcAddress = 0;
+  pNodeConfig.DstAddress = 0;
+  pNodeConfig.DataSize = 0;
+
+  /* Build UART_RX_Node Node */
+  ret |= HAL_DMAEx_List_BuildNode(&pNodeConfig, &UART_RX_Node);
+
+  /* Insert UART_RX_Node to Queue */
+  ret |= HAL_DMAEx_List_InsertNode_Tail(&UART_RX_Queue, &UART_RX_Node);
+
+  ret |= HAL_DMAEx_List_SetCircularMode(&UART_RX_Queue);
+
+  return ret;
+}
+
 void uart_write_byte(uint8_t byte){
+	uart_tx_wait(0xFFFF);
 	HAL_UART_Transmit(&huart1, &byte, 1, 0xFFFF);
 }
 
 void uart_write_string(void *p_buffer, uint16_t size){
+	uart_tx_wait(0xFFFF);
     HAL_UART_Transmit(&huart1, p_buffer, size, 0xFFFF);
 }
 
+/**
+ * @brief  Start sending a buffer by DMA and return at once.
+ * @note   The buffer may live in flash and must stay valid until
+ *         uart_tx_wait() returns.
+ * @param  p_buffer: data to send
+ * @param  size: number of bytes
+ * @retval HAL status
+ */
+HAL_StatusTypeDef uart_write_dma(const uint8_t *p_buffer, uint16_t size){
+	if (uart_tx_wait(0xFFFF) != HAL_OK) return HAL_TIMEOUT;
+	return HAL_UART_Transmit_DMA(&huart1, p_buffer, size);
+}
+
+/**
+ * @brief  Wait for the end of a DMA transmission.
+ * @param  timeout: timeout in ms
+ * @retval HAL_OK when the transmitter is free, HAL_TIMEOUT otherwise
+ */
+HAL_StatusTypeDef uart_tx_wait(uint32_t timeout){
+	uint32_t tickstart = HAL_GetTick();
+	while (huart1.gState != HAL_UART_STATE_READY) {
+		if ((HAL_GetTick() - tickstart) > timeout) return HAL_TIMEOUT;
+	}
+	return HAL_OK;
+}
+
+/**
+ * @brief  Compute the USART1 settings for a baud rate.
+ * @param  baud: requested rate
+ * @param  p_oversampling: UART_OVERSAMPLING_16 or _8, the closest one
+ * @retval error in per mille of the rate, above UART_BAUD_TOLERANCE when
+ *         the kernel clock cannot produce it
+ */
+static uint32_t uart_baud_error(uint32_t baud, uint32_t *p_oversampling){
+	uint32_t clock = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_USART1);
+	uint32_t k, div, actual, error, best = 1000U;
+	if (baud == 0U) return best;
+	/* k = 1: 16x oversampling, k = 2: 8x oversampling */
+	for (k = 1; k <= 2U; k++) {
+		div = ((clock * k) + (baud / 2U)) / baud;
+		if (div < 16U) continue;
+		actual = (clock * k) / div;
+		error = (uint32_t)(((uint64_t)((actual > baud) ? (actual - baud) : (baud - actual)) * 1000U) / baud);
+		if (error < best) {
+			best = error;
+			*p_oversampling = (k == 1U) ? UART_OVERSAMPLING_16 : UART_OVERSAMPLING_8;
+		}
+	}
+	return best;
+}
+
+/**
+ * @brief  Tell whether the USART1 clock can produce a baud rate.
+ * @param  baud: requested rate
+ * @retval 1 if supported, 0 otherwise
+ */
+uint32_t uart_baud_supported(uint32_t baud){
+	uint32_t oversampling;
+	return (uart_baud_error(baud, &oversampling) <= UART_BAUD_TOLERANCE) ? 1U : 0U;
+}
+
+/**
+ * @brief  Current USART1 baud rate.
+ * @retval uint32_t rate in bit/s
+ */
+uint32_t uart_get_baud(void){
+	return huart1.Init.BaudRate;
+}
+
+/**
+ * @brief  Change the USART1 baud rate.
+ * @note   Waits for the end of the current transmission; bytes not read yet
+ *         are lost since the RX ring is restarted.
+ * @param  baud: new rate, see uart_baud_supported()
+ * @retval HAL status
+ */
+HAL_StatusTypeDef uart_set_baud(uint32_t baud){
+	uint32_t oversampling = UART_OVERSAMPLING_16, tickstart;
+	HAL_StatusTypeDef status;
+	if (baud == huart1.Init.BaudRate) return HAL_OK;
+	if (uart_baud_error(baud, &oversampling) > UART_BAUD_TOLERANCE) return HAL_ERROR;
+	uart_tx_wait(0xFFFF);
+	tickstart = HAL_GetTick();
+	while ((__HAL_UART_GET_FLAG(&huart1, UART_FLAG_TC) == RESET) && ((HAL_GetTick() - tickstart) < 100U));
+	uart_rx_stop();
+	__HAL_UART_DISABLE(&huart1);
+	huart1.Init.BaudRate = baud;
+	huart1.Init.OverSampling = oversampling;
+	status = UART_SetConfig(&huart1);
+	__HAL_UART_ENABLE(&huart1);
+	/* UART_SetConfig() clears the FIFO setup */
+	if (status == HAL_OK) status = HAL_UARTEx_SetTxFifoThreshold(&huart1, UART_TXFIFO_THRESHOLD_1_8);
+	if (status == HAL_OK) status = HAL_UARTEx_SetRxFifoThreshold(&huart1, UART_RXFIFO_THRESHOLD_1_8);
+	if (status == HAL_OK) status = HAL_UARTEx_EnableFifoMode(&huart1);
+	if (uart_rx_start() != HAL_OK) status = HAL_ERROR;
+	return status;
+}
+
+/**
+ * @brief  Start the continuous DMA reception into the RX ring.
+ * @note   Reception never stops afterwards: bytes arriving while the
+ *         application is busy (sending an ACK, programming flash) are kept
+ *         in the ring until uart_read() consumes them.
+ * @retval HAL status
+ */
+HAL_StatusTypeDef uart_rx_start(void){
+	HAL_StatusTypeDef status;
+	rx_tail = 0;
+	rx_laps = 0;
+	/* Receiver timeout marks the end of a burst of characters */
+	HAL_UART_ReceiverTimeout_Config(&huart1, UART_RX_TIMEOUT_BITS);
+	HAL_UART_EnableReceiverTimeout(&huart1);
+	status = HAL_UARTEx_ReceiveToIdle_DMA(&huart1, aRxRing, UART_RX_RING_SIZE);
+	if (status == HAL_OK) __HAL_UART_ENABLE_IT(&huart1, UART_IT_RTO);
+	return status;
+}
+
+/**
+ * @brief  Stop the DMA reception.
+ * @retval None
+ */
+void uart_rx_stop(void){
+	__HAL_UART_DISABLE_IT(&huart1, UART_IT_RTO);
+	HAL_UART_DisableReceiverTimeout(&huart1);
+	HAL_UART_AbortReceive(&huart1);
+}
+
+/**
+ * @brief  Bytes written by the DMA since uart_rx_start(), free running.
+ * @note   The ring wraps counted by the transfer complete event, plus the
+ *         DMA position in the current lap.
+ * @retval uint32_t byte count
+ */
+static uint32_t uart_rx_head(void){
+	uint32_t laps, head;
+	do {
+		laps = rx_laps;
+		head = UART_RX_RING_SIZE - __HAL_DMA_GET_COUNTER(huart1.hdmarx);
+	} while (laps != rx_laps);
+	head += laps * UART_RX_RING_SIZE;
+	/* Wrapped, the transfer complete event not served yet */
+	if ((int32_t)(head - rx_tail) < 0) head += UART_RX_RING_SIZE;
+	return head;
+}
+
+/**
+ * @brief  Number of received bytes not consumed yet.
+ * @note   When the DMA got more than a ring ahead, unread bytes were
+ *         overwritten: they are all dropped, the overrun counted and
+ *         reported to the read in progress.
+ * @retval uint32_t byte count
+ */
+uint32_t uart_rx_available(void){
+	uint32_t head = uart_rx_head();
+	if ((head - rx_tail) > UART_RX_RING_SIZE) {
+		rx_tail = head;
+		rx_stats.overruns++;
+		rx_overrun_events++;
+	}
+	return head - rx_tail;
+}
+
+/**
+ * @brief  Drop every byte received so far.
+ * @retval None
+ */
+void uart_rx_flush(void){
+	rx_tail = uart_rx_head();
+}
+
+/**
+ * @brief  Read bytes from the RX ring.
+ * @param  p_data: destination buffer
+ * @param  size: number of bytes to read
+ * @param  timeout: overall timeout in ms
+ * @param  frame: when set, a receiver timeout (line silent in the middle of
+ *         the requested bytes) ends the read early
+ * @retval HAL_OK: all bytes read
+ *         HAL_TIMEOUT: timeout elapsed or the frame was cut short
+ *         HAL_ERROR: received bytes were lost, the ring overrun
+ */
+static HAL_StatusTypeDef uart_rx_copy(uint8_t *p_data, uint32_t size, uint32_t timeout, uint8_t frame){
+	uint32_t tickstart = HAL_GetTick(), waitstart = DWT->CYCCNT;
+	uint32_t rto = rx_timeout_events, overrun = rx_overrun_events;
+	uint32_t count, chunk, tail;
+	uint8_t waiting = 0;
+	while (size > 0) {
+		count = uart_rx_available();
+		if (overrun != rx_overrun_events) {
+			if (waiting) rx_wait_cycles += DWT->CYCCNT - waitstart;
+			return HAL_ERROR;
+		}
+		if (count == 0) {
+			if (!waiting) {
+				waitstart = DWT->CYCCNT;
+				waiting = 1;
+			}
+			if ((frame && (rto != rx_timeout_events) && (uart_rx_available() == 0))
+					|| ((timeout != HAL_MAX_DELAY) && ((HAL_GetTick() - tickstart) > timeout))) {
+				rx_wait_cycles += DWT->CYCCNT - waitstart;
+				return HAL_TIMEOUT;
+			}
+			continue;
+		}
+		if (waiting) {
+			rx_wait_cycles += DWT->CYCCNT - waitstart;
+			waiting = 0;
+		}
+		if (count > size) count = size;
+		/* Copy out of the ring in at most two contiguous runs */
+		tail = rx_tail & (UART_RX_RING_SIZE - 1U);
+		chunk = UART_RX_RING_SIZE - tail;
+		if (chunk > count) chunk = count;
+		memcpy(p_data, &aRxRing[tail], chunk);
+		memcpy(p_data + chunk, &aRxRing[0], count - chunk);
+		rx_tail += count;
+		p_data += count;
+		size -= count;
+		rto = rx_timeout_events;
+	}
+	return HAL_OK;
+}
+
+/**
+ * @brief  Drop received bytes until the line stays quiet.
+ * @param  quiet: required silence in ms
+ * @retval None
+ */
+void uart_rx_purge(uint32_t quiet){
+	uint32_t tickstart = HAL_GetTick();
+	while ((HAL_GetTick() - tickstart) <= quiet) {
+		if (uart_rx_available() != 0) {
+			uart_rx_flush();
+			tickstart = HAL_GetTick();
+		}
+	}
+}
+
+/**
+ * @brief  Wait for bytes in the RX ring.
+ * @param  p_data: destination buffer
+ * @param  size: number of bytes to read
+ * @param  timeout: timeout in ms
+ * @retval HAL_OK, HAL_TIMEOUT, or HAL_ERROR when bytes were lost
+ */
+HAL_StatusTypeDef uart_read(uint8_t *p_data, uint32_t size, uint32_t timeout){
+	return uart_rx_copy(p_data, size, timeout, 0);
+}
+
+/**
+ * @brief  Read the remainder of a frame from the RX ring.
+ * @note   Must be called after the first byte of the frame was consumed:
+ *         the receiver timeout then fires only if the sender stalls, so a
+ *         truncated frame is reported without waiting for the full timeout.
+ * @param  p_data: destination buffer
+ * @param  size: number of bytes to read
+ * @param  timeout: timeout in ms
+ * @retval HAL_OK, HAL_TIMEOUT, or HAL_ERROR when bytes were lost
+ */
+HAL_StatusTypeDef uart_read_frame(uint8_t *p_data, uint32_t size, uint32_t timeout){
+	return uart_rx_copy(p_data, size, timeout, 1);
+}
+
+/**
+ * @brief  USART1 interrupt hook, called before the HAL handler.
+ * @note   The HAL treats a receiver timeout as a blocking error and would
+ *         abort the circular DMA, so the flag is consumed here instead.
+ * @retval None
+ */
+void uart_rx_irq(void){
+	if (__HAL_UART_GET_FLAG(&huart1, UART_FLAG_RTOF)) {
+		__HAL_UART_CLEAR_FLAG(&huart1, UART_CLEAR_RTOF);
+		rx_timeout_events++;
+	}
+}
+
+/**
+ * @brief  Reception event callback (idle line, half and full ring).
+ * @note   The end of a burst is the receiver timeout's business, see
+ *         uart_read_frame(). Only the ring wraps are counted here, for
+ *         the overrun check of uart_rx_available().
+ * @param  huart: UART handle
+ * @param  Size: position of the DMA in the ring
+ * @retval None
+ */
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size){
+	UNUSED(Size);
+	if ((huart->Instance == USART1) && (HAL_UARTEx_GetRxEventType(huart) == HAL_UART_RXEVENT_TC)) {
+		rx_laps++;
+	}
+}
+
+/**
+ * @brief  UART error callback.
+ * @note   Overrun aborts the DMA reception: restart it so the ring keeps running.
+ *         Framing and noise errors leave it running, they are only counted.
+ * @param  huart: UART handle
+ * @retval None
+ */
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart){
+	if (huart->Instance != USART1) return;
+	if ((huart->ErrorCode & HAL_UART_ERROR_ORE) != 0U) rx_stats.overruns++;
+	if ((huart->ErrorCode & HAL_UART_ERROR_FE) != 0U) rx_stats.framing++;
+	if ((huart->ErrorCode & (HAL_UART_ERROR_NE | HAL_UART_ERROR_PE)) != 0U) rx_stats.noise++;
+	if (huart->RxState == HAL_UART_STATE_READY) {
+		/* The DMA restarts at the top of the ring, unread bytes are lost */
+		rx_tail = 0;
+		rx_laps = 0;
+		rx_overrun_events++;
+		HAL_UARTEx_ReceiveToIdle_DMA(&huart1, aRxRing, UART_RX_RING_SIZE);
+		__HAL_UART_ENABLE_IT(&huart1, UART_IT_RTO);
+	}
+}
+
+/**
+ * @brief  Clear the reception counters.
+ * @retval None
+ */
+void uart_rx_stats_reset(void){
+	memset(&rx_stats, 0, sizeof(rx_stats));
+	rx_wait_cycles = 0;
+}
+
+/**
+ * @brief  Reception counters since uart_rx_stats_reset().
+ * @note   The wait time needs the DWT cycle counter, it stays 0 otherwise.
+ * @param  p_stats: copy of the counters
+ * @retval None
+ */
+void uart_rx_stats(UART_StatsTypeDef *p_stats){
+	*p_stats = rx_stats;
+	p_stats->wait_us = (uint32_t)(rx_wait_cycles / (SystemCoreClock / 1000000U));
+}
+
 /* USER CODE END 1 */
@@ -24,24 +24,152 @@
 /* Includes ------------------------------------------------------------------*/
 #include "flash.h"
 #include "ymodem.h"
+#include "checksum.h"
+#include "lzss.h"
+#include "delta.h"
 #include "string.h"
 #include "main.h"
 #include "menu.h"
 #include "usart.h"
 #include "stdlib.h"
+#include "icache.h"
+#include "profile.h"
+#include "trace.h"
 
 /* Private typedef -----------------------------------------------------------*/
+/**
+  * @brief  Packet buffer waiting to be programmed
+  */
+typedef struct
+{
+  uint32_t address;   /* flash destination */
+  uint32_t length;    /* payload length */
+  uint8_t  pending;   /* PIPELINE_xxx */
+  FLASH_QueueOpTypeDef op; /* programming of a raw payload */
+} PacketSlotTypeDef;
+
+/**
+  * @brief  Download checkpoint being built
+  */
+typedef struct
+{
+  uint32_t bank;      /* bank receiving the image */
+  uint32_t start;     /* first address of the image */
+  uint8_t  active;    /* the sender announced a file hash */
+  FLASH_CheckpointTypeDef record;  /* latest record queued */
+  FLASH_CheckpointTypeDef written; /* record being programmed */
+  FLASH_QueueOpTypeDef op;         /* programming of the record */
+} CheckpointTypeDef;
+
+/**
+  * @brief  Image being written: the file data, or the image decoded from it
+  */
+typedef struct
+{
+  uint32_t format;    /* STREAM_xxx */
+  uint32_t bank;      /* bank receiving the image */
+  uint32_t start;     /* start of the image area */
+  uint32_t address;   /* next flash address of a decoded image */
+  uint32_t end;       /* end of the image area */
+  uint32_t erased;    /* pages below are erased or programmed */
+  FLASH_QueueOpTypeDef erase_op; /* erase ahead of raw payloads */
+  uint32_t compare;   /* raw image: program only the pages that differ */
+  uint32_t page;      /* compare: page being received, 0 for none */
+  uint32_t written;   /* compare: end of the data received in that page */
+  uint32_t matching;  /* compare: the page holds the data received so far */
+  uint32_t run;       /* raw image: flash address of the data combined */
+  uint32_t fill;      /* raw image: bytes combined */
+  uint32_t buffer;    /* raw image: combining buffer being filled */
+  YMODEM_StatsTypeDef stats;
+  uint32_t input;     /* file bytes still expected, the rest is padding */
+  uint32_t eof;       /* flash address of the end of the file received */
+  uint32_t size;      /* decoded image size */
+  const uint8_t *p_base; /* image a patch applies to, or pages are copied from */
+  uint32_t base_size; /* size of that image */
+  uint32_t send;      /* paged image: pages in the file */
+  uint32_t copy;      /* paged image: pages still to copy from p_base */
+} StreamTypeDef;
+
 /* Private define ------------------------------------------------------------*/
+/* Image formats */
+#define STREAM_RAW              0U  /* the file is the image */
+#define STREAM_LZSS             1U  /* LZSS compressed image */
+#define STREAM_DELTA            2U  /* patch of the running image */
+#define STREAM_PAGES            3U  /* changed pages of the image */
+
+/* Packet buffer states */
+#define PIPELINE_FREE           0U  /* buffer can receive */
+#define PIPELINE_WAITING        1U  /* payload not programmed yet */
+#define PIPELINE_FLASHING       2U  /* payload queued to the flash engine */
+
 #define CRC16_F       /* activate the CRC16 integrity */
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 /* @note ATTENTION - please keep this variable 32bit aligned */
-uint8_t aPacketData[PACKET_1K_SIZE + PACKET_DATA_INDEX + PACKET_TRAILER_SIZE];
+uint8_t aPacketData[PACKET_BUFFERS][PACKET_BUFFER_SIZE] __attribute__((aligned(4)));
+static PacketSlotTypeDef aPacketSlot[PACKET_BUFFERS];
+static uint32_t frame_limit = PACKET_1K_SIZE; /* largest data frame of the session */
+static CheckpointTypeDef checkpoint;
+static StreamTypeDef stream;
+/* One decoder at a time, they share the RAM */
+static union
+{
+  LZSS_DecoderTypeDef lzss;
+  DELTA_PatcherTypeDef delta;
+  uint8_t page[FLASH_PAGE_SIZE] __attribute__((aligned(4))); /* compare: page start kept across its erase */
+} decoder;
+/* Raw payloads gathered by page before programming */
+static uint8_t aCombine[COMBINE_BUFFERS][FLASH_PAGE_SIZE] __attribute__((aligned(4)));
+static FLASH_QueueOpTypeDef aCombineOp[COMBINE_BUFFERS];
+/* Negotiable baud rates, fastest first */
+static const uint32_t aBaudRates[] = {4000000, 2000000, 1000000, 921600, 460800, 230400};
+static uint32_t pipeline_error = FLASHIF_OK;
+static uint32_t handling_start;       /* DWT cycle of the last data packet in */
+static uint8_t handling = 0;          /* a data packet is being handled */
+static uint32_t packet_in;            /* DWT cycle the last data packet passed its CRC */
+static uint64_t crc_cycles;           /* DWT cycles checking packet CRCs */
 
 /* Private function prototypes -----------------------------------------------*/
 static HAL_StatusTypeDef ReceivePacket(uint8_t *p_data, uint32_t *p_length, uint32_t timeout);
-uint16_t UpdateCRC16(uint16_t crc_in, uint8_t byte);
-uint16_t Cal_CRC16(const uint8_t* p_data, uint32_t size);
+static void Pipeline_Reset(void);
+static void Pipeline_Queue(uint32_t slot, uint32_t address, uint32_t length);
+static void Pipeline_Process(void);
+static void Pipeline_Wait(uint32_t slot);
+static uint32_t Pipeline_Commit(void);
+static void Handling_Done(void);
+static void Ack_Latency(void);
+static void Stats_Finish(COM_StatusTypeDef result, uint32_t tickstart);
+static uint32_t PutDecimal(uint8_t *p_text, uint32_t value);
+static uint32_t GetExtension(const uint8_t *p_text, uint32_t length, const char *p_key, uint32_t *p_value);
+static uint32_t PutExtension(uint8_t *p_text, const char *p_key, uint32_t value);
+static void SendExtension(const char *p_key, uint32_t value);
+static uint32_t BaudSelect(uint32_t requested);
+static void SendWindowControl(uint8_t control, uint32_t blk_number);
+static uint32_t Stream_Base(uint32_t bank, uint32_t hash);
+static uint32_t Stream_Pages(uint32_t bank, uint32_t size, uint32_t send, uint32_t copy);
+static void Stream_Start(uint32_t format, uint32_t bank, uint32_t address, uint32_t input, uint32_t size, uint32_t compare);
+static uint32_t Stream_Erase(uint32_t end);
+static uint32_t Stream_Compare(FLASH_QueueOpTypeDef *p_op, uint32_t address, const uint8_t *p_data, uint32_t length);
+static uint32_t Stream_ComparePage(void);
+static uint32_t Stream_Rewrite(void);
+static uint32_t Stream_Trim(void);
+static uint32_t Stream_Combine(uint32_t address, const uint8_t *p_data, uint32_t length);
+static uint32_t Stream_Flush(uint32_t end);
+static uint32_t Stream_CombineWait(void);
+static uint32_t Stream_CopyPages(uint32_t limit);
+static void SendPageHashes(uint32_t bank);
+static uint32_t Stream_Write(FLASH_QueueOpTypeDef *p_op, uint32_t address, const uint8_t *p_data, uint32_t length);
+static uint32_t Stream_Output(const uint8_t *p_data, uint32_t length);
+static uint32_t Stream_Finish(void);
+static uint32_t Checkpoint_Start(uint32_t bank, uint32_t size, uint32_t hash);
+static uint32_t Checkpoint_Digest(uint32_t start, uint32_t offset);
+static void Checkpoint_Update(uint32_t end_address);
+static void Checkpoint_Done(void);
+static COM_StatusTypeDef ReceiveWindow(uint32_t address, uint32_t *p_end, uint32_t window, uint32_t frame, uint32_t *p_slot);
+static uint32_t FrameSize(uint32_t size_blk, uint32_t limit);
+static void PrepareIntialPacket(uint8_t *p_data, const uint8_t *p_file_name, uint32_t length);
+static HAL_StatusTypeDef SendDataPacket(const uint8_t *p_source, uint8_t blk_number, uint32_t size_blk, uint32_t packet_size);
+static HAL_StatusTypeDef WaitControl(uint8_t *p_char, uint32_t timeout);
 
 /* Private functions ---------------------------------------------------------*/
 
@@ -57,13 +185,15 @@ uint16_t Cal_CRC16(const uint8_t* p_data, uint32_t size);
  *         HAL_BUSY: abort by user
  */
 static HAL_StatusTypeDef ReceivePacket(uint8_t *p_data, uint32_t *p_length, uint32_t timeout) {
-	uint32_t crc;
+	uint32_t crc, start;
 	uint32_t packet_size = 0;
 	HAL_StatusTypeDef status;
 	uint8_t char1;
 	*p_length = 0;
-	status = HAL_UART_Receive(&huart1, &char1, 1, timeout);
+	status = uart_read(&char1, 1, timeout);
 	if (status == HAL_OK) {
+		/* From the first byte on: the wait for the sender is not counted */
+		PROFILE_BEGIN(PROFILE_SITE_PACKET);
 		switch (char1) {
 		case SOH: {
 			packet_size = PACKET_SIZE;
@@ -73,10 +203,27 @@ static HAL_StatusTypeDef ReceivePacket(uint8_t *p_data, uint32_t *p_length, uint
 			packet_size = PACKET_1K_SIZE;
 		}
 		break;
+		case STX_4K:{
+			/* Extended frames only once negotiated */
+			if (frame_limit >= PACKET_4K_SIZE) {
+				packet_size = PACKET_4K_SIZE;
+			} else {
+				status = HAL_ERROR;
+			}
+		}
+		break;
+		case STX_8K:{
+			if (frame_limit >= PACKET_8K_SIZE) {
+				packet_size = PACKET_8K_SIZE;
+			} else {
+				status = HAL_ERROR;
+			}
+		}
+		break;
 		case EOT:{}
 		break;
 		case CA:{
-			if ((HAL_UART_Receive(&huart1, &char1, 1, timeout) == HAL_OK) && (char1 == CA)) {
+			if ((uart_read_frame(&char1, 1, timeout) == HAL_OK) && (char1 == CA)) {
 				packet_size = 2;
 			} else {
 				status = HAL_ERROR;
@@ -96,7 +243,7 @@ static HAL_StatusTypeDef ReceivePacket(uint8_t *p_data, uint32_t *p_length, uint
 		}
 		*p_data = char1;
 		if (packet_size >= PACKET_SIZE ) {
-			status = HAL_UART_Receive(&huart1, &p_data[PACKET_NUMBER_INDEX], packet_size + PACKET_OVERHEAD_SIZE, timeout);
+			status = uart_read_frame(&p_data[PACKET_NUMBER_INDEX], packet_size + PACKET_OVERHEAD_SIZE, timeout);
 			/* Simple packet sanity check */
 			if (status == HAL_OK ) {
 				if (p_data[PACKET_NUMBER_INDEX] != ((p_data[PACKET_CNUMBER_INDEX]) ^ NEGATIVE_BYTE)) {
@@ -106,7 +253,12 @@ static HAL_StatusTypeDef ReceivePacket(uint8_t *p_data, uint32_t *p_length, uint
 					/* Check packet CRC */
 					crc = p_data[ packet_size + PACKET_DATA_INDEX ] << 8;
 					crc += p_data[ packet_size + PACKET_DATA_INDEX + 1 ];
-					if (Cal_CRC16(&p_data[PACKET_DATA_INDEX], packet_size) != crc ) {
+					start = DWT->CYCCNT;
+					crc ^= Crc16_Calc(&p_data[PACKET_DATA_INDEX], packet_size);
+					packet_in = DWT->CYCCNT;
+					crc_cycles += packet_in - start;
+					if (crc != 0U) {
+						stream.stats.crc_errors++;
 						packet_size = 0;
 						status = HAL_ERROR;
 					}
@@ -115,71 +267,1010 @@ static HAL_StatusTypeDef ReceivePacket(uint8_t *p_data, uint32_t *p_length, uint
 				packet_size = 0;
 			}
 		}
+		/* Resynchronize: drop the rest of a bad frame before asking again */
+		if ((status != HAL_OK) && (status != HAL_BUSY)) uart_rx_purge(PACKET_PURGE_TIMEOUT);
+		if (status == HAL_OK) {
+			if (packet_size >= PACKET_SIZE) TRACE(TRACE_EV_PACKET, p_data[PACKET_NUMBER_INDEX], packet_size);
+		} else if (status != HAL_BUSY) {
+			TRACE(TRACE_EV_BAD_PACKET, char1, status);
+		}
+		PROFILE_END(PROFILE_SITE_PACKET);
 	}
 	*p_length = packet_size;
 	return status;
 }
 
 /**
- * @brief  Update CRC16 for input byte
- * @param  crc_in input value
- * @param  input byte
+ * @brief  Drop every pending packet and clear the deferred error.
+ * @retval None
+ */
+static void Pipeline_Reset(void) {
+	uint32_t i;
+	/* The flash engine may still read the buffers */
+	FLASH_Queue_Wait(NULL, FLASH_QUEUE_TIMEOUT);
+	for (i = 0; i < PACKET_BUFFERS; i++) aPacketSlot[i].pending = PIPELINE_FREE;
+	pipeline_error = FLASHIF_OK;
+}
+
+/**
+ * @brief  Hand an acknowledged packet over to flash programming.
+ * @param  slot: packet buffer holding the payload
+ * @param  address: flash destination
+ * @param  length: payload length
+ * @retval None
+ */
+static void Pipeline_Queue(uint32_t slot, uint32_t address, uint32_t length) {
+	handling_start = DWT->CYCCNT;
+	handling = 1;
+	/* The file bytes only, not the padding of the last packet */
+	if (address < stream.eof) stream.stats.bytes += ((stream.eof - address) < length) ? (stream.eof - address) : length;
+	ICACHE_Monitor_Phase(ICACHE_PHASE_DATA);
+	aPacketSlot[slot].address = address;
+	aPacketSlot[slot].length = length;
+	aPacketSlot[slot].pending = PIPELINE_WAITING;
+}
+
+/**
+ * @brief  Program the pending packets, oldest first.
+ * @note   Runs after the early ACK, while the sender already streams the next
+ *         packet into the UART ring. Raw payloads are only queued to the
+ *         flash engine, their buffer is released once programmed. The first
+ *         failure is kept and reported by Pipeline_Commit().
+ * @retval None
+ */
+static void Pipeline_Process(void) {
+	uint32_t i, slot, oldest = 0, found, error;
+	FLASH_Queue_Poll();
+	/* Release the buffers the flash engine is done with */
+	for (i = 0; i < PACKET_BUFFERS; i++) {
+		if ((aPacketSlot[i].pending == PIPELINE_FLASHING) && (aPacketSlot[i].op.status != FLASHIF_BUSY)) {
+			if (pipeline_error == FLASHIF_OK) pipeline_error = aPacketSlot[i].op.status;
+			aPacketSlot[i].pending = PIPELINE_FREE;
+		}
+	}
+	do {
+		found = 0;
+		for (i = 0; i < PACKET_BUFFERS; i++) {
+			if ((aPacketSlot[i].pending == PIPELINE_WAITING) && (!found || (aPacketSlot[i].address < aPacketSlot[oldest].address))) {
+				oldest = i;
+				found = 1;
+			}
+		}
+		if (found) {
+			slot = oldest;
+			if (pipeline_error == FLASHIF_OK) {
+				error = Stream_Write(&aPacketSlot[slot].op, aPacketSlot[slot].address, &aPacketData[slot][PACKET_DATA_INDEX], aPacketSlot[slot].length);
+				/* Engine queue full: next time */
+				if (error == FLASHIF_BUSY) break;
+				pipeline_error = error;
+			}
+			aPacketSlot[slot].pending = ((pipeline_error == FLASHIF_OK) && (aPacketSlot[slot].op.status == FLASHIF_BUSY)) ? PIPELINE_FLASHING : PIPELINE_FREE;
+		}
+	} while (found);
+}
+
+/**
+ * @brief  Wait until a packet buffer can receive again.
+ * @param  slot: packet buffer
+ * @retval None
+ */
+static void Pipeline_Wait(uint32_t slot) {
+	while (aPacketSlot[slot].pending != PIPELINE_FREE) {
+		if (aPacketSlot[slot].pending == PIPELINE_FLASHING) FLASH_Queue_Wait(&aPacketSlot[slot].op, FLASH_QUEUE_TIMEOUT);
+		Pipeline_Process();
+	}
+}
+
+/**
+ * @brief  The receiver is ready for the next packet: account the time the
+ *         last data packet took, programming stalls included.
+ * @retval None
+ */
+static void Handling_Done(void) {
+	uint32_t us;
+	if (!handling) return;
+	handling = 0;
+	us = (DWT->CYCCNT - handling_start) / (SystemCoreClock / 1000000U);
+	stream.stats.packets++;
+	stream.stats.handling_us += us;
+	if (us > stream.stats.handling_max_us) stream.stats.handling_max_us = us;
+}
+
+/**
+ * @brief  A data packet is acknowledged: account the time since it passed
+ *         its CRC, for the worst case.
+ * @retval None
+ */
+static void Ack_Latency(void) {
+	uint32_t us = (DWT->CYCCNT - packet_in) / (SystemCoreClock / 1000000U);
+	if (us > stream.stats.ack_max_us) stream.stats.ack_max_us = us;
+}
+
+/**
+ * @brief  Complete the statistics record at the end of a reception.
+ * @param  result: result of the reception
+ * @param  tickstart: HAL tick at its start
  * @retval None
  */
-uint16_t UpdateCRC16(uint16_t crc_in, uint8_t byte) {
-	uint32_t crc = crc_in;
-	uint32_t in = byte | 0x100;
+static void Stats_Finish(COM_StatusTypeDef result, uint32_t tickstart) {
+	FLASH_SessionStatsTypeDef session;
+	UART_StatsTypeDef uart;
+	FLASH_Session_GetStats(&session);
+	uart_rx_stats(&uart);
+	stream.stats.result = (uint32_t)result;
+	stream.stats.uart_overruns = uart.overruns;
+	stream.stats.uart_framing = uart.framing + uart.noise;
+	stream.stats.uart_wait_us = uart.wait_us;
+	stream.stats.crc_us = (uint32_t)(crc_cycles / (SystemCoreClock / 1000000U));
+	stream.stats.erase_us = session.erase_us;
+	stream.stats.program_us = session.program_us;
+	stream.stats.verify_ms = session.verify_ms;
+	stream.stats.duration_ms = HAL_GetTick() - tickstart;
+	stream.stats.throughput = (stream.stats.duration_ms != 0U) ? (uint32_t)(((uint64_t)stream.stats.bytes * 1000U) / stream.stats.duration_ms) : 0U;
+}
+
+/**
+ * @brief  Commit barrier: wait for every pending packet to be programmed.
+ * @retval FLASHIF_OK if all the acknowledged data reached the flash,
+ *         otherwise the first deferred write error
+ */
+static uint32_t Pipeline_Commit(void) {
+	uint32_t i;
+	for (i = 0; i < PACKET_BUFFERS; i++) Pipeline_Wait(i);
+	if ((pipeline_error == FLASHIF_OK) && (FLASH_Queue_Wait(&stream.erase_op, FLASH_QUEUE_TIMEOUT) != FLASHIF_OK)) pipeline_error = FLASHIF_ERASEKO;
+	/* Full pages only, the one being combined is not written yet */
+	if (pipeline_error == FLASHIF_OK) pipeline_error = Stream_CombineWait();
+	return pipeline_error;
+}
+
+/**
+ * @brief  Write a value in decimal.
+ * @param  p_text: output, not NUL terminated
+ * @param  value: value to write
+ * @retval number of characters written
+ */
+static uint32_t PutDecimal(uint8_t *p_text, uint32_t value) {
+	uint8_t astring[10];
+	uint32_t i = 0, j = 0;
 	do {
-		crc <<= 1;
-		in <<= 1;
-		if(in & 0x100) ++crc;
-		if(crc & 0x10000) crc ^= 0x1021;
+		astring[i++] = (uint8_t)('0' + (value % 10U));
+		value /= 10U;
+	} while (value != 0U);
+	while (i > 0U) p_text[j++] = astring[--i];
+	return j;
+}
+
+/**
+ * @brief  Look for a "@key=value" session extension.
+ * @param  p_text: text to scan, stops at the first NUL
+ * @param  length: size of the text
+ * @param  p_key: extension name
+ * @param  p_value: decimal value of the extension
+ * @retval 1 if the extension is present, 0 otherwise
+ */
+static uint32_t GetExtension(const uint8_t *p_text, uint32_t length, const char *p_key, uint32_t *p_value) {
+	uint32_t i, k, value;
+	for (i = 0; (i < length) && (p_text[i] != '\0'); i++) {
+		if (p_text[i] != YMODEM_EXT_PREFIX) continue;
+		for (k = 0; (p_key[k] != '\0') && (i + 1 + k < length) && (p_text[i + 1 + k] == (uint8_t)p_key[k]); k++);
+		i += 1 + k;
+		if ((p_key[k] != '\0') || (i >= length) || (p_text[i] != '=')) continue;
+		value = 0;
+		for (i++; (i < length) && (p_text[i] >= '0') && (p_text[i] <= '9'); i++) {
+			value = (value * 10U) + (p_text[i] - '0');
+		}
+		*p_value = value;
+		return 1;
 	}
-	while(!(in & 0x10000));
-	return crc & 0xffffu;
+	return 0;
 }
 
 /**
- * @brief  Cal CRC16 for YModem Packet
- * @param  data
- * @param  length
+ * @brief  Write a "@key=value" session extension.
+ * @param  p_text: output, not NUL terminated
+ * @param  p_key: extension name
+ * @param  value: extension value
+ * @retval number of characters written
+ */
+static uint32_t PutExtension(uint8_t *p_text, const char *p_key, uint32_t value) {
+	uint32_t i = 0;
+	p_text[i++] = YMODEM_EXT_PREFIX;
+	while ((*p_key != '\0') && (i < YMODEM_EXT_LENGTH - 12U)) p_text[i++] = (uint8_t)*p_key++;
+	p_text[i++] = '=';
+	i += PutDecimal(&p_text[i], value);
+	return i;
+}
+
+/**
+ * @brief  Send a "@key=value" line to the peer.
+ * @param  p_key: extension name
+ * @param  value: accepted value
+ * @retval None
+ */
+static void SendExtension(const char *p_key, uint32_t value) {
+	uint8_t aline[YMODEM_EXT_LENGTH];
+	uint32_t i = PutExtension(aline, p_key, value);
+	aline[i++] = YMODEM_EXT_END;
+	uart_write_string(aline, i);
+}
+
+/**
+ * @brief  Pick the fastest baud rate the USART1 clock supports.
+ * @param  requested: highest rate acceptable to the peer
+ * @retval negotiated rate, UART_BAUD_DEFAULT if none fits
+ */
+static uint32_t BaudSelect(uint32_t requested) {
+	uint32_t i;
+	for (i = 0; i < (sizeof(aBaudRates) / sizeof(aBaudRates[0])); i++) {
+		if ((aBaudRates[i] <= requested) && uart_baud_supported(aBaudRates[i])) return aBaudRates[i];
+	}
+	return UART_BAUD_DEFAULT;
+}
+
+/**
+ * @brief  Pick the data frame for the next block.
+ * @param  size_blk: payload bytes left in the image
+ * @param  limit: largest frame of the session
+ * @retval smallest frame holding the block, at most limit
+ */
+static uint32_t FrameSize(uint32_t size_blk, uint32_t limit) {
+	if (size_blk <= PACKET_SIZE) return PACKET_SIZE;
+	if ((size_blk <= PACKET_1K_SIZE) || (limit < PACKET_4K_SIZE)) return PACKET_1K_SIZE;
+	if ((size_blk <= PACKET_4K_SIZE) || (limit < PACKET_8K_SIZE)) return PACKET_4K_SIZE;
+	return PACKET_8K_SIZE;
+}
+
+/**
+ * @brief  Prepare the first block (file name and size)
+ * @note   The frame size and baud rate extensions follow the file size.
+ * @param  p_data: output buffer
+ * @param  p_file_name: name of the file to be sent
+ * @param  length: length of the file to be sent in bytes
+ * @retval None
+ */
+static void PrepareIntialPacket(uint8_t *p_data, const uint8_t *p_file_name, uint32_t length) {
+	uint32_t i, j;
+	/* first 3 bytes are constant */
+	p_data[PACKET_START_INDEX] = SOH;
+	p_data[PACKET_NUMBER_INDEX] = 0x00;
+	p_data[PACKET_CNUMBER_INDEX] = 0xff;
+	/* Filename written */
+	for (i = 0; (p_file_name[i] != '\0') && (i < FILE_NAME_LENGTH); i++) {
+		p_data[i + PACKET_DATA_INDEX] = p_file_name[i];
+	}
+	p_data[i + PACKET_DATA_INDEX] = 0x00;
+	i = i + PACKET_DATA_INDEX + 1;
+	/* file size written, then what we can do faster than plain YMODEM */
+	i += PutDecimal(&p_data[i], length);
+	p_data[i++] = ' ';
+	i += PutExtension(&p_data[i], YMODEM_KEY_BLOCK, PACKET_MAX_SIZE);
+	p_data[i++] = ' ';
+	i += PutExtension(&p_data[i], YMODEM_KEY_BAUD, BaudSelect(0xFFFFFFFFU));
+	/* padding with zeros */
+	for (j = i; j < PACKET_SIZE + PACKET_DATA_INDEX; j++) {
+		p_data[j] = 0;
+	}
+}
+
+/**
+ * @brief  Send one data block straight from memory.
+ * @note   The payload goes out by DMA from its source (flash) while the CPU
+ *         computes the CRC over the same bytes. Only the 3-byte header, the
+ *         0x1A padding of a short block and the CRC are staged in RAM.
+ * @param  p_source: first payload byte
+ * @param  blk_number: block number
+ * @param  size_blk: payload bytes left in the image
+ * @param  packet_size: data frame, see FrameSize()
+ * @retval HAL status
+ */
+static HAL_StatusTypeDef SendDataPacket(const uint8_t *p_source, uint8_t blk_number, uint32_t size_blk, uint32_t packet_size) {
+	static uint8_t aHeader[PACKET_HEADER_SIZE];
+	static uint8_t aTrailer[PACKET_TRAILER_SIZE];
+	static uint8_t aPadding[PACKET_SIZE];
+	uint32_t size = (size_blk < packet_size) ? size_blk : packet_size;
+	uint32_t chunk, pad;
+	uint16_t crc;
+	HAL_StatusTypeDef status;
+	switch (packet_size) {
+	case PACKET_8K_SIZE: aHeader[0] = STX_8K; break;
+	case PACKET_4K_SIZE: aHeader[0] = STX_4K; break;
+	case PACKET_1K_SIZE: aHeader[0] = STX; break;
+	default: aHeader[0] = SOH; break;
+	}
+	aHeader[1] = blk_number;
+	aHeader[2] = (~blk_number);
+	status = uart_write_dma(aHeader, PACKET_HEADER_SIZE);
+	if (status == HAL_OK) status = uart_write_dma(p_source, size);
+	if (status != HAL_OK) return status;
+	/* CRC on the fly, while the payload is on the wire */
+	crc = Crc16_Update(0, p_source, size);
+	memset(aPadding, 0x1A, PACKET_SIZE);
+	for (pad = packet_size - size; (pad > 0U) && (status == HAL_OK); pad -= chunk) {
+		chunk = (pad < PACKET_SIZE) ? pad : PACKET_SIZE;
+		crc = Crc16_Update(crc, aPadding, chunk);
+		status = uart_write_dma(aPadding, chunk);
+	}
+	aTrailer[0] = (uint8_t)(crc >> 8);
+	aTrailer[1] = (uint8_t)(crc & 0xFF);
+	if (status == HAL_OK) status = uart_write_dma(aTrailer, PACKET_TRAILER_SIZE);
+	if (status == HAL_OK) status = uart_tx_wait(PACKET_TX_TIMEOUT);
+	return status;
+}
+
+/**
+ * @brief  Wait for a control character from the receiver.
+ * @param  p_char: received character
+ * @param  timeout: timeout in ms
+ * @retval HAL_OK: character received
+ *         HAL_BUSY: CA CA, abort by receiver
+ *         HAL_TIMEOUT: nothing received
+ */
+static HAL_StatusTypeDef WaitControl(uint8_t *p_char, uint32_t timeout) {
+	if (uart_read(p_char, 1, timeout) != HAL_OK) return HAL_TIMEOUT;
+	if ((*p_char == CA) && (uart_read(p_char, 1, PACKET_PURGE_TIMEOUT) == HAL_OK) && (*p_char == CA)) {
+		return HAL_BUSY;
+	}
+	return HAL_OK;
+}
+
+/**
+ * @brief  Check the image a patch applies to.
+ * @note   The patch is made against the running image, the one in the
+ *         other bank. Its erased end is not part of it.
+ * @param  bank: Flash bank receiving the new image
+ * @param  hash: CRC-32 of the base image announced by the sender
+ * @retval FLASHIF_OK when the running image matches, FLASHIF_WRITING_ERROR
+ *         otherwise
+ */
+static uint32_t Stream_Base(uint32_t bank, uint32_t hash) {
+	uint32_t base = (bank == FLASH_BANK_1) ? FLASH_BANK_2 : FLASH_BANK_1;
+	stream.p_base = (const uint8_t *)Flash_Get_BankAddress(base);
+	stream.base_size = Flash_Get_ImageSize(base);
+	return (Crc32_Update(0, stream.p_base, stream.base_size) == hash) ? FLASHIF_OK : FLASHIF_WRITING_ERROR;
+}
+
+/**
+ * @brief  Prepare the bank for a paged image.
+ * @note   Pages neither sent nor copied are kept as they are: the sender
+ *         found them already in the bank. The others, the pages after the
+ *         image and the checkpoint page are erased.
+ * @param  bank: Flash bank receiving the new image
+ * @param  size: new image size
+ * @param  send: pages in the file
+ * @param  copy: pages copied from the running image
+ * @retval FLASHIF_OK, FLASHIF_ERASEKO or FLASHIF_WRITINGCTRL_ERROR for
+ *         masks that do not fit the image
+ */
+static uint32_t Stream_Pages(uint32_t bank, uint32_t size, uint32_t send, uint32_t copy) {
+	uint32_t pages = (size + FLASH_PAGE_SIZE - 1U) / FLASH_PAGE_SIZE, keep, page, first, result = FLASHIF_OK;
+	if ((FLASH_PAGE_NB > YMODEM_PAGES_MAX) || ((send & copy) != 0U) || (((send | copy) >> pages) != 0U)) return FLASHIF_WRITINGCTRL_ERROR;
+	keep = ~(send | copy) & ((1U << pages) - 1U);
+	stream.p_base = (const uint8_t *)Flash_Get_BankAddress((bank == FLASH_BANK_1) ? FLASH_BANK_2 : FLASH_BANK_1);
+	stream.send = send;
+	stream.copy = copy;
+	for (page = 0; page < pages; page++) {
+		if ((keep & (1U << page)) != 0U) stream.stats.pages_skipped++; else stream.stats.pages_written++;
+	}
+	/* Erase the runs of pages not kept */
+	for (page = 0; (page < FLASH_PAGE_NB) && (result == FLASHIF_OK); page++) {
+		if ((keep & (1U << page)) != 0U) continue;
+		for (first = page; ((page + 1U) < FLASH_PAGE_NB) && ((keep & (1U << (page + 1U))) == 0U); page++);
+		result = FLASH_PagesErase(bank, first, page + 1U - first);
+	}
+	return result;
+}
+
+/**
+ * @brief  Copy the pending pages of the running image below a page.
+ * @param  limit: first page not copied
+ * @retval FLASHIF_OK or the FLASH_Write() error
+ */
+static uint32_t Stream_CopyPages(uint32_t limit) {
+	uint32_t page, error = FLASHIF_OK;
+	for (page = 0; (page < limit) && (stream.copy != 0U) && (error == FLASHIF_OK); page++) {
+		if ((stream.copy & (1U << page)) == 0U) continue;
+		stream.copy &= ~(1U << page);
+		error = FLASH_Write(stream.address + (page * FLASH_PAGE_SIZE), &stream.p_base[page * FLASH_PAGE_SIZE], FLASH_PAGE_SIZE);
+	}
+	return error;
+}
+
+/**
+ * @brief  Send the CRC-32 of every image page of both banks.
+ * @param  bank: Flash bank receiving the next image
+ * @retval None
+ */
+static void SendPageHashes(uint32_t bank) {
+	const uint8_t *p_active = (const uint8_t *)Flash_Get_BankAddress((bank == FLASH_BANK_1) ? FLASH_BANK_2 : FLASH_BANK_1);
+	const uint8_t *p_inactive = (const uint8_t *)Flash_Get_BankAddress(bank);
+	uint32_t page, pages = FLASH_IMAGE_SIZE / FLASH_PAGE_SIZE;
+	SendExtension(YMODEM_KEY_PAGEHASH, pages);
+	for (page = 0; page < pages; page++) {
+		SendExtension(YMODEM_KEY_PAGE_ACTIVE, Crc32_Update(0, &p_active[page * FLASH_PAGE_SIZE], FLASH_PAGE_SIZE));
+		SendExtension(YMODEM_KEY_PAGE_INACTIVE, Crc32_Update(0, &p_inactive[page * FLASH_PAGE_SIZE], FLASH_PAGE_SIZE));
+	}
+}
+
+/**
+ * @brief  Select how the file data reaches the flash.
+ * @note   A patch needs Stream_Base() first, a paged image Stream_Pages().
+ *         The pages from address on are erased as the writes reach them.
+ * @param  format: STREAM_RAW, STREAM_LZSS, STREAM_DELTA or STREAM_PAGES
+ * @param  bank: Flash bank receiving the image
+ * @param  address: first address written, page aligned
+ * @param  input: file size, the packet padding after it is dropped
+ * @param  size: decoded image size
+ * @param  compare: raw image, leave the pages already holding the data
+ * @retval None
+ */
+static void Stream_Start(uint32_t format, uint32_t bank, uint32_t address, uint32_t input, uint32_t size, uint32_t compare) {
+	uint32_t i;
+	stream.format = format;
+	stream.bank = bank;
+	stream.start = Flash_Get_BankAddress(bank);
+	stream.address = address;
+	stream.end = stream.start + FLASH_IMAGE_SIZE;
+	/* Stream_Pages() erased what a paged image needs */
+	stream.erased = (format == STREAM_PAGES) ? stream.end : address;
+	stream.erase_op.status = FLASHIF_OK;
+	stream.compare = (format == STREAM_RAW) ? compare : 0U;
+	stream.page = 0;
+	stream.fill = 0;
+	stream.buffer = 0;
+	for (i = 0; i < COMBINE_BUFFERS; i++) aCombineOp[i].status = FLASHIF_OK;
+	stream.input = input;
+	stream.eof = address + input;
+	stream.size = size;
+	if (format == STREAM_LZSS) LZSS_Init(&decoder.lzss);
+	if (format == STREAM_DELTA) DELTA_Init(&decoder.delta, stream.p_base, stream.base_size);
+}
+
+/**
+ * @brief  Erase the pages up to an address, just before they are written.
+ * @note   Pages are erased in order from the first address written, so a
+ *         page is never erased once programmed, whatever the frame order.
+ *         The erase is queued to the flash engine ahead of the writes and
+ *         runs while the next frame comes in.
+ * @param  end: end of the data about to be written
+ * @retval FLASHIF_OK or FLASHIF_ERASEKO
+ */
+static uint32_t Stream_Erase(uint32_t end) {
+	uint32_t page, nb_pages, error;
+	if (end > stream.end) end = stream.end;
+	if (end <= stream.erased) return FLASHIF_OK;
+	page = (stream.erased - stream.start) / FLASH_PAGE_SIZE;
+	nb_pages = ((end - stream.erased) + FLASH_PAGE_SIZE - 1U) / FLASH_PAGE_SIZE;
+	/* One erase in flight, the previous one must have worked */
+	if (FLASH_Queue_Wait(&stream.erase_op, FLASH_QUEUE_TIMEOUT) != FLASHIF_OK) return FLASHIF_ERASEKO;
+	error = FLASH_Queue_Erase(&stream.erase_op, stream.bank, page, nb_pages);
+	if (error == FLASHIF_BUSY) {
+		FLASH_Queue_Wait(NULL, FLASH_QUEUE_TIMEOUT);
+		error = FLASH_Queue_Erase(&stream.erase_op, stream.bank, page, nb_pages);
+	}
+	if (error != FLASHIF_OK) return FLASHIF_ERASEKO;
+	stream.erased += nb_pages * FLASH_PAGE_SIZE;
+	stream.stats.pages_written += nb_pages;
+	return FLASHIF_OK;
+}
+
+/**
+ * @brief  Program a raw payload only where the bank differs.
+ * @note   Payloads come in order and never straddle a page. A page is left
+ *         alone while every payload matches it. At the first difference
+ *         it is erased, its matching start written back from RAM, and the
+ *         rest of it programmed as usual. The YMODEM padding after the
+ *         end of the file is dropped: the last quadword of the file is
+ *         compared and programmed from a copy completed with 0xFF, as
+ *         erased, the payload buffer is left alone.
+ * @param  p_op: flash operation of the payload buffer
+ * @param  address: flash destination
+ * @param  p_data: payload
+ * @param  length: payload length
+ * @retval FLASHIF_OK, FLASHIF_BUSY when the flash engine queue is full,
+ *         or the erase/write error
+ */
+static uint32_t Stream_Compare(FLASH_QueueOpTypeDef *p_op, uint32_t address, const uint8_t *p_data, uint32_t length) {
+	uint32_t page = address - ((address - stream.start) % FLASH_PAGE_SIZE), error = FLASHIF_OK;
+	uint32_t eof = stream.start + stream.input, tail;
+	uint64_t quadword[2];
+	if ((address + length) > (page + FLASH_PAGE_SIZE)) return FLASHIF_WRITINGCTRL_ERROR;
+	if (address >= eof) return FLASHIF_OK;
+	if (length > (eof - address)) length = eof - address;
+	/* Whole quadwords from the payload, the end of the file from the copy */
+	tail = length % sizeof(quadword);
+	length -= tail;
+	if (tail != 0U) {
+		memset(quadword, 0xFF, sizeof(quadword));
+		memcpy(quadword, &p_data[length], tail);
+	}
+	if (page != stream.page) {
+		/* Next page: settle the previous one */
+		error = Stream_ComparePage();
+		stream.page = page;
+		stream.written = address;
+		stream.matching = 1;
+		stream.erased = page + FLASH_PAGE_SIZE;
+	}
+	if (error != FLASHIF_OK) return error;
+	if (stream.matching) {
+		if ((memcmp((const void *)address, p_data, length) == 0)
+				&& ((tail == 0U) || (memcmp((const void *)(address + length), quadword, sizeof(quadword)) == 0))) {
+			stream.written = address + length + ((tail != 0U) ? sizeof(quadword) : 0U);
+			return FLASHIF_OK;
+		}
+		error = Stream_Rewrite();
+		if (error != FLASHIF_OK) return error;
+	}
+	stream.written = address + length;
+	if (tail == 0U) return FLASH_Queue_Program(p_op, address, p_data, length);
+	if (length != 0U) error = FLASH_Queue_Program(p_op, address, p_data, length);
+	/* FLASH_Write() drains the queue first and is done with the copy on return */
+	if (error == FLASHIF_OK) error = FLASH_Write(address + length, quadword, sizeof(quadword));
+	if (error == FLASHIF_OK) stream.written += sizeof(quadword);
+	return error;
+}
+
+/**
+ * @brief  Settle the page being compared.
+ * @note   A page that matched is skipped, unless older data follows the
+ *         end of the image in it.
+ * @retval FLASHIF_OK or the erase/write error
+ */
+static uint32_t Stream_ComparePage(void) {
+	if ((stream.page == 0U) || !stream.matching) return FLASHIF_OK;
+	if (!Flash_Is_Erased(stream.written, (stream.page + FLASH_PAGE_SIZE) - stream.written)) return Stream_Rewrite();
+	stream.matching = 0;
+	stream.stats.pages_skipped++;
+	return FLASHIF_OK;
+}
+
+/**
+ * @brief  Erase the page being compared, keeping what matched so far.
+ * @retval FLASHIF_OK or the erase/write error
+ */
+static uint32_t Stream_Rewrite(void) {
+	uint32_t length = stream.written - stream.page, error;
+	memcpy(decoder.page, (const void *)stream.page, length);
+	stream.matching = 0;
+	stream.stats.pages_written++;
+	error = FLASH_PagesErase(stream.bank, (stream.page - stream.start) / FLASH_PAGE_SIZE, 1U);
+	if ((error == FLASHIF_OK) && (length != 0U)) error = FLASH_Write(stream.page, decoder.page, length);
+	return error;
+}
+
+/**
+ * @brief  Erase the pages after the image that still hold older data.
+ * @note   Blank pages are left alone, a short image wears only its pages.
+ * @retval FLASHIF_OK or FLASHIF_ERASEKO
+ */
+static uint32_t Stream_Trim(void) {
+	uint32_t error = FLASHIF_OK;
+	for (; (stream.erased < stream.end) && (error == FLASHIF_OK); stream.erased += FLASH_PAGE_SIZE) {
+		if (!Flash_Is_Erased(stream.erased, FLASH_PAGE_SIZE)) error = FLASH_PagesErase(stream.bank, (stream.erased - stream.start) / FLASH_PAGE_SIZE, 1U);
+	}
+	return error;
+}
+
+/**
+ * @brief  Gather a raw payload in the page being combined.
+ * @note   Payloads that follow each other in a page are copied to a RAM
+ *         buffer, queued whole to the flash engine once the page is full.
+ *         Another payload, out of order after a retransmit, sends what was
+ *         gathered first. The YMODEM padding after the end of the file is
+ *         dropped. The payload buffer is free on return.
+ * @param  address: flash destination
+ * @param  p_data: payload
+ * @param  length: payload length
+ * @retval FLASHIF_OK, or the erase/programming error of the buffer reused
+ */
+static uint32_t Stream_Combine(uint32_t address, const uint8_t *p_data, uint32_t length) {
+	uint32_t eof = stream.start + stream.input, room, error = FLASHIF_OK;
+	if (address >= eof) return FLASHIF_OK;
+	if (length > (eof - address)) length = eof - address;
+	if ((stream.fill != 0U) && (address != (stream.run + stream.fill))) error = Stream_Flush(stream.run + stream.fill);
+	while ((length != 0U) && (error == FLASHIF_OK)) {
+		if (stream.fill == 0U) {
+			/* The buffer must be done with its previous page */
+			error = FLASH_Queue_Wait(&aCombineOp[stream.buffer], FLASH_QUEUE_TIMEOUT);
+			if (error != FLASHIF_OK) break;
+			stream.run = address;
+		}
+		room = FLASH_PAGE_SIZE - ((stream.run - stream.start) % FLASH_PAGE_SIZE) - stream.fill;
+		if (room > length) room = length;
+		memcpy(&aCombine[stream.buffer][stream.fill], p_data, room);
+		stream.fill += room;
+		address += room;
+		p_data += room;
+		length -= room;
+		if (((stream.run + stream.fill - stream.start) % FLASH_PAGE_SIZE) == 0U) error = Stream_Flush(stream.run + stream.fill);
+	}
+	return error;
+}
+
+/**
+ * @brief  Queue the data combined up to an address, switch buffers.
+ * @note   A short end is padded with 0xFF to a quadword, as erased.
+ * @param  end: end of the data to program, at most the end combined
+ * @retval FLASHIF_OK or the erase/programming error
+ */
+static uint32_t Stream_Flush(uint32_t end) {
+	FLASH_QueueOpTypeDef *p_op = &aCombineOp[stream.buffer];
+	uint8_t *p_buffer = aCombine[stream.buffer];
+	uint32_t length = end - stream.run, padded = (length + 15U) & ~15U, error;
+	stream.fill = 0;
+	if (length == 0U) return FLASHIF_OK;
+	memset(&p_buffer[length], 0xFF, padded - length);
+	error = Stream_Erase(stream.run + padded);
+	if (error == FLASHIF_OK) error = FLASH_Queue_Program(p_op, stream.run, p_buffer, padded);
+	if (error == FLASHIF_BUSY) {
+		FLASH_Queue_Wait(NULL, FLASH_QUEUE_TIMEOUT);
+		error = FLASH_Queue_Program(p_op, stream.run, p_buffer, padded);
+	}
+	stream.buffer = (stream.buffer + 1U) % COMBINE_BUFFERS;
+	return error;
+}
+
+/**
+ * @brief  Wait for the combined pages queued.
+ * @retval FLASHIF_OK or the first programming error
+ */
+static uint32_t Stream_CombineWait(void) {
+	uint32_t i, status, error = FLASHIF_OK;
+	for (i = 0; i < COMBINE_BUFFERS; i++) {
+		status = FLASH_Queue_Wait(&aCombineOp[i], FLASH_QUEUE_TIMEOUT);
+		if (error == FLASHIF_OK) error = status;
+	}
+	return error;
+}
+
+/**
+ * @brief  Program a packet payload, decoding it first if needed.
+ * @note   A raw payload is copied to the page being combined, or with
+ *         compare queued to the flash engine: p_op stays FLASHIF_BUSY
+ *         until it is programmed and the buffer is free. Other formats
+ *         are programmed before returning.
+ * @param  p_op: flash operation of the payload buffer
+ * @param  address: flash destination of a raw payload
+ * @param  p_data: payload
+ * @param  length: payload length
+ * @retval FLASHIF_OK, FLASHIF_BUSY when the flash engine queue is full,
+ *         or the erase/FLASH_Write() error
+ */
+static uint32_t Stream_Write(FLASH_QueueOpTypeDef *p_op, uint32_t address, const uint8_t *p_data, uint32_t length) {
+	uint32_t offset, page, count, index, error = FLASHIF_OK;
+	p_op->status = FLASHIF_OK;
+	if (stream.compare) return Stream_Compare(p_op, address, p_data, length);
+	if (stream.format == STREAM_RAW) return Stream_Combine(address, p_data, length);
+	if (stream.format == STREAM_PAGES) {
+		/* The file offset gives the page, frames may come in any order */
+		offset = address - stream.address;
+		if (offset >= stream.input) return FLASHIF_OK;
+		if (length > (stream.input - offset)) length = stream.input - offset;
+		while ((length != 0U) && (error == FLASHIF_OK)) {
+			/* index-th page sent */
+			for (page = 0, index = offset / FLASH_PAGE_SIZE; page < YMODEM_PAGES_MAX; page++) {
+				if (((stream.send & (1U << page)) != 0U) && (index-- == 0U)) break;
+			}
+			count = FLASH_PAGE_SIZE - (offset % FLASH_PAGE_SIZE);
+			if (count > length) count = length;
+			error = Stream_CopyPages(page);
+			if (error == FLASHIF_OK) error = FLASH_Write(stream.address + (page * FLASH_PAGE_SIZE) + (offset % FLASH_PAGE_SIZE), p_data, count);
+			offset += count;
+			p_data += count;
+			length -= count;
+		}
+		return error;
+	}
+	if (length > stream.input) length = stream.input;
+	stream.input -= length;
+	if (stream.format == STREAM_DELTA) return DELTA_Patch(&decoder.delta, p_data, length, Stream_Output);
+	return LZSS_Decode(&decoder.lzss, p_data, length, Stream_Output);
+}
+
+/**
+ * @brief  Program decoded data, in quadword-aligned chunks.
+ * @param  p_data: decoded data
+ * @param  length: data length, a multiple of 16 bytes
+ * @retval FLASHIF_OK or the FLASH_Write() error
+ */
+static uint32_t Stream_Output(const uint8_t *p_data, uint32_t length) {
+	uint32_t error;
+	if ((stream.address + length) > stream.end) return FLASHIF_WRITINGCTRL_ERROR;
+	error = Stream_Erase(stream.address + length);
+	if (error == FLASHIF_OK) error = FLASH_Write(stream.address, p_data, length);
+	stream.address += length;
+	return error;
+}
+
+/**
+ * @brief  Program the end of the image, check its size and the flash.
+ * @note   The flash is checked once, against the digests of the flash
+ *         session (see FLASH_Session_Verify()).
+ * @retval FLASHIF_OK, the FLASH_Write() or erase error, or
+ *         FLASHIF_WRITING_ERROR when the image does not have the announced
+ *         size or the flash does not hold what was programmed
+ */
+static uint32_t Stream_Finish(void) {
+	uint32_t error, total;
+	ICACHE_Monitor_Phase(ICACHE_PHASE_VERIFY);
+	if (stream.format == STREAM_RAW) {
+		error = Stream_ComparePage();
+		stream.page = 0;
+		if (error == FLASHIF_OK) error = Stream_Flush(stream.run + stream.fill);
+		if (error == FLASHIF_OK) error = Stream_CombineWait();
+		if (error == FLASHIF_OK) error = Stream_Trim();
+	} else if (stream.format == STREAM_PAGES) {
+		error = Stream_CopyPages(YMODEM_PAGES_MAX);
+	} else {
+		if (stream.format == STREAM_DELTA) {
+			error = DELTA_Finish(&decoder.delta, Stream_Output);
+			total = decoder.delta.total;
+		} else {
+			error = LZSS_Finish(&decoder.lzss, Stream_Output);
+			total = decoder.lzss.total;
+		}
+		if ((error == FLASHIF_OK) && ((total != stream.size) || (stream.input != 0U))) error = FLASHIF_WRITING_ERROR;
+		if (error == FLASHIF_OK) error = Stream_Trim();
+	}
+	return (error == FLASHIF_OK) ? FLASH_Session_Verify() : error;
+}
+
+/**
+ * @brief  Prepare the checkpoints of a download, resume it if possible.
+ * @note   A download resumes when the last checkpoint of the bank is for
+ *         the same file (name, size and hash) and the flash still holds
+ *         the data it covers. Otherwise the bank is erased.
+ * @param  bank: Flash bank receiving the image
+ * @param  size: file size
+ * @param  hash: file CRC-32 announced by the sender
+ * @retval file offset to resume from, 0 for a new download
+ */
+static uint32_t Checkpoint_Start(uint32_t bank, uint32_t size, uint32_t hash) {
+	FLASH_CheckpointTypeDef *p_record = &checkpoint.record;
+	uint32_t name = Crc32_Update(0, aFileName, strlen((char *)aFileName));
+	checkpoint.bank = bank;
+	checkpoint.start = Flash_Get_BankAddress(bank);
+	checkpoint.active = 1;
+	if ((FLASH_CheckpointRead(bank, p_record) == FLASHIF_OK) && (p_record->name == name) && (p_record->size == size) &&
+			(p_record->hash == hash) && (p_record->offset < size) && ((p_record->offset % FLASH_PAGE_SIZE) == 0U) &&
+			(Checkpoint_Digest(checkpoint.start, p_record->offset) == p_record->digest)) {
+		/* Keep the pages already programmed, the next ones are erased as written */
+		return p_record->offset;
+	}
+	/* New download, drop the old checkpoints */
+	FLASH_CheckpointClear(bank);
+	p_record->name = name;
+	p_record->size = size;
+	p_record->hash = hash;
+	p_record->offset = 0;
+	p_record->digest = 0;
+	return 0;
+}
+
+/**
+ * @brief  Compute the checkpoint digest of the image start from the flash.
+ * @param  start: first address of the image
+ * @param  offset: bytes covered, page aligned
+ * @retval CRC-32 of the page CRC-32s
+ */
+static uint32_t Checkpoint_Digest(uint32_t start, uint32_t offset) {
+	uint32_t address, page, digest = 0;
+	for (address = start; address < (start + offset); address += FLASH_PAGE_SIZE) {
+		page = Crc32_Update(0, (const uint8_t *)address, FLASH_PAGE_SIZE);
+		digest = Crc32_Update(digest, (const uint8_t *)&page, sizeof(page));
+	}
+	return digest;
+}
+
+/**
+ * @brief  Record the progress of a download at every new page.
+ * @note   The page digests come from the session, computed from the payloads
+ *         when they were queued: the flash is not read and the queue keeps
+ *         running. A page counts once its programming is done, and the record
+ *         is queued after the previous one. A page written out of order, after
+ *         a retransmit, or left as it was by a compare has no digest: the
+ *         checkpoints stop before it. None with FLASH_SESSION_VERIFY at 0.
+ * @param  end_address: end of the data programmed without hole
+ * @retval None
+ */
+static void Checkpoint_Update(uint32_t end_address) {
+	FLASH_CheckpointTypeDef *p_record = &checkpoint.written;
+	uint32_t page;
+	if (!checkpoint.active || (checkpoint.op.status == FLASHIF_BUSY)) return;
+	*p_record = checkpoint.record;
+	while (((p_record->offset + FLASH_PAGE_SIZE) <= (end_address - checkpoint.start)) &&
+			(FLASH_Session_Digest(checkpoint.start + p_record->offset, &page) == FLASHIF_OK)) {
+		p_record->digest = Crc32_Update(p_record->digest, (const uint8_t *)&page, sizeof(page));
+		p_record->offset += FLASH_PAGE_SIZE;
+	}
+	if (p_record->offset == checkpoint.record.offset) return;
+	/* A lost checkpoint only costs a longer retry */
+	if (FLASH_CheckpointWrite(checkpoint.bank, p_record, &checkpoint.op) == FLASHIF_OK) checkpoint.record = *p_record;
+}
+
+/**
+ * @brief  The download is complete, nothing left to resume.
+ * @retval None
+ */
+static void Checkpoint_Done(void) {
+	if (!checkpoint.active) return;
+	FLASH_CheckpointClear(checkpoint.bank);
+	checkpoint.active = 0;
+}
+
+/**
+ * @brief  Send a windowed acknowledgement.
+ * @param  control: ACK (cumulative) or NAK (selective retransmit)
+ * @param  blk_number: block number
  * @retval None
  */
-uint16_t Cal_CRC16(const uint8_t* p_data, uint32_t size) {
-	uint32_t crc = 0;
-	const uint8_t* dataEnd = p_data + size;
-	while(p_data < dataEnd) crc = UpdateCRC16(crc, *p_data++);
-	crc = UpdateCRC16(crc, 0);
-	crc = UpdateCRC16(crc, 0);
-	return crc&0xffffu;
+static void SendWindowControl(uint8_t control, uint32_t blk_number) {
+	uint8_t acontrol[PACKET_CONTROL_SIZE];
+	if (control == NAK) stream.stats.naks++; else Ack_Latency();
+	TRACE((control == NAK) ? TRACE_EV_NAK : TRACE_EV_ACK, blk_number, 0);
+	acontrol[0] = control;
+	acontrol[1] = (uint8_t)blk_number;
+	acontrol[2] = (uint8_t)(~blk_number);
+	uart_write_string(acontrol, PACKET_CONTROL_SIZE);
+}
+
+/**
+ * @brief  Windowed data phase: several frames in flight, selective retransmit.
+ * @note   The flash address of a frame follows from its block number, so
+ *         frames are programmed in the order they arrive. Returns after the
+ *         EOT acknowledgement, the caller asks for the next file header.
+ * @param  address: flash address of block 1
+ * @param  p_end: end of the data programmed
+ * @param  window: frames in flight, at most YMODEM_WINDOW_MAX
+ * @param  frame: negotiated frame size
+ * @param  p_slot: packet buffer rotation, shared with the caller
+ * @retval COM_StatusTypeDef result of reception/programming
+ */
+static COM_StatusTypeDef ReceiveWindow(uint32_t address, uint32_t *p_end, uint32_t window, uint32_t frame, uint32_t *p_slot) {
+	uint32_t base = 1, received = 0, asked = 0, offset, length, bit, errors = 0, timeout, destination;
+	uint8_t *p_packet;
+	COM_StatusTypeDef result = COM_OK;
+	while (result == COM_OK) {
+		Pipeline_Wait(*p_slot);
+		Handling_Done();
+		p_packet = aPacketData[*p_slot];
+		/* Nothing yet at a negotiated rate: the first frame is the probe */
+		timeout = ((base == 1U) && (received == 0U) && (uart_get_baud() != UART_BAUD_DEFAULT)) ? YMODEM_BAUD_PROBE_TIMEOUT : DOWNLOAD_TIMEOUT;
+		switch (ReceivePacket(p_packet, &length, timeout)) {
+		case HAL_OK:
+			errors = 0;
+			if (length == 2) {
+				/* Abort by sender */
+				uart_write_byte(ACK);
+				result = COM_ABORT;
+			} else if (length == 0) {
+				/* End of transmission, once the window is drained */
+				if (received != 0U) {
+					SendWindowControl(NAK, base);
+				} else if ((Pipeline_Commit() == FLASHIF_OK) && (Stream_Finish() == FLASHIF_OK)) {
+					Checkpoint_Done();
+					uart_write_byte(ACK);
+					return COM_OK;
+				} else {
+					uart_write_byte(CA);
+					uart_write_byte(CA);
+					result = COM_DATA;
+				}
+			} else {
+				offset = (uint8_t)(p_packet[PACKET_NUMBER_INDEX] - (uint8_t)base);
+				if ((offset < window) && ((received & (1U << offset)) == 0U) && (length <= frame)) {
+					destination = address + ((base + offset - 1U) * frame);
+					Pipeline_Queue(*p_slot, destination, length);
+					*p_slot = (*p_slot + 1U) % PACKET_BUFFERS;
+					Pipeline_Process();
+					if (pipeline_error != FLASHIF_OK) {
+						TRACE(TRACE_EV_ERROR, 0, pipeline_error);
+						uart_write_byte(CA);
+						uart_write_byte(CA);
+						result = COM_DATA;
+						break;
+					}
+					received |= 1U << offset;
+					asked &= ~(1U << offset);
+					if ((destination + length) > *p_end) *p_end = destination + length;
+					/* Slide over the frames now in order */
+					while ((received & 1U) != 0U) {
+						received >>= 1;
+						asked >>= 1;
+						base++;
+					}
+					Checkpoint_Update(address + ((base - 1U) * frame));
+					/* Ask once for every hole below the newest frame */
+					for (bit = 0; (received >> bit) != 0U; bit++) {
+						if (((received | asked) & (1U << bit)) == 0U) {
+							SendWindowControl(NAK, base + bit);
+							asked |= 1U << bit;
+						}
+					}
+				}
+				/* Cumulative acknowledgement, duplicates included */
+				SendWindowControl(ACK, base - 1U);
+			}
+			break;
+		case HAL_BUSY: /* Abort actually */
+			uart_write_byte(CA);
+			uart_write_byte(CA);
+			result = COM_ABORT;
+			break;
+		default:
+			TRACE(TRACE_EV_RETRY, errors + 1U, 0);
+			if (++errors > MAX_ERRORS) {
+				uart_write_byte(CA);
+				uart_write_byte(CA);
+				result = COM_ERROR;
+			} else {
+				if ((uart_get_baud() != UART_BAUD_DEFAULT) && (errors >= YMODEM_BAUD_FALLBACK)) {
+					/* Same rule as the stop-and-wait engine */
+					uart_set_baud(UART_BAUD_DEFAULT);
+					TRACE(TRACE_EV_BAUD, 0, UART_BAUD_DEFAULT);
+					errors = 0;
+				}
+				/* Lost or damaged frame: ask again from the first hole */
+				SendWindowControl(NAK, base);
+				asked |= 1U;
+			}
+			break;
+		}
+	}
+	return result;
 }
 
 /* Public functions ---------------------------------------------------------*/
 /**
  * @brief  Receive a file using the ymodem protocol with CRC16.
  * @param  p_size The size of the file.
+ * @param  bank Flash bank receiving the image.
+ * @param  options YMODEM_OPT_xxx flags:
+ *           YMODEM_OPT_STREAMING: ask for YMODEM-g. The sender streams without
+ *           waiting for ACKs and any error aborts the session. Falls back to
+ *           plain YMODEM if the sender does not answer the 'G' polls.
+ *           YMODEM_OPT_COMPARE: compare each page of a raw image with the
+ *           bank, the pages already holding the data are neither erased
+ *           nor programmed.
  * @retval COM_StatusTypeDef result of reception/programming
  */
-COM_StatusTypeDef Ymodem_Receive (uint32_t *p_size, uint32_t bank) {
+COM_StatusTypeDef Ymodem_Receive (uint32_t *p_size, uint32_t bank, uint32_t options) {
 	uint32_t i, packet_length, session_done = 0, file_done, errors = 0, session_begin = 0, packets_received = 0;
-	uint32_t flashdestination, ramsource, filesize;
-	uint8_t *file_ptr;
+	uint32_t flashdestination, filesize, slot = 0, polls = 0, frame = 0, baud = UART_BAUD_DEFAULT, baud_asked, probing = 0, window = 1, window_asked;
+	uint32_t ext_length, hash = 0, resume = 0, format, image_size = 0, send, copy, bits, pagehash;
+	uint8_t streaming = ((options & YMODEM_OPT_STREAMING) != 0) ? 1 : 0;
+	uint8_t *file_ptr, *p_packet, *p_ext;
 	uint8_t file_size[FILE_SIZE_LENGTH];
+	uint32_t tickstart = HAL_GetTick();
 	COM_StatusTypeDef result = COM_OK;
 	/* Check the parameters */
 	if(!IS_FLASH_BANK_EXCLUSIVE(bank)) return COM_ERROR;
+	/* Flash unlocked once for the whole transfer */
+	if (FLASH_Session_Begin(bank) != FLASHIF_OK) return COM_ERROR;
+	ICACHE_Monitor_Phase(ICACHE_PHASE_HEADER);
+	memset(&stream.stats, 0, sizeof(stream.stats));
+	uart_rx_stats_reset();
+	crc_cycles = 0;
+#if (TRACE_ENABLED != 0U)
+	/* The trace of the last reception only */
+	Trace_Clear();
+#endif
+	TRACE(TRACE_EV_SESSION, options, bank);
+	handling = 0;
 	/* Initialize flashdestination variable */
-	if(bank == FLASH_BANK_2){
-		flashdestination = FLASH_START_BANK2;
-	}else{
-		flashdestination = FLASH_START_BANK1;
-	}
+	flashdestination = Flash_Get_BankAddress(bank);
+	frame_limit = PACKET_1K_SIZE;
+	Pipeline_Reset();
 	/* Ymodem loop */
 	while ((session_done == 0) && (result == COM_OK)) {
 		packets_received = 0;
 		file_done = 0;
 		while ((file_done == 0) && (result == COM_OK)) {
-			switch (ReceivePacket(aPacketData, &packet_length, DOWNLOAD_TIMEOUT)) {
+			/* The buffer about to be filled must not wait for programming */
+			Pipeline_Wait(slot);
+			Handling_Done();
+			p_packet = aPacketData[slot];
+			switch (ReceivePacket(p_packet, &packet_length, probing ? YMODEM_BAUD_PROBE_TIMEOUT : DOWNLOAD_TIMEOUT)) {
 			case HAL_OK:
 				errors = 0;
 				switch (packet_length) {
@@ -189,21 +1280,39 @@ COM_StatusTypeDef Ymodem_Receive (uint32_t *p_size, uint32_t bank) {
 					result = COM_ABORT;
 					break;
 				case 0:
-					/* End of transmission */
-					uart_write_byte(ACK);
-					file_done = 1;
+					/* End of transmission: every acknowledged packet must be in flash */
+					if ((Pipeline_Commit() == FLASHIF_OK) && (Stream_Finish() == FLASHIF_OK)) {
+						Checkpoint_Done();
+						uart_write_byte(ACK);
+						/* Ask for the next file header */
+						uart_write_byte(streaming ? CRC_G : CRC16);
+						file_done = 1;
+					} else {
+						uart_write_byte(CA);
+						uart_write_byte(CA);
+						result = COM_DATA;
+					}
 					break;
 				default:
 					/* Normal packet */
-					if (aPacketData[PACKET_NUMBER_INDEX] != (0xFFU & packets_received)) {
-						uart_write_byte(NAK);
+					if (p_packet[PACKET_NUMBER_INDEX] != (0xFFU & packets_received)) {
+						if (streaming && (packets_received > 0)) {
+							/* No retransmission in YMODEM-g: a lost packet ends the session */
+							uart_write_byte(CA);
+							uart_write_byte(CA);
+							result = COM_ERROR;
+						} else {
+							stream.stats.naks++;
+							TRACE(TRACE_EV_NAK, packets_received, 0);
+							uart_write_byte(NAK);
+						}
 					} else {
 						if (packets_received == 0) {
 							/* File name packet */
-							if (aPacketData[PACKET_DATA_INDEX] != 0) {
+							if (p_packet[PACKET_DATA_INDEX] != 0) {
 								/* File name extraction */
 								i = 0;
-								file_ptr = aPacketData + PACKET_DATA_INDEX;
+								file_ptr = p_packet + PACKET_DATA_INDEX;
 								while ( (*file_ptr != 0) && (i < FILE_NAME_LENGTH)) {
 									aFileName[i++] = *file_ptr++;
 								}
@@ -216,19 +1325,119 @@ COM_StatusTypeDef Ymodem_Receive (uint32_t *p_size, uint32_t bank) {
 								}
 								file_size[i++] = '\0';
 								filesize = atoi((char *) &file_size);
+								/* Session extensions follow the file size */
+								p_ext = file_ptr;
+								ext_length = packet_length - (uint32_t)(file_ptr - (p_packet + PACKET_DATA_INDEX));
+								/* Frames above 1K only for a sender asking for them */
+								frame = 0;
+								if (GetExtension(p_ext, ext_length, YMODEM_KEY_BLOCK, &frame)) {
+									frame_limit = (frame >= PACKET_8K_SIZE) ? PACKET_8K_SIZE : ((frame >= PACKET_4K_SIZE) ? PACKET_4K_SIZE : PACKET_1K_SIZE);
+								}
+								/* Windowed engine for a sender asking for it, never with YMODEM-g */
+								window = 1;
+								window_asked = GetExtension(p_ext, ext_length, YMODEM_KEY_WINDOW, &window);
+								/* Frames in flight must fit in the RX ring while one is programmed */
+								i = UART_RX_RING_SIZE / (frame_limit + PACKET_OVERHEAD_SIZE + PACKET_START_INDEX);
+								if (i > YMODEM_WINDOW_MAX) i = YMODEM_WINDOW_MAX;
+								if (streaming || (window == 0U)) window = 1;
+								if (window > i) window = i;
+								/* Faster line for a sender asking for it */
+								baud_asked = GetExtension(p_ext, ext_length, YMODEM_KEY_BAUD, &baud);
+								if (baud_asked) {
+									baud = BaudSelect((streaming && (baud > YMODEM_BAUD_STREAMING_MAX)) ? YMODEM_BAUD_STREAMING_MAX : baud);
+								} else {
+									baud = UART_BAUD_DEFAULT;
+								}
+								/* A compressed file or a patch announces the size of the image */
+								if (GetExtension(p_ext, ext_length, YMODEM_KEY_LZSS, &image_size)) {
+									format = STREAM_LZSS;
+								} else if (GetExtension(p_ext, ext_length, YMODEM_KEY_DELTA, &image_size)) {
+									format = STREAM_DELTA;
+								} else if (GetExtension(p_ext, ext_length, YMODEM_KEY_PAGES, &image_size)) {
+									format = STREAM_PAGES;
+								} else {
+									format = STREAM_RAW;
+									image_size = filesize;
+								}
+								/* Compressed data and patches are decoded in order, from the start */
+								if ((format == STREAM_LZSS) || (format == STREAM_DELTA)) window = 1;
+								/* So are the pages compared */
+								if ((format == STREAM_RAW) && ((options & YMODEM_OPT_COMPARE) != 0U)) window = 1;
 								/* Test the size of the image to be sent */
 								/* Image size is greater than Flash size */
-								if (*p_size > FLASH_BANK_SIZE) {
+								if (image_size > FLASH_IMAGE_SIZE) {
 									/* End session */
 									uart_write_byte(CA);
 									uart_write_byte(CA);
 									result = COM_LIMIT;
+									break;
+								}
+								/* A patch applies only to the image it was made against */
+								if ((format == STREAM_DELTA) && (!GetExtension(p_ext, ext_length, YMODEM_KEY_BASE, &hash) || (Stream_Base(bank, hash) != FLASHIF_OK))) {
+									/* End session */
+									uart_write_byte(CA);
+									uart_write_byte(CA);
+									result = COM_BASE;
+									break;
+								}
+								/* Prepare the bank */
+								resume = 0;
+								checkpoint.active = 0;
+								pagehash = GetExtension(p_ext, ext_length, YMODEM_KEY_PAGEHASH, &i) && (filesize == 0U);
+								if (pagehash) {
+									/* Page hash request: the bank stays as it is, nothing to program */
+									format = STREAM_PAGES;
+									stream.send = 0;
+									stream.copy = 0;
+								} else if (format == STREAM_PAGES) {
+									/* Only whole changed pages in the file, the kept ones stay */
+									send = 0;
+									copy = 0;
+									GetExtension(p_ext, ext_length, YMODEM_KEY_SEND, &send);
+									GetExtension(p_ext, ext_length, YMODEM_KEY_COPY, &copy);
+									for (i = 0, bits = send; bits != 0U; bits &= bits - 1U) i++;
+									if ((filesize != (i * FLASH_PAGE_SIZE)) || (Stream_Pages(bank, image_size, send, copy) != FLASHIF_OK)) {
+										/* End session */
+										uart_write_byte(CA);
+										uart_write_byte(CA);
+										result = COM_DATA;
+										break;
+									}
+								} else if ((format == STREAM_RAW) && GetExtension(p_ext, ext_length, YMODEM_KEY_HASH, &hash)) {
+									/* A file with a hash can resume an interrupted download */
+									resume = Checkpoint_Start(bank, filesize, hash);
+								}
+								/* The pages are erased as the data reaches them */
+								flashdestination = Flash_Get_BankAddress(bank) + resume;
+								Stream_Start(format, bank, flashdestination, filesize, image_size, ((options & YMODEM_OPT_COMPARE) != 0U) ? 1U : 0U);
+								*p_size = image_size;
+								if (!streaming) uart_write_byte(ACK);
+								if (frame != 0) SendExtension(YMODEM_KEY_BLOCK, frame_limit);
+								if (window_asked) SendExtension(YMODEM_KEY_WINDOW, window);
+								if (checkpoint.active) SendExtension(YMODEM_KEY_RESUME, resume);
+								if (pagehash) SendPageHashes(bank);
+								if (baud_asked) SendExtension(YMODEM_KEY_BAUD, baud);
+								probing = 0;
+								if (baud != UART_BAUD_DEFAULT) {
+									/* Switch, give the sender time to follow, then probe with the poll */
+									uart_set_baud(baud);
+									TRACE(TRACE_EV_BAUD, 0, baud);
+									HAL_Delay(YMODEM_BAUD_SWITCH_DELAY);
+									probing = 1;
+								}
+								/* YMODEM-g: a new 'G' starts the data stream */
+								uart_write_byte(streaming ? CRC_G : CRC16);
+								if (window > 1U) {
+									/* Data phase in the windowed engine, back here after EOT */
+									result = ReceiveWindow(flashdestination, &flashdestination, window, frame_limit, &slot);
+									baud = uart_get_baud();
+									probing = 0;
+									if (result == COM_OK) {
+										/* Ask for the next file header */
+										uart_write_byte(CRC16);
+										file_done = 1;
+									}
 								}
-								/* erase user application area */
-								FLASH_BankErase(bank);
-								*p_size = filesize;
-								uart_write_byte(ACK);
-								uart_write_byte(CRC16);
 							} else { /* File header packet is empty, end session */
 								uart_write_byte(ACK);
 								file_done = 1;
@@ -236,16 +1445,26 @@ COM_StatusTypeDef Ymodem_Receive (uint32_t *p_size, uint32_t bank) {
 								break;
 							}
 						} else { /* Data packet */
-							ramsource = (uint32_t) & aPacketData[PACKET_DATA_INDEX];
-							/* Write received data in Flash */
-							if (FLASH_Write(flashdestination, (uint32_t*) ramsource, packet_length) == FLASHIF_OK) {
-								flashdestination += packet_length;
+							/* CRC passed: release the sender before programming */
+							if (!streaming) {
+								Ack_Latency();
+								TRACE(TRACE_EV_ACK, p_packet[PACKET_NUMBER_INDEX], 0);
 								uart_write_byte(ACK);
-							} else { /* An error occurred while writing to Flash memory */
+							}
+							probing = 0;
+							Pipeline_Queue(slot, flashdestination, packet_length);
+							flashdestination += packet_length;
+							slot = (slot + 1) % PACKET_BUFFERS;
+							/* Program while the next packet is on the wire */
+							Pipeline_Process();
+							if (pipeline_error != FLASHIF_OK) { /* An error occurred while writing to Flash memory */
+								TRACE(TRACE_EV_ERROR, 0, pipeline_error);
 								/* End session */
 								uart_write_byte(CA);
 								uart_write_byte(CA);
 								result = COM_DATA;
+							} else {
+								Checkpoint_Update(flashdestination);
 							}
 						}
 						packets_received ++;
@@ -261,19 +1480,228 @@ COM_StatusTypeDef Ymodem_Receive (uint32_t *p_size, uint32_t bank) {
 					break;
 				default:
 					if (session_begin > 0) {
+						/* The poll below asks for the packet again */
+						stream.stats.naks++;
 						errors ++;
+						TRACE(TRACE_EV_RETRY, errors, 0);
+					} else if (streaming && (++polls > YMODEM_G_POLLS)) {
+						/* The sender ignores 'G': fall back to YMODEM */
+						streaming = 0;
 					}
-					if (errors > MAX_ERRORS) {
+					if ((baud != UART_BAUD_DEFAULT) && (errors >= YMODEM_BAUD_FALLBACK) && (probing || !streaming)) {
+						/* The negotiated rate does not hold: the sender falls back too */
+						uart_set_baud(UART_BAUD_DEFAULT);
+						TRACE(TRACE_EV_BAUD, 0, UART_BAUD_DEFAULT);
+						baud = UART_BAUD_DEFAULT;
+						probing = 0;
+						errors = 0;
+						uart_write_byte(streaming ? CRC_G : CRC16);
+					} else if ((errors > MAX_ERRORS) || (streaming && (packets_received > 0) && !probing)) {
 						/* Abort communication */
 						uart_write_byte(CA);
 						uart_write_byte(CA);
+						result = COM_ERROR;
 					} else {
-						uart_write_byte(CRC16); /* Ask for a packet */
+						uart_write_byte(streaming ? CRC_G : CRC16); /* Ask for a packet */
 					}
 					break;
 			}
 		}
 	}
+	if (result != COM_OK) Pipeline_Reset();
+	stream.format = STREAM_RAW;
+	frame_limit = PACKET_1K_SIZE;
+	checkpoint.active = 0;
+	FLASH_Session_End();
+	Stats_Finish(result, tickstart);
+	TRACE(TRACE_EV_END, 0, result);
+	ICACHE_Monitor_Phase(ICACHE_PHASE_MENU);
+	/* Back to the console rate */
+	uart_set_baud(UART_BAUD_DEFAULT);
+	return result;
+}
+
+/**
+ * @brief  Statistics record of the last reception.
+ * @param  p_stats: receives the counters and times
+ * @retval None
+ */
+void Ymodem_GetStats(YMODEM_StatsTypeDef *p_stats) {
+	*p_stats = stream.stats;
+}
+
+/**
+ * @brief  Transmit a file using the ymodem protocol with CRC16.
+ * @note   The data blocks are sent from p_buf without copy: the DMA reads the
+ *         source while the CPU computes the block CRC over the same bytes.
+ * @param  p_buf: Address of the first byte (a flash bank for a backup)
+ * @param  p_file_name: Name of the file sent
+ * @param  file_size: Size of the transmission
+ * @retval COM_StatusTypeDef result of the communication
+ */
+COM_StatusTypeDef Ymodem_Transmit(uint8_t *p_buf, const uint8_t *p_file_name, uint32_t file_size) {
+	uint32_t errors = 0, ack_recpt = 0, size = 0, pkt_size, crc = 0, i, value, baud = UART_BAUD_DEFAULT;
+	uint8_t *p_buf_int;
+	uint8_t aline[YMODEM_EXT_LENGTH];
+	COM_StatusTypeDef result = COM_OK;
+	uint32_t blk_number = 1;
+	uint8_t a_rx_ctrl;
+	HAL_StatusTypeDef status;
+
+	/* Wait for the receiver to ask for a CRC16 session */
+	while ((!ack_recpt) && (result == COM_OK)) {
+		status = WaitControl(&a_rx_ctrl, DOWNLOAD_TIMEOUT);
+		if ((status == HAL_BUSY) || ((status == HAL_OK) && ((a_rx_ctrl == ABORT1) || (a_rx_ctrl == ABORT2)))) {
+			result = COM_ABORT;
+		} else if ((status == HAL_OK) && (a_rx_ctrl == CRC16)) {
+			ack_recpt = 1;
+		} else if (++errors > MAX_ERRORS) {
+			result = COM_ERROR;
+		}
+	}
+
+	/* Send the file header: block 0 with the name and the size */
+	PrepareIntialPacket(aPacketData[0], p_file_name, file_size);
+	crc = Crc16_Calc(&aPacketData[0][PACKET_DATA_INDEX], PACKET_SIZE);
+	aPacketData[0][PACKET_SIZE + PACKET_DATA_INDEX] = (uint8_t)(crc >> 8);
+	aPacketData[0][PACKET_SIZE + PACKET_DATA_INDEX + 1] = (uint8_t)(crc & 0xFF);
+	ack_recpt = 0;
+	errors = 0;
+	while ((!ack_recpt) && (result == COM_OK)) {
+		uart_rx_flush();
+		uart_write_dma(&aPacketData[0][PACKET_START_INDEX], PACKET_SIZE + PACKET_HEADER_SIZE + PACKET_TRAILER_SIZE);
+		uart_tx_wait(PACKET_TX_TIMEOUT);
+		status = WaitControl(&a_rx_ctrl, DOWNLOAD_TIMEOUT);
+		if (status == HAL_BUSY) {
+			result = COM_ABORT;
+		} else if ((status == HAL_OK) && (a_rx_ctrl == ACK)) {
+			ack_recpt = 1;
+		} else if (++errors > MAX_ERRORS) {
+			result = COM_ERROR;
+		}
+	}
+	/* The receiver asks for the data with a new 'C', after the extensions it accepted */
+	frame_limit = PACKET_1K_SIZE;
+	errors = 0;
+	while (result == COM_OK) {
+		status = WaitControl(&a_rx_ctrl, (baud != UART_BAUD_DEFAULT) ? YMODEM_BAUD_PROBE_TIMEOUT : DOWNLOAD_TIMEOUT);
+		if (status == HAL_BUSY) {
+			result = COM_ABORT;
+		} else if ((status == HAL_OK) && (a_rx_ctrl == YMODEM_EXT_PREFIX)) {
+			aline[0] = a_rx_ctrl;
+			for (i = 1; (i < YMODEM_EXT_LENGTH - 1U) && (uart_read(&aline[i], 1, PACKET_PURGE_TIMEOUT) == HAL_OK) && (aline[i] != YMODEM_EXT_END); i++);
+			aline[i] = '\0';
+			if (GetExtension(aline, i, YMODEM_KEY_BLOCK, &value)) {
+				frame_limit = (value >= PACKET_8K_SIZE) ? PACKET_8K_SIZE : ((value >= PACKET_4K_SIZE) ? PACKET_4K_SIZE : PACKET_1K_SIZE);
+			}
+			if (GetExtension(aline, i, YMODEM_KEY_BAUD, &value) && (value != baud) && (uart_set_baud(value) == HAL_OK)) {
+				/* The receiver polls again at the new rate */
+				baud = value;
+			}
+		} else if ((status == HAL_OK) && (a_rx_ctrl == CRC16)) {
+			break;
+		} else if (baud != UART_BAUD_DEFAULT) {
+			/* Probe at the negotiated rate failed */
+			if (++errors >= YMODEM_BAUD_FALLBACK) {
+				uart_set_baud(UART_BAUD_DEFAULT);
+				baud = UART_BAUD_DEFAULT;
+			}
+		} else if (++errors > MAX_ERRORS) {
+			result = COM_ERROR;
+		} else if ((status == HAL_OK) && (a_rx_ctrl == NAK)) {
+			/* The header did not get through after all: send it again,
+			 * a timeout or another byte only waits for the 'C' again */
+			uart_rx_flush();
+			uart_write_dma(&aPacketData[0][PACKET_START_INDEX], PACKET_SIZE + PACKET_HEADER_SIZE + PACKET_TRAILER_SIZE);
+			uart_tx_wait(PACKET_TX_TIMEOUT);
+		}
+	}
+
+	/* Packets up to the negotiated frame size, 1K for stock receivers */
+	p_buf_int = p_buf;
+	size = file_size;
+	while ((size) && (result == COM_OK)) {
+		pkt_size = FrameSize(size, frame_limit);
+		ack_recpt = 0;
+		errors = 0;
+		while ((!ack_recpt) && (result == COM_OK)) {
+			uart_rx_flush();
+			if (SendDataPacket(p_buf_int, (uint8_t)blk_number, size, pkt_size) != HAL_OK) {
+				result = COM_ERROR;
+				break;
+			}
+			status = WaitControl(&a_rx_ctrl, DOWNLOAD_TIMEOUT);
+			if (status == HAL_BUSY) {
+				result = COM_ABORT;
+			} else if ((status == HAL_OK) && (a_rx_ctrl == ACK)) {
+				ack_recpt = 1;
+				if (size > pkt_size) {
+					p_buf_int += pkt_size;
+					size -= pkt_size;
+				} else {
+					size = 0;
+				}
+				blk_number++;
+			} else if (++errors > MAX_ERRORS) {
+				result = COM_ERROR;
+			} else if ((baud != UART_BAUD_DEFAULT) && (errors >= YMODEM_BAUD_FALLBACK)) {
+				/* Same rule as the receiver: back to the console rate */
+				uart_set_baud(UART_BAUD_DEFAULT);
+				baud = UART_BAUD_DEFAULT;
+				errors = 0;
+			}
+		}
+	}
+
+	/* Sending End Of Transmission char */
+	ack_recpt = 0;
+	errors = 0;
+	while ((!ack_recpt) && (result == COM_OK)) {
+		uart_rx_flush();
+		uart_write_byte(EOT);
+		status = WaitControl(&a_rx_ctrl, DOWNLOAD_TIMEOUT);
+		if (status == HAL_BUSY) {
+			result = COM_ABORT;
+		} else if ((status == HAL_OK) && (a_rx_ctrl == ACK)) {
+			ack_recpt = 1;
+		} else if (++errors > MAX_ERRORS) {
+			result = COM_ERROR;
+		}
+	}
+
+	/* Empty packet sent to some terminal emulators, which wait for it */
+	if (result == COM_OK) {
+		/* The receiver asks for the next file header: end the session */
+		WaitControl(&a_rx_ctrl, DOWNLOAD_TIMEOUT);
+		memset(&aPacketData[0][PACKET_START_INDEX], 0, PACKET_SIZE + PACKET_HEADER_SIZE + PACKET_TRAILER_SIZE);
+		aPacketData[0][PACKET_START_INDEX] = SOH;
+		aPacketData[0][PACKET_CNUMBER_INDEX] = 0xFF;
+		/* CRC16 of 128 zero bytes is zero */
+		ack_recpt = 0;
+		errors = 0;
+		while ((!ack_recpt) && (result == COM_OK)) {
+			uart_rx_flush();
+			uart_write_dma(&aPacketData[0][PACKET_START_INDEX], PACKET_SIZE + PACKET_HEADER_SIZE + PACKET_TRAILER_SIZE);
+			uart_tx_wait(PACKET_TX_TIMEOUT);
+			status = WaitControl(&a_rx_ctrl, DOWNLOAD_TIMEOUT);
+			if (status == HAL_BUSY) {
+				result = COM_ABORT;
+			} else if ((status == HAL_OK) && (a_rx_ctrl == ACK)) {
+				ack_recpt = 1;
+			} else if (++errors > MAX_ERRORS) {
+				result = COM_ERROR;
+			}
+		}
+	} else if (result == COM_ERROR) {
+		/* Tell the receiver the session is over */
+		uart_write_byte(CA);
+		uart_write_byte(CA);
+	}
+
+	uart_tx_wait(PACKET_TX_TIMEOUT);
+	frame_limit = PACKET_1K_SIZE;
+	/* Back to the console rate */
+	uart_set_baud(UART_BAUD_DEFAULT);
 	return result;
 }
 
@@ -0,0 +1,59 @@
+/**
+  ******************************************************************************
+  * @file    core_cm33.h
+  * @brief   Host build: the CMSIS core header with the ARM-only intrinsics
+  *          replaced by the simulation ones.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SIM_CORE_CM33_H__
+#define __SIM_CORE_CM33_H__
+
+/* The PRIMASK intrinsics are ARM instructions: the CMSIS ones get other
+ * names, they are never called, and the firmware gets the simulated ones. */
+#define __get_PRIMASK           __cmsis_get_PRIMASK
+#define __set_PRIMASK           __cmsis_set_PRIMASK
+#define __enable_irq            __cmsis_enable_irq
+#define __disable_irq           __cmsis_disable_irq
+
+/* __NVIC_SetVector() and __NVIC_GetVector() cast VTOR to a pointer */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
+#include_next "core_cm33.h"
+#pragma GCC diagnostic pop
+
+#undef __get_PRIMASK
+#undef __set_PRIMASK
+#undef __enable_irq
+#undef __disable_irq
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Exported functions ------------------------------------------------------- */
+uint32_t Sim_GetPrimask(void);
+void Sim_SetPrimask(uint32_t primask);
+
+/* Exported macro ------------------------------------------------------------*/
+#define __get_PRIMASK()         Sim_GetPrimask()
+#define __set_PRIMASK(primask)  Sim_SetPrimask(primask)
+#define __enable_irq()          Sim_SetPrimask(0U)
+#define __disable_irq()         Sim_SetPrimask(1U)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIM_CORE_CM33_H__ */
@@ -0,0 +1,126 @@
+/**
+  ******************************************************************************
+  * @file    sim.h
+  * @brief   This file contains the peripherals and the function prototypes
+  *          of the host simulation of the updater.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* The flash is a file mapped at its address, bank 1 then bank 2 in the
+ * file; the bank swap option byte is kept next to it, in <file>.ob.   */
+#define SIM_FLASH_SIZE          FLASH_SIZE_DEFAULT
+#define SIM_SYSCLK              4000000U   /* MSI range 4, see SystemClock_Config() */
+#define SIM_UART_CLOCK          16000000U  /* HSI, USART1 kernel clock */
+
+/* Flash timings, us, overridden from the command line. The defaults are
+ * in the range of the typical values of the STM32U5 datasheet.        */
+#define SIM_QUADWORD_US         118U
+#define SIM_BURST_US            580U
+#define SIM_PAGE_ERASE_US       1500U
+#define SIM_BANK_ERASE_US       3000U
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Simulation settings
+  */
+typedef struct
+{
+  const char *p_flash;      /* flash image file */
+  int fd;                   /* UART line, -1 for a pty */
+  uint32_t quadword_us;     /* flash timings */
+  uint32_t burst_us;
+  uint32_t page_erase_us;
+  uint32_t bank_erase_us;
+  uint32_t verbose;         /* log the flash operations on stderr */
+} SIM_ConfigTypeDef;
+
+/**
+  * @brief  Flash work done, for the log at exit
+  */
+typedef struct
+{
+  uint32_t quadwords;       /* programmed one by one */
+  uint32_t bursts;          /* programmed by 8 */
+  uint32_t pages;           /* erased */
+  uint32_t banks;           /* mass erased */
+  uint32_t errors;          /* operations refused */
+} SIM_FlashStatsTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern SIM_ConfigTypeDef sim_config;
+extern RCC_TypeDef sim_rcc;
+extern ICACHE_TypeDef sim_icache;
+extern CRC_TypeDef sim_crc;
+extern CoreDebug_Type sim_coredebug;
+extern MPU_Type sim_mpu;
+
+/* Exported macro ------------------------------------------------------------*/
+/* Peripherals the firmware reaches through registers: host structures.
+ * FLASH and DWT go through a function that brings them up to date.   */
+#undef FLASH
+#define FLASH                   (Sim_Flash())
+#undef DWT
+#define DWT                     (Sim_Dwt())
+#undef CoreDebug
+#define CoreDebug               (&sim_coredebug)
+#undef MPU
+#define MPU                     (&sim_mpu)
+#undef RCC
+#define RCC                     (&sim_rcc)
+#undef ICACHE
+#define ICACHE                  (&sim_icache)
+#undef CRC
+#define CRC                     (&sim_crc)
+/* The flash size register is not mapped */
+#undef FLASH_SIZE
+#define FLASH_SIZE              FLASH_SIZE_DEFAULT
+
+/* printf() of the firmware goes to the UART, as __io_putchar() does */
+#define printf                  Sim_Printf
+
+/* Exported functions ------------------------------------------------------- */
+/* sim_hal.c */
+uint64_t Sim_Time(void);
+void Sim_Sleep(uint64_t until);
+DWT_Type *Sim_Dwt(void);
+void Sim_Poll(void);
+uint32_t Sim_IrqEnabled(IRQn_Type irq);
+/* sim_flash.c */
+int Sim_FlashInit(const char *p_path);
+FLASH_TypeDef *Sim_Flash(void);
+void Sim_FlashPoll(void);
+uint32_t Sim_FlashPending(void);
+uint64_t Sim_FlashNextEvent(void);
+void Sim_FlashGetStats(SIM_FlashStatsTypeDef *p_stats);
+/* sim_uart.c */
+int Sim_UartInit(int fd);
+void Sim_UartPoll(void);
+int Sim_Printf(const char *p_format, ...);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIM_H__ */
@@ -0,0 +1,26 @@
+/**
+  ******************************************************************************
+  * @file    stm32u5xx_hal_conf.h
+  * @brief   Host build: the HAL configuration of the project, then the
+  *          simulated peripherals in place of the memory mapped ones.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SIM_HAL_CONF_H__
+#define __SIM_HAL_CONF_H__
+
+#include_next "stm32u5xx_hal_conf.h"
+#include "sim.h"
+
+#endif /* __SIM_HAL_CONF_H__ */
@@ -0,0 +1,596 @@
+/**
+  ******************************************************************************
+  * @file    sim_flash.c
+  * @brief   This file provides the flash of the host simulation: a 512 KB
+  *          file mapped at the flash address, the NSCR/NSSR registers, the
+  *          erase and program timings, the HAL FLASH services and the option
+  *          bytes.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* The flash is mapped read only. The register level loop of the firmware
+ * stores straight to it: the first store to a host page faults, the page
+ * is opened and the store goes through. The next register access closes
+ * the page and checks each quadword that changed, as the flash would: PG
+ * set, flash unlocked, quadword erased before. A refused quadword is put
+ * back and its error flag raised in NSSR. The accepted ones keep the flash
+ * busy (NSSR BSY) for their programming time.
+ * The HAL services (erase, program by interrupt) change the flash at once
+ * and keep it busy the same way; their interrupt comes when the time is
+ * over, from Sim_Poll().                                                */
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "flash.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_FLASH_OPEN_MAX      8U
+#define SIM_NSSR_MARK           0x80000000U  /* reserved bit, tells a write to NSSR */
+#define SIM_NSSR_ERRORS         (FLASH_FLAG_SR_ERRORS | FLASH_FLAG_OPTWERR)
+#define SIM_OP_NONE             0U
+#define SIM_OP_ERASE            1U
+#define SIM_OP_PROGRAM          2U
+
+/* Private variables ---------------------------------------------------------*/
+static FLASH_TypeDef flash_regs = { .NSCR = FLASH_NSCR_LOCK | FLASH_NSCR_OPTLOCK };
+static uint8_t aShadow[SIM_FLASH_SIZE];  /* flash content, as checked last */
+static uint32_t nssr_published;          /* NSSR as the firmware last read it */
+static uint32_t nssr_errors;
+static uint64_t busy_until;              /* Sim_Time() the flash is ready at */
+static uint32_t optr;                    /* option bytes loaded at start */
+static char ob_path[512];
+static long host_page;
+static SIM_FlashStatsTypeDef sim_flash_stats;
+
+/* Host pages opened by a store, with NSCR at the time */
+static struct
+{
+  uintptr_t address;
+  uint32_t cr;
+} aOpen[SIM_FLASH_OPEN_MAX];
+static volatile uint32_t open_count;
+
+/* Operation started by a HAL service, its interrupt to come */
+static struct
+{
+  uint32_t type;                         /* SIM_OP_xxx */
+  uint64_t due;                          /* Sim_Time() of the interrupt */
+  uint32_t param;                        /* page or address */
+  uint32_t pages;                        /* pages left to erase */
+  uint32_t error;                        /* NSSR error flags */
+} flash_op;
+
+/* Private function prototypes -----------------------------------------------*/
+static void Flash_Fault(int sig, siginfo_t *p_info, void *p_context);
+static void Flash_Settle(void);
+static void Flash_Publish(void);
+static void Flash_Store(uint32_t offset, const void *p_data, uint32_t size);
+static void Flash_Busy(uint32_t us);
+static void Flash_WaitReady(void);
+static uint32_t Flash_Offset(uint32_t bank, uint32_t page);
+static uint32_t Flash_Erase(const FLASH_EraseInitTypeDef *p_desc, uint32_t *p_us);
+static uint32_t Flash_Program(uint32_t type, uint32_t address, const uint8_t *p_data, uint32_t *p_us);
+static void Flash_SaveOptions(uint32_t value);
+
+/* Public functions ---------------------------------------------------------*/
+/**
+ * @brief  Map the flash image file, created erased if missing.
+ * @note   The SWAP_BANK option byte of <file>.ob picks the half of the file
+ *         mapped first, as the hardware does.
+ * @param  p_path: image file
+ * @retval 0, or -1 with a message on stderr
+ */
+int Sim_FlashInit(const char *p_path) {
+	struct sigaction action;
+	struct stat info;
+	uint32_t first;
+	FILE *p_file;
+	void *p_bank;
+	int fd;
+	host_page = sysconf(_SC_PAGESIZE);
+	fd = open(p_path, O_RDWR | O_CREAT, 0644);
+	if ((fd < 0) || (fstat(fd, &info) != 0)) {
+		perror(p_path);
+		return -1;
+	}
+	if (info.st_size < (off_t)SIM_FLASH_SIZE) {
+		/* New image: erased */
+		memset(aShadow, 0xFF, sizeof(aShadow));
+		if ((pwrite(fd, aShadow, SIM_FLASH_SIZE - info.st_size, info.st_size) != (ssize_t)(SIM_FLASH_SIZE - info.st_size))) {
+			perror(p_path);
+			return -1;
+		}
+	}
+	/* Option bytes */
+	optr = FLASH_OPTR_DUALBANK;
+	snprintf(ob_path, sizeof(ob_path), "%s.ob", p_path);
+	p_file = fopen(ob_path, "r");
+	if (p_file != NULL) {
+		if (fscanf(p_file, "SWAP_BANK=%u", &first) == 1) optr |= (first != 0U) ? FLASH_OPTR_SWAP_BANK : 0U;
+		fclose(p_file);
+	}
+	flash_regs.OPTR = optr;
+	/* Bank 1 of the memory map is bank 2 of the file once swapped */
+	first = ((optr & FLASH_OPTR_SWAP_BANK) != 0U) ? (SIM_FLASH_SIZE / 2U) : 0U;
+	p_bank = mmap((void *)FLASH_BASE_NS, SIM_FLASH_SIZE / 2U, PROT_READ, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, first);
+	if (p_bank == (void *)FLASH_BASE_NS) {
+		p_bank = mmap((void *)(FLASH_BASE_NS + (SIM_FLASH_SIZE / 2U)), SIM_FLASH_SIZE / 2U, PROT_READ,
+				MAP_SHARED | MAP_FIXED_NOREPLACE, fd, (SIM_FLASH_SIZE / 2U) - first);
+	}
+	if (p_bank != (void *)(FLASH_BASE_NS + ((p_bank == (void *)FLASH_BASE_NS) ? 0U : (SIM_FLASH_SIZE / 2U)))) {
+		fprintf(stderr, "sim: cannot map the flash at 0x%08lx\n", (unsigned long)FLASH_BASE_NS);
+		return -1;
+	}
+	close(fd);
+	memcpy(aShadow, (const void *)FLASH_BASE_NS, SIM_FLASH_SIZE);
+	/* Stores to the flash */
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = Flash_Fault;
+	action.sa_flags = SA_SIGINFO;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGSEGV, &action, NULL);
+	if (sim_config.verbose) {
+		fprintf(stderr, "sim: flash %s, bank %u at 0x%08lx\n", p_path, (first == 0U) ? 1U : 2U, (unsigned long)FLASH_BASE_NS);
+	}
+	return 0;
+}
+
+/**
+ * @brief  The FLASH registers, brought up to date.
+ * @note   Closes the pages stored to since the last access, publishes
+ *         NSSR, then delivers the interrupts due.
+ * @param  None
+ * @retval FLASH registers
+ */
+FLASH_TypeDef *Sim_Flash(void) {
+	Sim_FlashPoll();
+	Sim_Poll();
+	return &flash_regs;
+}
+
+/**
+ * @brief  Bring the flash state up to date, without interrupt.
+ * @param  None
+ * @retval None
+ */
+void Sim_FlashPoll(void) {
+	Flash_Settle();
+	Flash_Publish();
+}
+
+/**
+ * @brief  Tell whether the interrupt of a HAL service is due.
+ * @param  None
+ * @retval 1 when HAL_FLASH_IRQHandler() has something to report
+ */
+uint32_t Sim_FlashPending(void) {
+	return ((flash_op.type != SIM_OP_NONE) && (Sim_Time() >= flash_op.due)) ? 1U : 0U;
+}
+
+/**
+ * @brief  Time of the next flash interrupt, for the waiting loops.
+ * @param  None
+ * @retval Sim_Time(), UINT64_MAX when none is expected
+ */
+uint64_t Sim_FlashNextEvent(void) {
+	return (flash_op.type != SIM_OP_NONE) ? flash_op.due : UINT64_MAX;
+}
+
+/**
+ * @brief  Flash work done since the start.
+ * @param  p_stats: copy of the counters
+ * @retval None
+ */
+void Sim_FlashGetStats(SIM_FlashStatsTypeDef *p_stats) {
+	*p_stats = sim_flash_stats;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void) {
+	Sim_FlashPoll();
+	CLEAR_BIT(flash_regs.NSCR, FLASH_NSCR_LOCK);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void) {
+	Sim_FlashPoll();
+	SET_BIT(flash_regs.NSCR, FLASH_NSCR_LOCK);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_OB_Unlock(void) {
+	if (READ_BIT(flash_regs.NSCR, FLASH_NSCR_LOCK) != 0U) return HAL_ERROR;
+	CLEAR_BIT(flash_regs.NSCR, FLASH_NSCR_OPTLOCK);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_OB_Lock(void) {
+	SET_BIT(flash_regs.NSCR, FLASH_NSCR_OPTLOCK);
+	return HAL_OK;
+}
+
+/**
+ * @brief  Program a quadword or a burst, wait for the end.
+ * @param  TypeProgram: FLASH_TYPEPROGRAM_QUADWORD or FLASH_TYPEPROGRAM_BURST
+ * @param  Address: flash address
+ * @param  DataAddress: data, in the low 4 GB of the host
+ * @retval HAL status
+ */
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint32_t DataAddress) {
+	uint32_t us, error;
+	Flash_WaitReady();
+	error = Flash_Program(TypeProgram, Address, (const uint8_t *)(uintptr_t)DataAddress, &us);
+	if (error != 0U) return HAL_ERROR;
+	Flash_Busy(us);
+	Flash_WaitReady();
+	return HAL_OK;
+}
+
+/**
+ * @brief  Program a quadword or a burst, the interrupt tells the end.
+ * @param  TypeProgram: FLASH_TYPEPROGRAM_QUADWORD or FLASH_TYPEPROGRAM_BURST
+ * @param  Address: flash address
+ * @param  DataAddress: data, in the low 4 GB of the host
+ * @retval HAL_OK, HAL_BUSY while an operation runs, HAL_ERROR locked
+ */
+HAL_StatusTypeDef HAL_FLASH_Program_IT(uint32_t TypeProgram, uint32_t Address, uint32_t DataAddress) {
+	uint32_t us = 0;
+	Sim_FlashPoll();
+	if (flash_op.type != SIM_OP_NONE) return HAL_BUSY;
+	if (READ_BIT(flash_regs.NSCR, FLASH_NSCR_LOCK) != 0U) return HAL_ERROR;
+	flash_op.error = Flash_Program(TypeProgram, Address, (const uint8_t *)(uintptr_t)DataAddress, &us);
+	Flash_Busy(us);
+	flash_op.type = SIM_OP_PROGRAM;
+	flash_op.param = Address;
+	flash_op.due = busy_until;
+	return HAL_OK;
+}
+
+/**
+ * @brief  Erase pages or a bank, wait for the end.
+ * @param  pEraseInit: pages or bank
+ * @param  PageError: 0xFFFFFFFF, or the page that failed
+ * @retval HAL status
+ */
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *PageError) {
+	uint32_t us;
+	*PageError = 0xFFFFFFFFU;
+	Flash_WaitReady();
+	if (READ_BIT(flash_regs.NSCR, FLASH_NSCR_LOCK) != 0U) return HAL_ERROR;
+	if (Flash_Erase(pEraseInit, &us) != 0U) {
+		*PageError = pEraseInit->Page;
+		return HAL_ERROR;
+	}
+	Flash_Busy(us);
+	Flash_WaitReady();
+	return HAL_OK;
+}
+
+/**
+ * @brief  Erase pages, the interrupt tells the end of each one.
+ * @param  pEraseInit: pages
+ * @retval HAL_OK, HAL_BUSY while an operation runs, HAL_ERROR otherwise
+ */
+HAL_StatusTypeDef HAL_FLASHEx_Erase_IT(FLASH_EraseInitTypeDef *pEraseInit) {
+	uint32_t us;
+	Sim_FlashPoll();
+	if (flash_op.type != SIM_OP_NONE) return HAL_BUSY;
+	if ((READ_BIT(flash_regs.NSCR, FLASH_NSCR_LOCK) != 0U) || (pEraseInit->TypeErase != FLASH_TYPEERASE_PAGES)) return HAL_ERROR;
+	if (Flash_Erase(pEraseInit, &us) != 0U) return HAL_ERROR;
+	/* One interrupt per page, the pages one after the other */
+	if (busy_until < Sim_Time()) busy_until = Sim_Time();
+	flash_op.type = SIM_OP_ERASE;
+	flash_op.param = pEraseInit->Page;
+	flash_op.pages = pEraseInit->NbPages;
+	flash_op.error = 0;
+	flash_op.due = busy_until + ((uint64_t)sim_config.page_erase_us * 1000U);
+	Flash_Busy(us);
+	return HAL_OK;
+}
+
+/**
+ * @brief  Report the operation of a HAL service, when its time is over.
+ * @note   Same callbacks as the HAL: EndOfOperation with the page after
+ *         each page, 0xFFFFFFFF after the last one, the address after a
+ *         program; OperationError with the page or address.
+ * @param  None
+ * @retval None
+ */
+void HAL_FLASH_IRQHandler(void) {
+	uint32_t param;
+	if (!Sim_FlashPending()) return;
+	param = flash_op.param;
+	if (flash_op.error != 0U) {
+		flash_op.type = SIM_OP_NONE;
+		HAL_FLASH_OperationErrorCallback(param);
+		return;
+	}
+	if ((flash_op.type == SIM_OP_ERASE) && (--flash_op.pages != 0U)) {
+		flash_op.param++;
+		flash_op.due += (uint64_t)sim_config.page_erase_us * 1000U;
+	} else {
+		if (flash_op.type == SIM_OP_ERASE) param = 0xFFFFFFFFU;
+		flash_op.type = SIM_OP_NONE;
+	}
+	HAL_FLASH_EndOfOperationCallback(param);
+}
+
+/**
+ * @brief  Option bytes, as loaded at start.
+ * @param  pOBInit: USER configuration filled in
+ * @retval None
+ */
+void HAL_FLASHEx_OBGetConfig(FLASH_OBProgramInitTypeDef *pOBInit) {
+	pOBInit->OptionType = OPTIONBYTE_USER;
+	pOBInit->USERType = OB_USER_SWAP_BANK;
+	pOBInit->USERConfig = optr;
+}
+
+/**
+ * @brief  Program the option bytes: only SWAP_BANK is kept, in <file>.ob.
+ * @note   They apply at the next start, see HAL_FLASH_OB_Launch().
+ * @param  pOBInit: USER configuration
+ * @retval HAL_ERROR while the option bytes are locked
+ */
+HAL_StatusTypeDef HAL_FLASHEx_OBProgram(FLASH_OBProgramInitTypeDef *pOBInit) {
+	if (READ_BIT(flash_regs.NSCR, FLASH_NSCR_OPTLOCK) != 0U) return HAL_ERROR;
+	Flash_WaitReady();
+	if (((pOBInit->OptionType & OPTIONBYTE_USER) != 0U) && ((pOBInit->USERType & OB_USER_SWAP_BANK) != 0U)) {
+		Flash_SaveOptions(pOBInit->USERConfig & FLASH_OPTR_SWAP_BANK);
+	}
+	return HAL_OK;
+}
+
+/**
+ * @brief  Load the option bytes: the device resets, the simulation ends.
+ * @param  None
+ * @retval None, does not return
+ */
+HAL_StatusTypeDef HAL_FLASH_OB_Launch(void) {
+	if (READ_BIT(flash_regs.NSCR, FLASH_NSCR_OPTLOCK) != 0U) return HAL_ERROR;
+	fprintf(stderr, "sim: option bytes loaded, reset\n");
+	exit(0);
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+ * @brief  A store faulted: open the host page if it is flash.
+ * @note   Signal handler. Other faults get the default action.
+ * @param  sig: SIGSEGV
+ * @param  p_info: fault address
+ * @param  p_context: unused
+ * @retval None
+ */
+static void Flash_Fault(int sig, siginfo_t *p_info, void *p_context) {
+	uintptr_t address = (uintptr_t)p_info->si_addr;
+	(void)p_context;
+	if ((address < FLASH_BASE_NS) || (address >= (FLASH_BASE_NS + SIM_FLASH_SIZE)) || (open_count == SIM_FLASH_OPEN_MAX)) {
+		signal(sig, SIG_DFL);
+		return;
+	}
+	address &= ~((uintptr_t)host_page - 1U);
+	mprotect((void *)address, (size_t)host_page, PROT_READ | PROT_WRITE);
+	aOpen[open_count].address = address;
+	aOpen[open_count].cr = flash_regs.NSCR;
+	open_count++;
+}
+
+/**
+ * @brief  Close the opened pages and check the quadwords stored to them.
+ * @param  None
+ * @retval None
+ */
+static void Flash_Settle(void) {
+	uint32_t page, offset, end, quadword, bursts = 0, quadwords = 0, burst = UINT32_MAX, cr, error;
+	const uint8_t *p_flash = (const uint8_t *)FLASH_BASE_NS;
+	for (page = 0; page < open_count; page++) {
+		mprotect((void *)aOpen[page].address, (size_t)host_page, PROT_READ);
+		cr = aOpen[page].cr;
+		offset = (uint32_t)(aOpen[page].address - FLASH_BASE_NS);
+		end = offset + (uint32_t)host_page;
+		for (; offset < end; offset += FLASH_QUADWORD_SIZE) {
+			if (memcmp(&p_flash[offset], &aShadow[offset], FLASH_QUADWORD_SIZE) == 0) continue;
+			error = 0;
+			if ((cr & FLASH_NSCR_LOCK) != 0U) {
+				error = FLASH_FLAG_WRPERR;
+			} else if ((cr & FLASH_NSCR_PG) == 0U) {
+				error = FLASH_FLAG_PGSERR;
+			} else {
+				for (quadword = 0; quadword < FLASH_QUADWORD_SIZE; quadword++) {
+					if (aShadow[offset + quadword] != 0xFFU) error = FLASH_FLAG_PROGERR;
+				}
+			}
+			if (error != 0U) {
+				/* Refused: the flash keeps its content */
+				nssr_errors |= error;
+				sim_flash_stats.errors++;
+				Flash_Store(offset, &aShadow[offset], FLASH_QUADWORD_SIZE);
+				if (sim_config.verbose) fprintf(stderr, "sim: store to 0x%08lx refused, NSSR 0x%08lx\n",
+						(unsigned long)(FLASH_BASE_NS + offset), (unsigned long)error);
+				continue;
+			}
+			memcpy(&aShadow[offset], &p_flash[offset], FLASH_QUADWORD_SIZE);
+			if ((cr & FLASH_NSCR_BWR) != 0U) {
+				if ((offset / FLASH_BURST_SIZE) != burst) bursts++;
+				burst = offset / FLASH_BURST_SIZE;
+			} else {
+				quadwords++;
+			}
+		}
+	}
+	open_count = 0;
+	sim_flash_stats.quadwords += quadwords;
+	sim_flash_stats.bursts += bursts;
+	Flash_Busy((quadwords * sim_config.quadword_us) + (bursts * sim_config.burst_us));
+}
+
+/**
+ * @brief  Publish NSSR. Its error flags are cleared by writing 1.
+ * @note   The published value carries a reserved bit the firmware never
+ *         writes: NSSR differs from it once written.
+ * @param  None
+ * @retval None
+ */
+static void Flash_Publish(void) {
+	if (flash_regs.NSSR != nssr_published) nssr_errors &= ~flash_regs.NSSR;
+	nssr_published = SIM_NSSR_MARK | nssr_errors;
+	if (Sim_Time() < busy_until) nssr_published |= FLASH_FLAG_BSY;
+	flash_regs.NSSR = nssr_published;
+}
+
+/**
+ * @brief  Change the flash content, outside of the stores of the firmware.
+ * @param  offset: from the flash start
+ * @param  p_data: new content
+ * @param  size: bytes
+ * @retval None
+ */
+static void Flash_Store(uint32_t offset, const void *p_data, uint32_t size) {
+	uintptr_t start = (FLASH_BASE_NS + offset) & ~((uintptr_t)host_page - 1U);
+	size_t length = (size_t)((FLASH_BASE_NS + offset + size) - start);
+	mprotect((void *)start, length, PROT_READ | PROT_WRITE);
+	memmove((void *)(FLASH_BASE_NS + offset), p_data, size);
+	mprotect((void *)start, length, PROT_READ);
+	memmove(&aShadow[offset], p_data, size);
+}
+
+/**
+ * @brief  Keep the flash busy, after what it is already doing.
+ * @param  us: operation time
+ * @retval None
+ */
+static void Flash_Busy(uint32_t us) {
+	uint64_t now = Sim_Time();
+	if (us == 0U) return;
+	if (busy_until < now) busy_until = now;
+	busy_until += (uint64_t)us * 1000U;
+}
+
+/**
+ * @brief  Wait for the end of the flash operations, interrupts delivered.
+ * @param  None
+ * @retval None
+ */
+static void Flash_WaitReady(void) {
+	Sim_FlashPoll();
+	while (Sim_Time() < busy_until) {
+		Sim_Poll();
+		Sim_Sleep(busy_until);
+	}
+	Sim_FlashPoll();
+}
+
+/**
+ * @brief  Offset of a page in the flash.
+ * @param  bank: FLASH_BANK_1 or FLASH_BANK_2, as mapped
+ * @param  page: page in the bank
+ * @retval offset from the flash start
+ */
+static uint32_t Flash_Offset(uint32_t bank, uint32_t page) {
+	return ((bank == FLASH_BANK_2) ? FLASH_BANK_SIZE : 0U) + (page * FLASH_PAGE_SIZE);
+}
+
+/**
+ * @brief  Erase pages or a whole bank.
+ * @param  p_desc: erase description
+ * @param  p_us: operation time
+ * @retval 0, or the NSSR error flags
+ */
+static uint32_t Flash_Erase(const FLASH_EraseInitTypeDef *p_desc, uint32_t *p_us) {
+	static uint8_t aErased[FLASH_PAGE_SIZE];
+	uint32_t bank, page, first = p_desc->Page, count = p_desc->NbPages;
+	memset(aErased, 0xFF, sizeof(aErased));
+	*p_us = 0;
+	if (p_desc->TypeErase == FLASH_TYPEERASE_MASSERASE) {
+		first = 0;
+		count = FLASH_PAGE_NB;
+	} else if ((p_desc->TypeErase != FLASH_TYPEERASE_PAGES) || (count == 0U) || ((first + count) > FLASH_PAGE_NB)
+			|| ((p_desc->Banks != FLASH_BANK_1) && (p_desc->Banks != FLASH_BANK_2))) {
+		nssr_errors |= FLASH_FLAG_PGSERR;
+		sim_flash_stats.errors++;
+		return FLASH_FLAG_PGSERR;
+	}
+	for (bank = FLASH_BANK_1; bank <= FLASH_BANK_2; bank <<= 1) {
+		if ((p_desc->Banks & bank) == 0U) continue;
+		for (page = first; page < (first + count); page++) Flash_Store(Flash_Offset(bank, page), aErased, FLASH_PAGE_SIZE);
+		if (p_desc->TypeErase == FLASH_TYPEERASE_MASSERASE) {
+			*p_us += sim_config.bank_erase_us;
+			sim_flash_stats.banks++;
+		} else {
+			*p_us += count * sim_config.page_erase_us;
+			sim_flash_stats.pages += count;
+		}
+		if (sim_config.verbose) fprintf(stderr, "sim: bank %lu erase, %lu pages from %lu\n", (unsigned long)bank,
+				(unsigned long)count, (unsigned long)first);
+	}
+	return 0;
+}
+
+/**
+ * @brief  Program a quadword or a burst for a HAL service.
+ * @param  type: FLASH_TYPEPROGRAM_QUADWORD or FLASH_TYPEPROGRAM_BURST
+ * @param  address: flash address, aligned on the size
+ * @param  p_data: data
+ * @param  p_us: operation time
+ * @retval 0, or the NSSR error flags
+ */
+static uint32_t Flash_Program(uint32_t type, uint32_t address, const uint8_t *p_data, uint32_t *p_us) {
+	uint32_t size = (type == FLASH_TYPEPROGRAM_BURST) ? FLASH_BURST_SIZE : FLASH_QUADWORD_SIZE;
+	uint32_t offset = address - FLASH_BASE_NS, index, error = 0;
+	*p_us = 0;
+	if ((address < FLASH_BASE_NS) || (offset >= SIM_FLASH_SIZE) || ((offset % size) != 0U)) {
+		error = FLASH_FLAG_PGAERR;
+	} else {
+		for (index = 0; index < size; index++) {
+			if (aShadow[offset + index] != 0xFFU) error = FLASH_FLAG_PROGERR;
+		}
+	}
+	if (error != 0U) {
+		nssr_errors |= error;
+		sim_flash_stats.errors++;
+		if (sim_config.verbose) fprintf(stderr, "sim: program of 0x%08lx refused, NSSR 0x%08lx\n",
+				(unsigned long)address, (unsigned long)error);
+		return error;
+	}
+	Flash_Store(offset, p_data, size);
+	if (size == FLASH_BURST_SIZE) {
+		*p_us = sim_config.burst_us;
+		sim_flash_stats.bursts++;
+	} else {
+		*p_us = sim_config.quadword_us;
+		sim_flash_stats.quadwords++;
+	}
+	return 0;
+}
+
+/**
+ * @brief  Write the SWAP_BANK option byte next to the image.
+ * @param  value: FLASH_OPTR_SWAP_BANK or 0
+ * @retval None
+ */
+static void Flash_SaveOptions(uint32_t value) {
+	FILE *p_file = fopen(ob_path, "w");
+	if (p_file == NULL) {
+		perror(ob_path);
+		return;
+	}
+	fprintf(p_file, "SWAP_BANK=%u\n", (value != 0U) ? 1U : 0U);
+	fclose(p_file);
+}
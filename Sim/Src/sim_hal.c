@@ -0,0 +1,263 @@
+/**
+  ******************************************************************************
+  * @file    sim_hal.c
+  * @brief   This file provides the time base, the interrupt masking and
+  *          delivery, and the HAL services of the host simulation that have
+  *          no behaviour of their own (MPU, ICACHE, NVIC).
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "flash.h"
+#include <time.h>
+
+/* Private variables ---------------------------------------------------------*/
+uint32_t SystemCoreClock = SIM_SYSCLK;
+RCC_TypeDef sim_rcc;
+ICACHE_TypeDef sim_icache = { .CR = ICACHE_CR_WAYSEL };   /* reset value */
+CRC_TypeDef sim_crc;
+CoreDebug_Type sim_coredebug;
+MPU_Type sim_mpu;
+
+static DWT_Type sim_dwt;
+static uint64_t time_base;              /* ns, Sim_Time() origin */
+static volatile uint32_t primask;
+static uint32_t in_irq;
+static uint32_t irq_enabled[8];
+
+/* Private function prototypes -----------------------------------------------*/
+void FLASH_IRQHandler(void);
+
+/* Public functions ---------------------------------------------------------*/
+/**
+ * @brief  Time since the start of the simulation.
+ * @param  None
+ * @retval ns
+ */
+uint64_t Sim_Time(void) {
+	struct timespec now;
+	uint64_t ns;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ns = ((uint64_t)now.tv_sec * 1000000000U) + (uint64_t)now.tv_nsec;
+	if (time_base == 0U) time_base = ns;
+	return ns - time_base;
+}
+
+/**
+ * @brief  Sleep until a time, or a little less: callers loop on a condition.
+ * @param  until: Sim_Time() to wake up at, at most 1 ms from now
+ * @retval None
+ */
+void Sim_Sleep(uint64_t until) {
+	struct timespec delay = { 0, 0 };
+	uint64_t now = Sim_Time();
+	if (until <= now) return;
+	delay.tv_nsec = (long)(((until - now) > 1000000U) ? 1000000U : (until - now));
+	nanosleep(&delay, NULL);
+}
+
+/**
+ * @brief  The DWT, its cycle counter running at SystemCoreClock.
+ * @note   The count is host time: what the code costs on the host, scaled
+ *         to the core clock. Pending interrupts are delivered first.
+ * @param  None
+ * @retval DWT registers
+ */
+DWT_Type *Sim_Dwt(void) {
+	Sim_Poll();
+	if ((sim_dwt.CTRL & DWT_CTRL_CYCCNTENA_Msk) != 0U) {
+		sim_dwt.CYCCNT = (uint32_t)((Sim_Time() * SystemCoreClock) / 1000000000U);
+	}
+	return &sim_dwt;
+}
+
+/**
+ * @brief  PRIMASK read.
+ * @param  None
+ * @retval 1 when the interrupts are masked
+ */
+uint32_t Sim_GetPrimask(void) {
+	return primask;
+}
+
+/**
+ * @brief  PRIMASK write. Unmasking delivers the pending interrupts.
+ * @param  mask: 1 to mask the interrupts
+ * @retval None
+ */
+void Sim_SetPrimask(uint32_t mask) {
+	primask = mask & 1U;
+	if (primask == 0U) Sim_Poll();
+}
+
+/**
+ * @brief  Deliver the interrupts due, as the NVIC would between two
+ *         instructions of the main loop.
+ * @note   Called by every simulated register access and HAL service that
+ *         a waiting loop uses. Nothing is delivered while the interrupts
+ *         are masked, nor from an interrupt.
+ * @param  None
+ * @retval None
+ */
+void Sim_Poll(void) {
+	Sim_UartPoll();
+	if ((primask != 0U) || (in_irq != 0U)) return;
+	Sim_FlashPoll();
+	if (Sim_IrqEnabled(FLASH_IRQn) && Sim_FlashPending()) {
+		in_irq = 1;
+		FLASH_IRQHandler();
+		in_irq = 0;
+	}
+}
+
+/**
+ * @brief  Tell whether an interrupt is enabled in the NVIC.
+ * @param  irq: interrupt number
+ * @retval 1 when enabled
+ */
+uint32_t Sim_IrqEnabled(IRQn_Type irq) {
+	if ((irq < 0) || ((uint32_t)irq >= (sizeof(irq_enabled) * 8U))) return 0;
+	return (irq_enabled[irq / 32] >> (irq % 32)) & 1U;
+}
+
+/**
+ * @brief  Flash non-secure global interrupt, as stm32u5xx_it.c has it.
+ * @param  None
+ * @retval None
+ */
+void FLASH_IRQHandler(void) {
+	HAL_FLASH_IRQHandler();
+	FLASH_Queue_IRQHandler();
+}
+
+/**
+ * @brief  Milliseconds since the start. Pending interrupts are delivered.
+ * @param  None
+ * @retval tick
+ */
+uint32_t HAL_GetTick(void) {
+	Sim_Poll();
+	return (uint32_t)(Sim_Time() / 1000000U);
+}
+
+/**
+ * @brief  Wait, interrupts delivered.
+ * @param  Delay: ms
+ * @retval None
+ */
+void HAL_Delay(uint32_t Delay) {
+	uint64_t until = Sim_Time() + ((uint64_t)Delay * 1000000U);
+	while (Sim_Time() < until) {
+		Sim_Poll();
+		Sim_Sleep(until);
+	}
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority) {
+	UNUSED(IRQn);
+	UNUSED(PreemptPriority);
+	UNUSED(SubPriority);
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn) {
+	if ((IRQn >= 0) && ((uint32_t)IRQn < (sizeof(irq_enabled) * 8U))) irq_enabled[IRQn / 32] |= 1UL << (IRQn % 32);
+	Sim_Poll();
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn) {
+	if ((IRQn >= 0) && ((uint32_t)IRQn < (sizeof(irq_enabled) * 8U))) irq_enabled[IRQn / 32] &= ~(1UL << (IRQn % 32));
+}
+
+void HAL_NVIC_ClearPendingIRQ(IRQn_Type IRQn) {
+	UNUSED(IRQn);
+}
+
+/* The MPU only changes the cacheability of the bank being written: the
+ * registers are kept, as the firmware saves and restores them, but there
+ * is no cache to apply them to.                                       */
+void HAL_MPU_Enable(uint32_t MPU_Control) {
+	sim_mpu.CTRL = MPU_Control | MPU_CTRL_ENABLE_Msk;
+}
+
+void HAL_MPU_Disable(void) {
+	CLEAR_BIT(sim_mpu.CTRL, MPU_CTRL_ENABLE_Msk);
+}
+
+void HAL_MPU_DisableRegion(uint32_t RegionNumber) {
+	sim_mpu.RNR = RegionNumber;
+	CLEAR_BIT(sim_mpu.RLAR, MPU_RLAR_EN_Msk);
+}
+
+void HAL_MPU_ConfigRegion(const MPU_Region_InitTypeDef *const pMPU_RegionInit) {
+	sim_mpu.RNR = pMPU_RegionInit->Number;
+	sim_mpu.RBAR = (pMPU_RegionInit->BaseAddress & 0xFFFFFFE0UL) | ((uint32_t)pMPU_RegionInit->IsShareable << MPU_RBAR_SH_Pos) |
+			((uint32_t)pMPU_RegionInit->AccessPermission << MPU_RBAR_AP_Pos) | ((uint32_t)pMPU_RegionInit->DisableExec << MPU_RBAR_XN_Pos);
+	sim_mpu.RLAR = (pMPU_RegionInit->LimitAddress & 0xFFFFFFE0UL) | ((uint32_t)pMPU_RegionInit->AttributesIndex << MPU_RLAR_AttrIndx_Pos) |
+			((uint32_t)pMPU_RegionInit->Enable << MPU_RLAR_EN_Pos);
+}
+
+void HAL_MPU_ConfigMemoryAttributes(const MPU_Attributes_InitTypeDef *const pMPU_AttributesInit) {
+	volatile uint32_t *p_mair = (pMPU_AttributesInit->Number < 4U) ? &sim_mpu.MAIR0 : &sim_mpu.MAIR1;
+	uint32_t shift = (pMPU_AttributesInit->Number % 4U) * 8U;
+	*p_mair = (*p_mair & ~(0xFFUL << shift)) | ((uint32_t)pMPU_AttributesInit->Attributes << shift);
+}
+
+/* ICACHE: the register states are kept, as the firmware checks them, but
+ * there is no cache: the monitors stay at 0.                          */
+HAL_StatusTypeDef HAL_ICACHE_Enable(void) {
+	SET_BIT(ICACHE->CR, ICACHE_CR_EN);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ICACHE_Disable(void) {
+	CLEAR_BIT(ICACHE->CR, ICACHE_CR_EN);
+	return HAL_OK;
+}
+
+uint32_t HAL_ICACHE_IsEnabled(void) {
+	return (READ_BIT(ICACHE->CR, ICACHE_CR_EN) != 0U) ? 1UL : 0UL;
+}
+
+HAL_StatusTypeDef HAL_ICACHE_ConfigAssociativityMode(uint32_t AssociativityMode) {
+	if (READ_BIT(ICACHE->CR, ICACHE_CR_EN) != 0U) return HAL_ERROR;
+	MODIFY_REG(ICACHE->CR, ICACHE_CR_WAYSEL, AssociativityMode);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ICACHE_DeInit(void) {
+	WRITE_REG(ICACHE->CR, ICACHE_CR_WAYSEL);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ICACHE_Invalidate(void) {
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ICACHE_Monitor_Start(uint32_t MonitorType) {
+	UNUSED(MonitorType);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ICACHE_Monitor_Reset(uint32_t MonitorType) {
+	UNUSED(MonitorType);
+	return HAL_OK;
+}
+
+uint32_t HAL_ICACHE_Monitor_GetHitValue(void) {
+	return 0;
+}
+
+uint32_t HAL_ICACHE_Monitor_GetMissValue(void) {
+	return 0;
+}
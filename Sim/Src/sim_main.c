@@ -0,0 +1,123 @@
+/**
+  ******************************************************************************
+  * @file    sim_main.c
+  * @brief   Host simulation of the updater: main() of the firmware with the
+  *          board replaced by the simulated flash and USART1.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Usage: updater_sim [--flash FILE] [--fd N] [--quadword-us US] [--burst-us US]
+ *                    [--page-erase-us US] [--bank-erase-us US] [-v]
+ * Without --fd the line is a new pty, its name printed on stderr. Leaving
+ * the menu with '3' stands for the button press: the banks are swapped
+ * and the simulation ends, the next run starts on the other bank.      */
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "icache.h"
+#include "usart.h"
+#include "flash.h"
+#include "menu.h"
+#include "checksum.h"
+#include "profile.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Private variables ---------------------------------------------------------*/
+SIM_ConfigTypeDef sim_config = {
+	.p_flash = "sim_flash.bin",
+	.fd = -1,
+	.quadword_us = SIM_QUADWORD_US,
+	.burst_us = SIM_BURST_US,
+	.page_erase_us = SIM_PAGE_ERASE_US,
+	.bank_erase_us = SIM_BANK_ERASE_US,
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static void Sim_Usage(const char *p_name);
+static void Sim_Exit(void);
+
+/* Public functions ---------------------------------------------------------*/
+int main(int argc, char *argv[]) {
+	int i;
+	for (i = 1; i < argc; i++) {
+		const char *p_value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(argv[i], "-v") == 0) {
+			sim_config.verbose = 1;
+			continue;
+		}
+		if (p_value == NULL) Sim_Usage(argv[0]);
+		if (strcmp(argv[i], "--flash") == 0) sim_config.p_flash = p_value;
+		else if (strcmp(argv[i], "--fd") == 0) sim_config.fd = atoi(p_value);
+		else if (strcmp(argv[i], "--quadword-us") == 0) sim_config.quadword_us = strtoul(p_value, NULL, 0);
+		else if (strcmp(argv[i], "--burst-us") == 0) sim_config.burst_us = strtoul(p_value, NULL, 0);
+		else if (strcmp(argv[i], "--page-erase-us") == 0) sim_config.page_erase_us = strtoul(p_value, NULL, 0);
+		else if (strcmp(argv[i], "--bank-erase-us") == 0) sim_config.bank_erase_us = strtoul(p_value, NULL, 0);
+		else Sim_Usage(argv[0]);
+		i++;
+	}
+	if ((Sim_FlashInit(sim_config.p_flash) != 0) || (Sim_UartInit(sim_config.fd) != 0)) return 1;
+	atexit(Sim_Exit);
+
+	/* Same sequence as main.c */
+	MX_USART1_UART_Init();
+	MX_FLASH_Init();
+	MX_ICACHE_Init();
+	Profile_CycleCounterInit();
+	ICACHE_Monitor_Init();
+#if (PROFILE_ENABLED != 0U)
+	Profile_Init();
+#endif
+#if (TRACE_ENABLED != 0U)
+	Trace_Init();
+#endif
+	Crc16_Init();
+	if (uart_rx_start() != HAL_OK) {
+		Error_Handler();
+	}
+	Main_Menu();
+
+	/* The button */
+	uart_tx_wait(0xFFFF);
+	Flash_BankSwap();
+	return 0;
+}
+
+/**
+ * @brief  Same as main.c: the firmware stops.
+ * @retval None
+ */
+void Error_Handler(void) {
+	fprintf(stderr, "sim: Error_Handler()\n");
+	exit(2);
+}
+
+/* Private functions ---------------------------------------------------------*/
+static void Sim_Usage(const char *p_name) {
+	fprintf(stderr, "usage: %s [--flash FILE] [--fd N] [--quadword-us US] [--burst-us US]"
+			" [--page-erase-us US] [--bank-erase-us US] [-v]\n", p_name);
+	exit(1);
+}
+
+/**
+ * @brief  Flash work of the run, on stderr.
+ * @retval None
+ */
+static void Sim_Exit(void) {
+	SIM_FlashStatsTypeDef stats;
+	Sim_FlashGetStats(&stats);
+	fprintf(stderr, "sim: flash quadwords=%u bursts=%u pages=%u banks=%u errors=%u\n", stats.quadwords, stats.bursts,
+			stats.pages, stats.banks, stats.errors);
+}
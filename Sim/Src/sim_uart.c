@@ -0,0 +1,479 @@
+/**
+  ******************************************************************************
+  * @file    sim_uart.c
+  * @brief   This file provides the USART1 of the host simulation: the uart_*
+  *          services of usart.c over a pty or a socket, at the pace of the
+  *          baud rate.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* The peer writes as fast as the host lets it: each byte read from the
+ * line gets the time its last stop bit would reach the USART, 10 bit
+ * times after the previous one, and only enters the RX ring then. The
+ * receiver timeout fires after UART_RX_TIMEOUT_BITS of silence, as on the
+ * target. Bytes sent are written to the line the same way, once their
+ * 10 bit times are over: the peer never sees a byte before it would.   */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usart.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_LINE_SIZE           65536U     /* bytes on the wire, must be a power of two */
+#define SIM_PRINTF_SIZE         1024U
+
+/* Private variables ---------------------------------------------------------*/
+UART_HandleTypeDef huart1;
+
+static int uart_fd = -1;
+static int uart_slave_fd = -1;          /* pty: kept open, the master reads EIO otherwise */
+
+/* Bytes read from the line, not arrived yet */
+static uint8_t aLine[SIM_LINE_SIZE];
+static uint64_t aLineTime[SIM_LINE_SIZE];
+static uint32_t line_head, line_tail;
+static uint64_t line_free;              /* arrival of the last byte on the wire */
+
+/* RX ring, written over as the circular DMA does; free running counts */
+static uint8_t aRxRing[UART_RX_RING_SIZE];
+static uint32_t rx_head, rx_tail;
+static uint32_t rx_running;
+static uint32_t rx_overrun_events;
+static uint64_t rx_last;                /* arrival of the last byte in the ring */
+static uint32_t rx_timeout_armed;
+static volatile uint32_t rx_timeout_events;
+static UART_StatsTypeDef rx_stats;
+static uint64_t rx_wait_ns;
+
+/* Bytes sent, written to the line at the end of their stop bit */
+static uint8_t aTx[SIM_LINE_SIZE];
+static uint64_t aTxTime[SIM_LINE_SIZE];
+static uint32_t tx_head, tx_tail;
+static uint64_t tx_busy_until;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint64_t uart_byte_ns(void);
+static void uart_update(void);
+static void uart_wait(uint64_t until);
+static void uart_send(const uint8_t *p_buffer, uint32_t size);
+static void uart_flush_tx(uint64_t now);
+static uint32_t uart_baud_error(uint32_t baud);
+static HAL_StatusTypeDef uart_rx_copy(uint8_t *p_data, uint32_t size, uint32_t timeout, uint8_t frame);
+
+/* Public functions ---------------------------------------------------------*/
+/**
+ * @brief  Open the line.
+ * @param  fd: connected socket, or -1 for a new pty (its name on stderr)
+ * @retval 0, or -1 with a message on stderr
+ */
+int Sim_UartInit(int fd) {
+	struct termios tio;
+	if (fd < 0) {
+		fd = posix_openpt(O_RDWR | O_NOCTTY);
+		if ((fd < 0) || (grantpt(fd) != 0) || (unlockpt(fd) != 0)) {
+			perror("pty");
+			return -1;
+		}
+		uart_slave_fd = open(ptsname(fd), O_RDWR | O_NOCTTY);
+		if ((uart_slave_fd < 0) || (tcgetattr(uart_slave_fd, &tio) != 0)) {
+			perror(ptsname(fd));
+			return -1;
+		}
+		cfmakeraw(&tio);
+		tcsetattr(uart_slave_fd, TCSANOW, &tio);
+		fprintf(stderr, "sim: USART1 on %s\n", ptsname(fd));
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	uart_fd = fd;
+	return 0;
+}
+
+/**
+ * @brief  Run the USART: bytes sent reach the line, bytes received reach
+ *         the RX ring, as the hardware and the DMA do meanwhile.
+ * @param  None
+ * @retval None
+ */
+void Sim_UartPoll(void) {
+	if (uart_fd >= 0) uart_update();
+}
+
+/**
+ * @brief  printf() of the firmware, sent as __io_putchar() would.
+ * @note   The firmware prints uint32_t with %lu: 'l' is dropped, the
+ *         argument is an unsigned int on the host.
+ * @param  p_format: format
+ * @retval characters sent
+ */
+int Sim_Printf(const char *p_format, ...) {
+	char aFormat[SIM_PRINTF_SIZE], aText[SIM_PRINTF_SIZE];
+	uint32_t in = 0, out = 0;
+	va_list args;
+	int size;
+	while ((p_format[in] != '\0') && (out < (sizeof(aFormat) - 1U))) {
+		aFormat[out++] = p_format[in];
+		if (p_format[in++] != '%') continue;
+		if (p_format[in] == '%') {
+			aFormat[out++] = p_format[in++];
+			continue;
+		}
+		while ((p_format[in] != '\0') && (strchr("-+ #0123456789.*", p_format[in]) != NULL) && (out < (sizeof(aFormat) - 1U))) {
+			aFormat[out++] = p_format[in++];
+		}
+		if ((p_format[in] == 'l') && (p_format[in + 1] != '\0') && (strchr("diouxX", p_format[in + 1]) != NULL)) in++;
+	}
+	aFormat[out] = '\0';
+	va_start(args, p_format);
+	size = vsnprintf(aText, sizeof(aText), aFormat, args);
+	va_end(args);
+	if (size > (int)(sizeof(aText) - 1U)) size = sizeof(aText) - 1U;
+	if (size > 0) uart_write_string(aText, (uint16_t)size);
+	return size;
+}
+
+void MX_USART1_UART_Init(void) {
+	huart1.Instance = USART1;
+	huart1.Init.BaudRate = UART_BAUD_DEFAULT;
+	huart1.Init.WordLength = UART_WORDLENGTH_8B;
+	huart1.Init.StopBits = UART_STOPBITS_1;
+	huart1.Init.Parity = UART_PARITY_NONE;
+	huart1.Init.Mode = UART_MODE_TX_RX;
+	huart1.Init.OverSampling = UART_OVERSAMPLING_16;
+	huart1.gState = HAL_UART_STATE_READY;
+}
+
+void uart_write_byte(uint8_t byte) {
+	uart_write_string(&byte, 1);
+}
+
+void uart_write_string(void *p_buffer, uint16_t size) {
+	uart_tx_wait(0xFFFF);
+	uart_send(p_buffer, size);
+	uart_tx_wait(0xFFFF);
+}
+
+HAL_StatusTypeDef uart_write_dma(const uint8_t *p_buffer, uint16_t size) {
+	if (uart_tx_wait(0xFFFF) != HAL_OK) return HAL_TIMEOUT;
+	uart_send(p_buffer, size);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef uart_tx_wait(uint32_t timeout) {
+	uint64_t until = Sim_Time() + ((uint64_t)timeout * 1000000U);
+	while (Sim_Time() < tx_busy_until) {
+		if (Sim_Time() > until) return HAL_TIMEOUT;
+		uart_wait(tx_busy_until);
+	}
+	uart_update();
+	huart1.gState = HAL_UART_STATE_READY;
+	return HAL_OK;
+}
+
+uint32_t uart_baud_supported(uint32_t baud) {
+	return (uart_baud_error(baud) <= UART_BAUD_TOLERANCE) ? 1U : 0U;
+}
+
+uint32_t uart_get_baud(void) {
+	return huart1.Init.BaudRate;
+}
+
+/**
+ * @brief  Change the baud rate.
+ * @note   Bytes not read yet are lost, as on the target; so are the ones
+ *         still on the wire, sent at the former rate.
+ * @param  baud: new rate, see uart_baud_supported()
+ * @retval HAL status
+ */
+HAL_StatusTypeDef uart_set_baud(uint32_t baud) {
+	if (baud == huart1.Init.BaudRate) return HAL_OK;
+	if (uart_baud_error(baud) > UART_BAUD_TOLERANCE) return HAL_ERROR;
+	uart_tx_wait(0xFFFF);
+	uart_rx_stop();
+	uart_update();
+	line_tail = line_head;
+	huart1.Init.BaudRate = baud;
+	return uart_rx_start();
+}
+
+HAL_StatusTypeDef uart_rx_start(void) {
+	uart_update();
+	rx_tail = rx_head;
+	rx_timeout_armed = 0;
+	rx_running = 1;
+	return HAL_OK;
+}
+
+void uart_rx_stop(void) {
+	rx_running = 0;
+}
+
+uint32_t uart_rx_available(void) {
+	uart_update();
+	if ((rx_head - rx_tail) > UART_RX_RING_SIZE) {
+		rx_tail = rx_head;
+		rx_stats.overruns++;
+		rx_overrun_events++;
+	}
+	return rx_head - rx_tail;
+}
+
+void uart_rx_flush(void) {
+	uart_update();
+	rx_tail = rx_head;
+}
+
+void uart_rx_purge(uint32_t quiet) {
+	uint32_t tickstart = HAL_GetTick();
+	while ((HAL_GetTick() - tickstart) <= quiet) {
+		if (uart_rx_available() != 0) {
+			uart_rx_flush();
+			tickstart = HAL_GetTick();
+		}
+		uart_wait(Sim_Time() + 1000000U);
+	}
+}
+
+HAL_StatusTypeDef uart_read(uint8_t *p_data, uint32_t size, uint32_t timeout) {
+	return uart_rx_copy(p_data, size, timeout, 0);
+}
+
+HAL_StatusTypeDef uart_read_frame(uint8_t *p_data, uint32_t size, uint32_t timeout) {
+	return uart_rx_copy(p_data, size, timeout, 1);
+}
+
+void uart_rx_irq(void) {
+	uart_update();
+}
+
+void uart_rx_stats_reset(void) {
+	memset(&rx_stats, 0, sizeof(rx_stats));
+	rx_wait_ns = 0;
+}
+
+void uart_rx_stats(UART_StatsTypeDef *p_stats) {
+	uart_update();
+	*p_stats = rx_stats;
+	p_stats->wait_us = (uint32_t)(rx_wait_ns / 1000U);
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+ * @brief  Time of a character on the line, 8N1.
+ * @param  None
+ * @retval ns
+ */
+static uint64_t uart_byte_ns(void) {
+	return 10000000000ULL / huart1.Init.BaudRate;
+}
+
+/**
+ * @brief  Read the line, move the bytes arrived into the RX ring.
+ * @note   A byte arriving on a full ring overwrites the oldest unread
+ *         one, as the circular DMA does; uart_rx_available() notices.
+ * @param  None
+ * @retval None
+ */
+static void uart_update(void) {
+	static uint8_t aRead[4096];
+	uint64_t now = Sim_Time(), rto = ((uint64_t)UART_RX_TIMEOUT_BITS * 1000000000U) / huart1.Init.BaudRate;
+	uint32_t room, index;
+	ssize_t count;
+	uart_flush_tx(now);
+	/* Bytes on the wire */
+	room = SIM_LINE_SIZE - (line_head - line_tail);
+	while (room != 0U) {
+		count = read(uart_fd, aRead, (room < sizeof(aRead)) ? room : sizeof(aRead));
+		if (count <= 0) {
+			if ((count == 0) || ((errno != EAGAIN) && (errno != EINTR) && (errno != EIO))) {
+				fprintf(stderr, "sim: line closed\n");
+				exit(0);
+			}
+			break;
+		}
+		for (index = 0; index < (uint32_t)count; index++) {
+			if (line_free < now) line_free = now;
+			line_free += uart_byte_ns();
+			aLine[line_head & (SIM_LINE_SIZE - 1U)] = aRead[index];
+			aLineTime[line_head & (SIM_LINE_SIZE - 1U)] = line_free;
+			line_head++;
+		}
+		room -= (uint32_t)count;
+	}
+	/* Bytes arrived, and the receiver timeouts between them */
+	while ((line_tail != line_head) && (aLineTime[line_tail & (SIM_LINE_SIZE - 1U)] <= now)) {
+		if (rx_timeout_armed && (aLineTime[line_tail & (SIM_LINE_SIZE - 1U)] > (rx_last + rto))) rx_timeout_events++;
+		rx_last = aLineTime[line_tail & (SIM_LINE_SIZE - 1U)];
+		rx_timeout_armed = 1;
+		if (rx_running) {
+			aRxRing[rx_head & (UART_RX_RING_SIZE - 1U)] = aLine[line_tail & (SIM_LINE_SIZE - 1U)];
+			rx_head++;
+		}
+		line_tail++;
+	}
+	if (rx_timeout_armed && (now > (rx_last + rto))) {
+		rx_timeout_events++;
+		rx_timeout_armed = 0;
+	}
+}
+
+/**
+ * @brief  Wait for the line or for a time, interrupts delivered.
+ * @param  until: Sim_Time() to return at, at the latest
+ * @retval None
+ */
+static void uart_wait(uint64_t until) {
+	struct pollfd line = { .fd = uart_fd, .events = POLLIN };
+	struct timespec delay = { 0, 0 };
+	uint64_t now, next;
+	Sim_Poll();
+	uart_update();
+	now = Sim_Time();
+	next = until;
+	if (Sim_FlashNextEvent() < next) next = Sim_FlashNextEvent();
+	if ((line_tail != line_head) && (aLineTime[line_tail & (SIM_LINE_SIZE - 1U)] < next)) next = aLineTime[line_tail & (SIM_LINE_SIZE - 1U)];
+	if ((tx_tail != tx_head) && (aTxTime[tx_tail & (SIM_LINE_SIZE - 1U)] < next)) next = aTxTime[tx_tail & (SIM_LINE_SIZE - 1U)];
+	if (next <= now) return;
+	if ((next - now) > 1000000U) next = now + 1000000U;
+	delay.tv_nsec = (long)(next - now);
+	/* The wire full, the line is not read: only the time matters */
+	if ((line_head - line_tail) == SIM_LINE_SIZE) line.fd = -1;
+	ppoll(&line, 1, &delay, NULL);
+}
+
+/**
+ * @brief  Send bytes: each one reaches the line when its stop bit is out,
+ *         the transmitter busy until the last one.
+ * @param  p_buffer: data
+ * @param  size: bytes
+ * @retval None
+ */
+static void uart_send(const uint8_t *p_buffer, uint32_t size) {
+	uint64_t now = Sim_Time();
+	huart1.gState = HAL_UART_STATE_BUSY_TX;
+	if (tx_busy_until < now) tx_busy_until = now;
+	while (size != 0U) {
+		while ((tx_head - tx_tail) == SIM_LINE_SIZE) uart_wait(aTxTime[tx_tail & (SIM_LINE_SIZE - 1U)]);
+		tx_busy_until += uart_byte_ns();
+		aTx[tx_head & (SIM_LINE_SIZE - 1U)] = *p_buffer++;
+		aTxTime[tx_head & (SIM_LINE_SIZE - 1U)] = tx_busy_until;
+		tx_head++;
+		size--;
+	}
+	uart_update();
+}
+
+/**
+ * @brief  Write the bytes sent by now to the line.
+ * @param  now: Sim_Time()
+ * @retval None
+ */
+static void uart_flush_tx(uint64_t now) {
+	static uint8_t aWrite[4096];
+	struct pollfd line = { .fd = uart_fd, .events = POLLOUT };
+	uint32_t count = 0, done;
+	ssize_t written;
+	while ((tx_tail != tx_head) && (aTxTime[tx_tail & (SIM_LINE_SIZE - 1U)] <= now) && (count < sizeof(aWrite))) {
+		aWrite[count++] = aTx[tx_tail & (SIM_LINE_SIZE - 1U)];
+		tx_tail++;
+	}
+	for (done = 0; done < count;) {
+		written = write(uart_fd, &aWrite[done], count - done);
+		if (written < 0) {
+			if ((errno != EAGAIN) && (errno != EINTR)) {
+				fprintf(stderr, "sim: line closed\n");
+				exit(0);
+			}
+			/* The peer reads slowly */
+			poll(&line, 1, 1);
+			continue;
+		}
+		done += (uint32_t)written;
+	}
+}
+
+/**
+ * @brief  Baud rate error with the 16 MHz kernel clock, as usart.c has it.
+ * @param  baud: requested rate
+ * @retval error in per mille
+ */
+static uint32_t uart_baud_error(uint32_t baud) {
+	uint32_t k, div, actual, error, best = 1000U;
+	if (baud == 0U) return best;
+	for (k = 1; k <= 2U; k++) {
+		div = ((SIM_UART_CLOCK * k) + (baud / 2U)) / baud;
+		if (div < 16U) continue;
+		actual = (SIM_UART_CLOCK * k) / div;
+		error = (uint32_t)(((uint64_t)((actual > baud) ? (actual - baud) : (baud - actual)) * 1000U) / baud);
+		if (error < best) best = error;
+	}
+	return best;
+}
+
+/**
+ * @brief  Read bytes from the RX ring, as usart.c does.
+ * @param  p_data: destination buffer
+ * @param  size: number of bytes to read
+ * @param  timeout: overall timeout in ms
+ * @param  frame: when set, a receiver timeout ends the read early
+ * @retval HAL_OK, HAL_TIMEOUT, or HAL_ERROR when bytes were lost
+ */
+static HAL_StatusTypeDef uart_rx_copy(uint8_t *p_data, uint32_t size, uint32_t timeout, uint8_t frame) {
+	uint64_t start = Sim_Time(), waitstart = 0;
+	uint64_t until = (timeout == HAL_MAX_DELAY) ? UINT64_MAX : (start + ((uint64_t)timeout * 1000000U));
+	uint32_t rto = rx_timeout_events, overrun = rx_overrun_events;
+	uint32_t count, chunk, tail;
+	uint8_t waiting = 0;
+	while (size > 0) {
+		count = uart_rx_available();
+		if (overrun != rx_overrun_events) {
+			if (waiting) rx_wait_ns += Sim_Time() - waitstart;
+			return HAL_ERROR;
+		}
+		if (count == 0) {
+			if (!waiting) {
+				waitstart = Sim_Time();
+				waiting = 1;
+			}
+			if ((frame && (rto != rx_timeout_events)) || (Sim_Time() > until)) {
+				rx_wait_ns += Sim_Time() - waitstart;
+				return HAL_TIMEOUT;
+			}
+			uart_wait(until);
+			continue;
+		}
+		if (waiting) {
+			rx_wait_ns += Sim_Time() - waitstart;
+			waiting = 0;
+		}
+		if (count > size) count = size;
+		tail = rx_tail & (UART_RX_RING_SIZE - 1U);
+		chunk = UART_RX_RING_SIZE - tail;
+		if (chunk > count) chunk = count;
+		memcpy(p_data, &aRxRing[tail], chunk);
+		memcpy(p_data + chunk, &aRxRing[0], count - chunk);
+		rx_tail += count;
+		p_data += count;
+		size -= count;
+		rto = rx_timeout_events;
+	}
+	return HAL_OK;
+}
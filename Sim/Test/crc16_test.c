@@ -0,0 +1,223 @@
+/**
+  ******************************************************************************
+  * @file    crc16_test.c
+  * @brief   Host check and benchmark of the CRC16 engines of checksum.c
+  *          against the bit loop they replaced.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2024 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* checksum.c is built once per software engine, its functions renamed
+ * after it (Crc16_Update_SLICE8...), see the check target of the
+ * Makefile. Every engine must give the result of Cal_CRC16(), the code
+ * ymodem.c had before, on random data of every length up to
+ * CRC16_TEST_LENGTH at every alignment, in one call and split in two.
+ * The benchmark then times 1K and 8K packets. The peripheral engine
+ * needs the target and is not covered here.                          */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* Private define ------------------------------------------------------------*/
+#define CRC16_TEST_LENGTH       1100U      /* a 1K frame and its overhead */
+#define CRC16_TEST_ALIGNMENTS   8U
+#define CRC16_BENCH_NS          200000000U /* per engine and size */
+
+/* Private macro -------------------------------------------------------------*/
+#define CRC16_ENGINE_FUNCTIONS(name) \
+	void Crc16_Init_##name(void); \
+	uint16_t Crc16_Update_##name(uint16_t crc, const uint8_t *p_data, uint32_t size); \
+	uint16_t Crc16_Calc_##name(const uint8_t *p_data, uint32_t size);
+#define CRC16_ENGINE_ENTRY(name) \
+	{ #name, Crc16_Init_##name, Crc16_Update_##name, Crc16_Calc_##name }
+
+/* Private types -------------------------------------------------------------*/
+typedef struct
+{
+  const char *p_name;
+  void (*init)(void);
+  uint16_t (*update)(uint16_t crc, const uint8_t *p_data, uint32_t size);
+  uint16_t (*calc)(const uint8_t *p_data, uint32_t size);
+} CRC16_EngineTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+CRC16_ENGINE_FUNCTIONS(BITWISE)
+CRC16_ENGINE_FUNCTIONS(TABLE)
+CRC16_ENGINE_FUNCTIONS(SLICE4)
+CRC16_ENGINE_FUNCTIONS(SLICE8)
+
+static const CRC16_EngineTypeDef aEngines[] =
+{
+  CRC16_ENGINE_ENTRY(BITWISE),
+  CRC16_ENGINE_ENTRY(TABLE),
+  CRC16_ENGINE_ENTRY(SLICE4),
+  CRC16_ENGINE_ENTRY(SLICE8),
+};
+#define CRC16_ENGINES           (sizeof(aEngines) / sizeof(aEngines[0]))
+
+static uint8_t aBuffer[8192U + CRC16_TEST_ALIGNMENTS];
+static volatile uint16_t crc_sink;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint16_t UpdateCRC16(uint16_t crc_in, uint8_t byte);
+static uint16_t Cal_CRC16(const uint8_t *p_data, uint32_t size);
+static uint32_t Check(const CRC16_EngineTypeDef *p_engine);
+static double Bench(const char *p_name, uint16_t (*calc)(const uint8_t *p_data, uint32_t size), uint32_t size,
+		double reference);
+static uint64_t Now_ns(void);
+static uint64_t Ticks(void);
+
+/* Public functions ---------------------------------------------------------*/
+int main(int argc, char *argv[]) {
+	uint32_t i, failed = 0, seed = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : (uint32_t)time(NULL);
+	static const uint32_t aSizes[] = { 1024U, 8192U };
+	uint32_t size;
+	double reference;
+	printf("crc16_test: seed %u\n", seed);
+	srand(seed);
+	for (i = 0; i < sizeof(aBuffer); i++) aBuffer[i] = (uint8_t)rand();
+	for (i = 0; i < CRC16_ENGINES; i++) {
+		aEngines[i].init();
+		failed += Check(&aEngines[i]);
+	}
+	if (failed != 0U) {
+		printf("crc16_test: %u engine(s) FAILED\n", failed);
+		return 1;
+	}
+	for (size = 0; size < (sizeof(aSizes) / sizeof(aSizes[0])); size++) {
+		printf("%u-byte packets:\n", aSizes[size]);
+		reference = Bench("Cal_CRC16", Cal_CRC16, aSizes[size], 0.0);
+		for (i = 0; i < CRC16_ENGINES; i++) Bench(aEngines[i].p_name, aEngines[i].calc, aSizes[size], reference);
+	}
+	printf("crc16_test: OK\n");
+	return 0;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+ * @brief  Update CRC16 for input byte, as ymodem.c had it
+ * @param  crc_in input value
+ * @param  input byte
+ * @retval None
+ */
+static uint16_t UpdateCRC16(uint16_t crc_in, uint8_t byte) {
+	uint32_t crc = crc_in;
+	uint32_t in = byte | 0x100;
+	do {
+		crc <<= 1;
+		in <<= 1;
+		if(in & 0x100) ++crc;
+		if(crc & 0x10000) crc ^= 0x1021;
+	}
+	while(!(in & 0x10000));
+	return crc & 0xffffu;
+}
+
+/**
+ * @brief  Cal CRC16 for YModem Packet, as ymodem.c had it
+ * @param  data
+ * @param  length
+ * @retval None
+ */
+static uint16_t Cal_CRC16(const uint8_t* p_data, uint32_t size) {
+	uint32_t crc = 0;
+	const uint8_t* dataEnd = p_data + size;
+	while(p_data < dataEnd) crc = UpdateCRC16(crc, *p_data++);
+	crc = UpdateCRC16(crc, 0);
+	crc = UpdateCRC16(crc, 0);
+	return crc&0xffffu;
+}
+
+/**
+ * @brief  Compare an engine with Cal_CRC16().
+ * @param  p_engine: engine
+ * @retval 0 if identical, 1 otherwise
+ */
+static uint32_t Check(const CRC16_EngineTypeDef *p_engine) {
+	uint32_t length, offset, split, cases = 0;
+	const uint8_t *p_data;
+	uint16_t expected;
+	if (p_engine->calc((const uint8_t *)"123456789", 9U) != 0x31C3U) {
+		printf("  %-8s check value 0x%04X, 0x31C3 expected\n", p_engine->p_name,
+				p_engine->calc((const uint8_t *)"123456789", 9U));
+		return 1;
+	}
+	for (length = 0; length <= CRC16_TEST_LENGTH; length++) {
+		for (offset = 0; offset < CRC16_TEST_ALIGNMENTS; offset++) {
+			p_data = &aBuffer[offset];
+			expected = Cal_CRC16(p_data, length);
+			split = (length != 0U) ? ((uint32_t)rand() % (length + 1U)) : 0U;
+			if ((p_engine->calc(p_data, length) != expected)
+					|| (p_engine->update(p_engine->update(0, p_data, split), &p_data[split], length - split) != expected)) {
+				printf("  %-8s differs: length %u, offset %u, split %u\n", p_engine->p_name, length, offset, split);
+				return 1;
+			}
+			cases++;
+		}
+	}
+	printf("  %-8s identical to Cal_CRC16() on %u buffers\n", p_engine->p_name, cases);
+	return 0;
+}
+
+/**
+ * @brief  Time an engine on packets of one size.
+ * @param  p_name: engine name
+ * @param  calc: CRC of a buffer
+ * @param  size: packet size
+ * @param  reference: ns per byte of Cal_CRC16(), 0 when timing it
+ * @retval ns per byte
+ */
+static double Bench(const char *p_name, uint16_t (*calc)(const uint8_t *p_data, uint32_t size), uint32_t size,
+		double reference) {
+	uint64_t start = Now_ns(), ticks = Ticks(), elapsed, bytes = 0;
+	double ns, cycles;
+	do {
+		crc_sink = calc(aBuffer, size);
+		bytes += size;
+		elapsed = Now_ns() - start;
+	} while (elapsed < CRC16_BENCH_NS);
+	ticks = Ticks() - ticks;
+	ns = (double)elapsed / (double)bytes;
+	cycles = (double)ticks / (double)bytes;
+	if (reference == 0.0) reference = ns;
+	if (ticks != 0U) {
+		printf("  %-10s %7.3f ns/byte %7.3f cycles/byte %6.1fx\n", p_name, ns, cycles, reference / ns);
+	} else {
+		printf("  %-10s %7.3f ns/byte %6.1fx\n", p_name, ns, reference / ns);
+	}
+	return ns;
+}
+
+static uint64_t Now_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000000000U) + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * @brief  Time stamp counter, 0 where there is none.
+ * @retval ticks
+ */
+static uint64_t Ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,318 @@
+#!/usr/bin/env python3
+"""Binary delta tool for the patch download.
+
+Builds a patch that turns the running image (the base) into a new one. The
+device rebuilds the new image in the inactive bank with Core/Src/delta.c,
+reading the base in place from the active bank.
+
+A patch is a sequence of operations, an opcode byte followed by LEB128
+numbers (7 bits per byte, least significant first, bit 7 = more follow):
+
+  - 0x01 offset length: copy bytes of the base image;
+  - 0x02 length data: insert the bytes that follow.
+
+The base is the image as the device sees it: padded with 0xFF to a quadword,
+without its erased end (see Flash_Get_ImageSize()). A backup made with the
+upload menu entry is exactly that. Send the patch with the YMODEM extensions
+" @delta=<new image size> @base=<CRC-32 of the base>" in block 0.
+
+Usage:
+  delta.py diff <base.bin> <new.bin> <patch.bin>
+  delta.py patch <base.bin> <patch.bin> <new.bin>
+  delta.py test [<base.bin> <new.bin>] [--baud 115200] [--runs 20]
+
+test rebuilds the new image through a model of the device: the patch is fed
+in random chunks, the output goes to a simulated flash bank that refuses to
+program a quadword twice. Without images it makes synthetic ones.
+"""
+
+import argparse
+import random
+import sys
+import time
+import zlib
+
+OP_COPY = 0x01
+OP_INSERT = 0x02
+QUADWORD = 16
+CHUNK_SIZE = 4096                    # DELTA_CHUNK_SIZE
+IMAGE_SIZE = 256 * 1024 - 8 * 1024   # FLASH_IMAGE_SIZE, STM32U545
+KEY = 16                             # bytes hashed to find copy candidates
+MIN_COPY = 8                         # shorter matches go in an insert
+CANDIDATES = 8                       # base offsets kept per key
+
+
+def base_image(data: bytes) -> bytes:
+    """The base as the device sees it: padded to a quadword, erased end trimmed."""
+    data = data + b"\xff" * (-len(data) % QUADWORD)
+    size = len(data)
+    while size >= QUADWORD and data[size - QUADWORD:size] == b"\xff" * QUADWORD:
+        size -= QUADWORD
+    return data[:size]
+
+
+def leb128(value: int) -> bytes:
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def diff(base: bytes, new: bytes) -> bytes:
+    """Greedy copy/insert diff, base offsets indexed by KEY-byte blocks."""
+    index = {}
+    for i in range(len(base) - KEY + 1):
+        offsets = index.setdefault(base[i:i + KEY], [])
+        if len(offsets) < CANDIDATES:
+            offsets.append(i)
+
+    out = bytearray()
+    literal = 0          # start of the bytes not covered yet
+    pos = 0
+    follow = None        # base offset matching pos after the last copy
+
+    def match(b, n):
+        length = 0
+        while b + length < len(base) and n + length < len(new) and base[b + length] == new[n + length]:
+            length += 1
+        return length
+
+    while pos < len(new):
+        best_len, best_off = 0, 0
+        candidates = list(index.get(new[pos:pos + KEY], ()))
+        if follow is not None and follow < len(base):
+            # Same alignment as the previous copy: catches patched constants
+            candidates.insert(0, follow)
+        for cand in candidates:
+            length = match(cand, pos)
+            # Grow backwards over the pending literal bytes
+            back = 0
+            while back < pos - literal and cand - back > 0 and base[cand - back - 1] == new[pos - back - 1]:
+                back += 1
+            if length + back > best_len:
+                best_len, best_off = length + back, cand - back
+                start = pos - back
+        if best_len >= MIN_COPY:
+            if start > literal:
+                out += bytes([OP_INSERT]) + leb128(start - literal) + new[literal:start]
+            out += bytes([OP_COPY]) + leb128(best_off) + leb128(best_len)
+            pos = start + best_len
+            literal = pos
+            follow = best_off + best_len
+        else:
+            pos += 1
+            if follow is not None:
+                follow += 1
+    if len(new) > literal:
+        out += bytes([OP_INSERT]) + leb128(len(new) - literal) + new[literal:]
+    return bytes(out)
+
+
+class Patcher:
+    """Reference patcher, same state machine as the device."""
+
+    def __init__(self, base: bytes, output):
+        self.base = base
+        self.output = output
+        self.buffer = bytearray()
+        self.total = 0
+        self.state = "op"
+        self.args = []
+        self.value = 0
+        self.shift = 0
+        self.length = 0
+
+    def _put(self, data):
+        self.total += len(data)
+        while data:
+            room = CHUNK_SIZE - len(self.buffer)
+            self.buffer += data[:room]
+            data = data[room:]
+            if len(self.buffer) == CHUNK_SIZE:
+                self.output(bytes(self.buffer))
+                self.buffer.clear()
+
+    def feed(self, data: bytes):
+        i = 0
+        while i < len(data):
+            if self.state == "data":
+                count = min(len(data) - i, self.length)
+                self._put(data[i:i + count])
+                i += count
+                self.length -= count
+                if self.length == 0:
+                    self.state = "op"
+                continue
+            byte = data[i]
+            i += 1
+            if self.state == "op":
+                if byte not in (OP_COPY, OP_INSERT):
+                    raise ValueError("bad opcode 0x%02x" % byte)
+                self.op, self.args, self.value, self.shift = byte, [], 0, 0
+                self.state = "arg"
+                continue
+            if self.shift >= 32:
+                raise ValueError("number too long")
+            self.value |= (byte & 0x7F) << self.shift
+            self.shift += 7
+            if byte & 0x80:
+                continue
+            self.args.append(self.value)
+            self.value, self.shift = 0, 0
+            if self.op == OP_COPY and len(self.args) == 1:
+                continue
+            self.state = "op"
+            if self.op == OP_INSERT:
+                self.length = self.args[0]
+                if self.length:
+                    self.state = "data"
+            else:
+                offset, length = self.args
+                if offset + length > len(self.base):
+                    raise ValueError("copy outside the base")
+                self._put(self.base[offset:offset + length])
+
+    def finish(self):
+        if self.state != "op":
+            raise ValueError("patch ends inside an operation")
+        if self.buffer:
+            self.buffer += b"\xff" * (-len(self.buffer) % QUADWORD)
+            self.output(bytes(self.buffer))
+
+
+class FlashBank:
+    """Erased bank that, like the device, programs each quadword once."""
+
+    def __init__(self, size=IMAGE_SIZE):
+        self.data = bytearray(b"\xff" * size)
+        self.address = 0
+
+    def write(self, chunk: bytes):
+        if len(chunk) % QUADWORD or self.address + len(chunk) > len(self.data):
+            raise ValueError("bad write at 0x%x" % self.address)
+        for q in range(0, len(chunk), QUADWORD):
+            word = chunk[q:q + QUADWORD]
+            if word == b"\xff" * QUADWORD:
+                continue    # FLASH_Write() skips erased quadwords
+            at = self.address + q
+            if self.data[at:at + QUADWORD] != b"\xff" * QUADWORD:
+                raise ValueError("quadword 0x%x programmed twice" % at)
+            self.data[at:at + QUADWORD] = word
+        self.address += len(chunk)
+
+
+def apply(base: bytes, patch: bytes, chunks=None) -> bytes:
+    """Rebuild through the device model; chunks lists the packet sizes."""
+    bank = FlashBank()
+    patcher = Patcher(base, bank.write)
+    i = 0
+    for size in chunks or [len(patch)]:
+        patcher.feed(patch[i:i + size])
+        i += size
+    patcher.feed(patch[i:])
+    patcher.finish()
+    return bytes(bank.data[:patcher.total])
+
+
+def wire_time(size: int, baud: int, block: int = 1024) -> float:
+    """Seconds on the wire for a YMODEM transfer, 10 bits per byte."""
+    blocks = (size + block - 1) // block
+    return (blocks * (block + 5) + 133 * 2) * 10 / baud
+
+
+def synthetic(rng: random.Random):
+    """A code-like base and a new image with a few local edits."""
+    words = [rng.randrange(1 << 32).to_bytes(4, "little") for _ in range(2048)]
+    base = bytearray()
+    while len(base) < 160 * 1024:
+        base += rng.choice(words)
+    new = bytearray(base)
+    for _ in range(40):
+        at = rng.randrange(len(new))
+        kind = rng.randrange(3)
+        if kind == 0:
+            new[at:at + 4] = rng.randbytes(4)
+        elif kind == 1:
+            new[at:at] = rng.randbytes(rng.randrange(1, 600))
+        else:
+            del new[at:at + rng.randrange(1, 600)]
+    return bytes(base), bytes(new)
+
+
+def test(args):
+    rng = random.Random(1)
+    if args.images:
+        if len(args.images) != 2:
+            sys.exit("test takes a base and a new image")
+        with open(args.images[0], "rb") as f:
+            base = base_image(f.read())
+        with open(args.images[1], "rb") as f:
+            new = f.read()
+    else:
+        base, new = synthetic(rng)
+    if len(new) > IMAGE_SIZE:
+        sys.exit("new image larger than the image area")
+    start = time.perf_counter()
+    patch = diff(base, new)
+    elapsed = time.perf_counter() - start
+    for run in range(args.runs):
+        chunks = [rng.randrange(1, 1500) for _ in range(len(patch) // 700 + 1)]
+        if apply(base, patch, chunks) != new:
+            sys.exit("round trip failed, run %d" % run)
+    # A patch applied to another base must not go unnoticed
+    other = bytearray(base)
+    other[len(other) // 2] ^= 0x01
+    assert zlib.crc32(bytes(other)) != zlib.crc32(base)
+    print("base %d, new %d, patch %d bytes (%.1f%%), diff %.2f s" %
+          (len(base), len(new), len(patch), 100.0 * len(patch) / max(len(new), 1), elapsed))
+    print("wire at %d baud: %.2f s -> %.2f s" %
+          (args.baud, wire_time(len(new), args.baud), wire_time(len(patch), args.baud)))
+    print("%d round trips through the flash model: OK" % args.runs)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="cmd", required=True)
+    p = sub.add_parser("diff")
+    p.add_argument("base")
+    p.add_argument("new")
+    p.add_argument("patch")
+    p = sub.add_parser("patch")
+    p.add_argument("base")
+    p.add_argument("patch")
+    p.add_argument("new")
+    p = sub.add_parser("test")
+    p.add_argument("images", nargs="*")
+    p.add_argument("--baud", type=int, default=115200)
+    p.add_argument("--runs", type=int, default=20)
+    args = parser.parse_args()
+
+    if args.cmd == "test":
+        test(args)
+        return
+    with open(args.base, "rb") as f:
+        base = base_image(f.read())
+    if args.cmd == "diff":
+        with open(args.new, "rb") as f:
+            new = f.read()
+        patch = diff(base, new)
+        with open(args.patch, "wb") as f:
+            f.write(patch)
+        print("%d -> %d bytes (%.1f%%), send with @delta=%d @base=%d" %
+              (len(new), len(patch), 100.0 * len(patch) / max(len(new), 1),
+               len(new), zlib.crc32(base)))
+    else:
+        with open(args.patch, "rb") as f:
+            patch = f.read()
+        with open(args.new, "wb") as f:
+            f.write(apply(base, patch))
+
+
+if __name__ == "__main__":
+    main()
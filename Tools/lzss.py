@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+"""LZSS compressor for the compressed image download.
+
+Produces the stream decoded on the device by Core/Src/lzss.c:
+
+  - a flag byte announces the next 8 items, least significant bit first;
+  - a set bit is a literal byte;
+  - a clear bit is a match of two bytes: distance - 1 on 12 bits (low byte,
+    then the high nibble in bits 4-7 of the second byte) and
+    length - 3 on the low nibble; a nibble of 15 is followed by one byte
+    added to the length (matches of 3 to 273 bytes, 4 KB window).
+
+Send the result with the YMODEM extension " @lzss=<image size>" in block 0.
+
+Usage:
+  lzss.py compress <image.bin> <image.lzss>
+  lzss.py decompress <image.lzss> <image.bin>
+  lzss.py bench <image.bin> [...] [--baud 115200]
+"""
+
+import argparse
+import sys
+import time
+
+WINDOW_BITS = 12
+WINDOW_SIZE = 1 << WINDOW_BITS
+MIN_MATCH = 3
+NIBBLE_MAX = 15
+MAX_MATCH = MIN_MATCH + NIBBLE_MAX + 255
+MAX_CHAIN = 256
+
+
+def compress(data: bytes) -> bytes:
+    """Greedy LZSS with hash chains on 3-byte prefixes."""
+    out = bytearray()
+    head = {}
+    prev = [0] * len(data)
+    pos = 0
+    flags_at = 0
+    items = 8
+
+    def insert(i):
+        if i + MIN_MATCH <= len(data):
+            key = data[i:i + MIN_MATCH]
+            prev[i] = head.get(key, -1)
+            head[key] = i
+
+    while pos < len(data):
+        if items == 8:
+            flags_at = len(out)
+            out.append(0)
+            items = 0
+        best_len, best_dist = 0, 0
+        if pos + MIN_MATCH <= len(data):
+            cand = head.get(data[pos:pos + MIN_MATCH], -1)
+            limit = min(MAX_MATCH, len(data) - pos)
+            chain = MAX_CHAIN
+            while cand >= 0 and pos - cand <= WINDOW_SIZE and chain:
+                length = 0
+                while length < limit and data[cand + length] == data[pos + length]:
+                    length += 1
+                if length > best_len:
+                    best_len, best_dist = length, pos - cand
+                    if length == limit:
+                        break
+                cand = prev[cand]
+                chain -= 1
+        if best_len >= MIN_MATCH:
+            extra = best_len - MIN_MATCH
+            nibble = min(extra, NIBBLE_MAX)
+            d = best_dist - 1
+            out.append(d & 0xFF)
+            out.append(((d >> 8) << 4) | nibble)
+            if nibble == NIBBLE_MAX:
+                out.append(extra - NIBBLE_MAX)
+            for i in range(pos, pos + best_len):
+                insert(i)
+            pos += best_len
+        else:
+            out[flags_at] |= 1 << items
+            out.append(data[pos])
+            insert(pos)
+            pos += 1
+        items += 1
+    return bytes(out)
+
+
+def decompress(stream: bytes) -> bytes:
+    """Reference decoder, same state machine as the device."""
+    out = bytearray()
+    i = 0
+    while i < len(stream):
+        flags = stream[i]
+        i += 1
+        for _ in range(8):
+            if i >= len(stream):
+                break
+            if flags & 1:
+                out.append(stream[i])
+                i += 1
+            else:
+                d = stream[i] | ((stream[i + 1] >> 4) << 8)
+                nibble = stream[i + 1] & NIBBLE_MAX
+                i += 2
+                length = nibble + MIN_MATCH
+                if nibble == NIBBLE_MAX:
+                    length += stream[i]
+                    i += 1
+                start = len(out) - d - 1
+                for k in range(length):
+                    out.append(out[start + k])
+            flags >>= 1
+    return bytes(out)
+
+
+def wire_time(size: int, baud: int, block: int = 1024) -> float:
+    """Seconds on the wire for a YMODEM transfer, 10 bits per byte."""
+    blocks = (size + block - 1) // block
+    return (blocks * (block + 5) + 133 * 2) * 10 / baud
+
+
+def bench(paths, baud):
+    print("%-32s %9s %9s %7s %9s %9s %9s" %
+          ("image", "raw", "lzss", "ratio", "t_raw s", "t_lzss s", "pack s"))
+    for path in paths:
+        with open(path, "rb") as f:
+            data = f.read()
+        start = time.perf_counter()
+        packed = compress(data)
+        elapsed = time.perf_counter() - start
+        if decompress(packed) != data:
+            sys.exit("%s: round trip failed" % path)
+        print("%-32s %9d %9d %6.2fx %9.2f %9.2f %9.2f" %
+              (path[-32:], len(data), len(packed), len(data) / max(len(packed), 1),
+               wire_time(len(data), baud), wire_time(len(packed), baud), elapsed))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="cmd", required=True)
+    for name in ("compress", "decompress"):
+        p = sub.add_parser(name)
+        p.add_argument("input")
+        p.add_argument("output")
+    p = sub.add_parser("bench")
+    p.add_argument("images", nargs="+")
+    p.add_argument("--baud", type=int, default=115200)
+    args = parser.parse_args()
+
+    if args.cmd == "bench":
+        bench(args.images, args.baud)
+        return
+    with open(args.input, "rb") as f:
+        data = f.read()
+    result = compress(data) if args.cmd == "compress" else decompress(data)
+    with open(args.output, "wb") as f:
+        f.write(result)
+    if args.cmd == "compress":
+        print("%d -> %d bytes (%.2fx), send with @lzss=%d" %
+              (len(data), len(result), len(data) / max(len(result), 1), len(data)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""Page planner for the paged download.
+
+The device gives the CRC-32 of every 8 KB page of both banks in answer to
+an empty file sent with " @pagehash=0" in block 0:
+
+  @pagehash=<n>
+  @pa=<crc of page 0 of the running image>
+  @pi=<crc of page 0 of the other bank>
+  ...                                       (n pairs)
+
+From these lines, plan builds the file of the pages that must be sent:
+  - a page the other bank already holds is kept, nothing sent;
+  - a page the running image holds is copied from it by the device;
+  - any other page is sent, whole, in page order.
+Send the file with " @pages=<image size> @send=<mask> @copy=<mask>", bit n
+of a mask standing for page n.
+
+Usage:
+  pages.py plan <new.bin> <hashes.txt> <pages.bin>
+  pages.py hashes <active.bin> <inactive.bin>   (the device answer, offline)
+  pages.py test [--baud 115200]
+"""
+
+import argparse
+import random
+import sys
+import zlib
+
+PAGE_SIZE = 8192
+PAGES = 31                  # FLASH_IMAGE_SIZE / FLASH_PAGE_SIZE, STM32U545
+QUADWORD = 16
+
+
+def page_hashes(data: bytes):
+    """CRC-32 of each page, the bank erased after the data."""
+    data = data + b"\xff" * (PAGES * PAGE_SIZE - len(data))
+    return [zlib.crc32(data[p * PAGE_SIZE:(p + 1) * PAGE_SIZE]) for p in range(PAGES)]
+
+
+def parse_hashes(text: str):
+    """Device answer to (active, inactive) lists."""
+    active, inactive, count = [], [], None
+    for line in text.split():
+        key, _, value = line.lstrip("@").partition("=")
+        if key == "pagehash":
+            count = int(value)
+        elif key == "pa":
+            active.append(int(value))
+        elif key == "pi":
+            inactive.append(int(value))
+    if count is None or len(active) != count or len(inactive) != count:
+        sys.exit("incomplete page hash answer")
+    return active, inactive
+
+
+def plan(new: bytes, active, inactive):
+    """Returns the file, the send and the copy masks."""
+    pages = (len(new) + PAGE_SIZE - 1) // PAGE_SIZE
+    if pages > len(active):
+        sys.exit("image larger than the image area")
+    padded = new + b"\xff" * (pages * PAGE_SIZE - len(new))
+    out, send, copy = bytearray(), 0, 0
+    for p in range(pages):
+        page = padded[p * PAGE_SIZE:(p + 1) * PAGE_SIZE]
+        crc = zlib.crc32(page)
+        if crc == inactive[p]:
+            continue
+        if crc == active[p]:
+            copy |= 1 << p
+        else:
+            send |= 1 << p
+            out += page
+    return bytes(out), send, copy
+
+
+def receive(active: bytes, inactive: bytes, size: int, send: int, copy: int, data: bytes) -> bytes:
+    """Model of the device: erase, program the sent pages, copy the others."""
+    pages = (size + PAGE_SIZE - 1) // PAGE_SIZE
+    keep = ~(send | copy) & ((1 << pages) - 1)
+    bank = bytearray(inactive + b"\xff" * (PAGES * PAGE_SIZE - len(inactive)))
+    active = active + b"\xff" * (PAGES * PAGE_SIZE - len(active))
+    for p in range(PAGES):
+        if not keep >> p & 1:
+            bank[p * PAGE_SIZE:(p + 1) * PAGE_SIZE] = b"\xff" * PAGE_SIZE
+    index = 0
+    for p in range(PAGES):
+        if send >> p & 1:
+            bank[p * PAGE_SIZE:(p + 1) * PAGE_SIZE] = data[index * PAGE_SIZE:(index + 1) * PAGE_SIZE]
+            index += 1
+        elif copy >> p & 1:
+            bank[p * PAGE_SIZE:(p + 1) * PAGE_SIZE] = active[p * PAGE_SIZE:(p + 1) * PAGE_SIZE]
+    return bytes(bank[:size])
+
+
+def wire_time(size: int, baud: int, block: int = 1024) -> float:
+    """Seconds on the wire for a YMODEM transfer, 10 bits per byte."""
+    blocks = (size + block - 1) // block
+    return (blocks * (block + 5) + 133 * 2) * 10 / baud
+
+
+def test(baud):
+    rng = random.Random(1)
+    old = rng.randbytes(200 * 1024)
+    new = bytearray(old)
+    # Edits in two pages, one page reverted to the older image
+    new[10000:10004] = b"\x00\x01\x02\x03"
+    new[150000:150100] = rng.randbytes(100)
+    older = bytearray(new)
+    older[70000:70004] = b"\xde\xad\xbe\xef"
+    scenarios = [
+        ("same image in the other bank", bytes(new), bytes(new)),
+        ("first update", bytes(old), rng.randbytes(180 * 1024)),
+        ("repeat update", bytes(old), bytes(older)),
+    ]
+    for name, active, inactive in scenarios:
+        answer = ["@pagehash=%d" % PAGES]
+        for a, i in zip(page_hashes(active), page_hashes(inactive)):
+            answer += ["@pa=%d" % a, "@pi=%d" % i]
+        data, send, copy = plan(bytes(new), *parse_hashes("\n".join(answer)))
+        if receive(active, inactive, len(new), send, copy, data) != bytes(new):
+            sys.exit("%s: round trip failed" % name)
+        print("%-30s sent %2d, copied %2d pages, %.2f s -> %.2f s at %d baud" %
+              (name, bin(send).count("1"), bin(copy).count("1"),
+               wire_time(len(new), baud), wire_time(len(data), baud), baud))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="cmd", required=True)
+    p = sub.add_parser("plan")
+    p.add_argument("new")
+    p.add_argument("hashes")
+    p.add_argument("output")
+    p = sub.add_parser("hashes")
+    p.add_argument("active")
+    p.add_argument("inactive")
+    p = sub.add_parser("test")
+    p.add_argument("--baud", type=int, default=115200)
+    args = parser.parse_args()
+
+    if args.cmd == "test":
+        test(args.baud)
+    elif args.cmd == "hashes":
+        with open(args.active, "rb") as f:
+            active = page_hashes(f.read())
+        with open(args.inactive, "rb") as f:
+            inactive = page_hashes(f.read())
+        print("@pagehash=%d" % PAGES)
+        for a, i in zip(active, inactive):
+            print("@pa=%d\n@pi=%d" % (a, i))
+    else:
+        with open(args.new, "rb") as f:
+            new = f.read()
+        with open(args.hashes) as f:
+            active, inactive = parse_hashes(f.read())
+        data, send, copy = plan(new, active, inactive)
+        with open(args.output, "wb") as f:
+            f.write(data)
+        print("%d pages sent, %d copied, %d kept: send with @pages=%d @send=%d @copy=%d" %
+              (bin(send).count("1"), bin(copy).count("1"),
+               (len(new) + PAGE_SIZE - 1) // PAGE_SIZE - bin(send | copy).count("1"),
+               len(new), send, copy))
+
+
+if __name__ == "__main__":
+    main()
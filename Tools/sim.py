@@ -0,0 +1,426 @@
+#!/usr/bin/env python3
+"""Driver of the host simulation of the updater (Sim/, make -C Sim).
+
+The simulation runs ymodem.c, flash.c and menu.c on Linux: the flash is a
+512 KB file (bank 1 then bank 2, SWAP_BANK in <file>.ob), USART1 a socket
+paced at the baud rate. This script starts it on a socketpair, picks menu
+entries and plays the PC side of the YMODEM sessions:
+
+  send     download an image ('1', '5' YMODEM-g or '6' compare), print the
+           device record ('9'), check the inactive bank holds the image
+  upload   read the running image back ('2')
+  test     regression run of whole sessions on a fresh flash
+
+Extensions of block 0 are asked for with --blk, --baud, --win and --hash.
+The flash timings of the simulation can be changed with --sim-args, e.g.
+--sim-args="--page-erase-us 3400 -v".
+
+Usage:
+  sim.py send <image.bin> [--mode raw|stream|compare] [--blk N] [--baud N]
+                          [--win N] [--hash] [--swap] [--flash FILE]
+  sim.py upload <output.bin> [--flash FILE]
+  sim.py test [--keep DIR]
+"""
+
+import argparse
+import os
+import random
+import shlex
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+import zlib
+
+import delta
+import pages
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SIM = os.path.join(ROOT, "Sim", "build", "updater_sim")
+FLASH_SIZE = 512 * 1024
+BANK_SIZE = FLASH_SIZE // 2
+
+SOH, STX, STX_4K, EOT, STX_8K, ACK, NAK, CA = 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x15, 0x18
+FRAME_START = {128: SOH, 1024: STX, 4096: STX_4K, 8192: STX_8K}
+FRAME_SIZE = {v: k for k, v in FRAME_START.items()}
+MENU_KEY = {"raw": b"1", "stream": b"5", "compare": b"6"}
+TIMEOUT = 12.0              # DOWNLOAD_TIMEOUT, with some margin
+MENU_END = b"\n" + b"=" * 58 + b"\r\n\n"   # the device reads a key after it
+
+
+def crc16(data: bytes) -> int:
+    """CRC-16/XMODEM, as Crc16_Calc()."""
+    crc = 0
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+        crc &= 0xFFFF
+    return crc
+
+
+def packet(number: int, data: bytes, size: int) -> bytes:
+    """Block 0 is padded with NULs, the data with SUB."""
+    data = data + (b"\0" if number == 0 else b"\x1a") * (size - len(data))
+    return bytes([FRAME_START[size], number & 0xFF, ~number & 0xFF]) + data + crc16(data).to_bytes(2, "big")
+
+
+class Device:
+    """The simulation, its USART1 on one end of a socketpair."""
+
+    def __init__(self, flash, sim_args=()):
+        ours, theirs = socket.socketpair()
+        self.proc = subprocess.Popen([SIM, "--flash", flash, "--fd", str(theirs.fileno())] + list(sim_args),
+                                     pass_fds=[theirs.fileno()], stderr=subprocess.PIPE)
+        theirs.close()
+        self.sock = ours
+        self.buffer = bytearray()
+        self.banner = self.until(MENU_END)
+
+    def fill(self, deadline):
+        self.sock.settimeout(max(0.001, deadline - time.time()))
+        try:
+            data = self.sock.recv(65536)
+        except socket.timeout:
+            return False
+        if not data:
+            raise EOFError("the simulation ended: %s" % self.proc.stderr.read().decode().strip())
+        self.buffer += data
+        return True
+
+    def read(self, count=1, timeout=TIMEOUT):
+        deadline = time.time() + timeout
+        while len(self.buffer) < count:
+            if time.time() >= deadline:
+                raise TimeoutError("%d byte(s) expected" % count)
+            self.fill(deadline)
+        data = bytes(self.buffer[:count])
+        del self.buffer[:count]
+        return data
+
+    def until(self, marker: bytes, timeout=TIMEOUT) -> bytes:
+        deadline = time.time() + timeout
+        while marker not in self.buffer:
+            if time.time() >= deadline:
+                raise TimeoutError("%r expected, got %r" % (marker, bytes(self.buffer[-200:])))
+            self.fill(deadline)
+        end = self.buffer.index(marker) + len(marker)
+        data = bytes(self.buffer[:end])
+        del self.buffer[:end]
+        return data
+
+    def write(self, data: bytes):
+        self.sock.sendall(data)
+
+    def menu(self, key: bytes, marker: bytes) -> bytes:
+        self.write(key)
+        return self.until(marker)
+
+    def record(self):
+        """The '9' line, as a dict of ints."""
+        line = self.menu(b"9", b"\r\n").decode()
+        self.until(MENU_END)
+        return {k: int(v) for k, _, v in (f.partition("=") for f in line.split()[1:])}
+
+    def exit(self):
+        """'3': the banks are swapped, the simulation ends."""
+        self.write(b"3")
+        err = self.proc.communicate(timeout=TIMEOUT)[1].decode()
+        self.sock.close()
+        return err
+
+
+def control(dev, timeout=TIMEOUT):
+    """Next control byte, with the '@' lines met on the way."""
+    lines = []
+    while True:
+        byte = dev.read(1, timeout)[0]
+        if byte == ord("@"):
+            lines.append(dev.until(b"\n").decode().strip())
+            continue
+        if byte == CA and dev.read(1, timeout)[0] == CA:
+            raise RuntimeError("session cancelled by the device")
+        return byte, lines
+
+
+def extensions(lines):
+    return {k: int(v) for k, _, v in (line.partition("=") for line in lines)}
+
+
+def ymodem_send(dev, name, data, ext="", streaming=False, answer=None):
+    """PC side of a download, the file then the end of session. The '@'
+    lines of the device answer to block 0 are added to answer."""
+    header = name.encode() + b"\0" + str(len(data)).encode() + ext.encode()
+    size = 128 if len(header) <= 128 else 1024
+    dev.until(b"to abort)\n\r")
+    # The device waits for block 0 before polling with 'C'
+    dev.write(packet(0, header, size))
+    byte, lines = control(dev)
+    if not streaming:
+        while byte != ACK:
+            if byte == NAK or byte == ord("C"):
+                dev.write(packet(0, header, size))
+            byte, more = control(dev)
+            lines += more
+        byte, more = control(dev)
+        lines += more
+    negotiated = extensions(lines)
+    if answer is not None:
+        answer += lines
+    poll = ord("G") if streaming else ord("C")
+    if byte != poll:
+        raise RuntimeError("poll expected after block 0, got 0x%02x" % byte)
+    frame = negotiated.get("blk", 1024)
+    window = negotiated.get("win", 1)
+    blocks = [data[i:i + frame] for i in range(0, len(data), frame)]
+    if streaming:
+        dev.write(b"".join(packet(n + 1, b, frame) for n, b in enumerate(blocks)))
+    elif window > 1:
+        send_window(dev, blocks, frame, window)
+    else:
+        for n, block in enumerate(blocks):
+            while True:
+                dev.write(packet(n + 1, block, frame))
+                byte, _ = control(dev)
+                if byte == ACK:
+                    break
+    dev.write(bytes([EOT]))
+    while control(dev)[0] != ACK:
+        dev.write(bytes([EOT]))
+    if control(dev)[0] != poll:
+        raise RuntimeError("poll expected after EOT")
+    # End of session
+    dev.write(packet(0, b"", 128))
+    while control(dev)[0] != ACK:
+        pass
+    return negotiated
+
+
+def send_window(dev, blocks, frame, window):
+    """Windowed data phase: frames ahead of the acknowledgements, the
+    holes sent again when the device asks."""
+    base, sent = 0, 0
+    while base < len(blocks):
+        while sent < len(blocks) and sent < base + window:
+            dev.write(packet(sent + 1, blocks[sent], frame))
+            sent += 1
+        code, number, check = dev.read(3)
+        if (number ^ check) != 0xFF:
+            continue
+        # Block numbers are 8 bits: the nearest one to the window
+        number = base + ((number - (base & 0xFF)) & 0xFF)
+        if code == ACK:
+            base = max(base, number)
+        elif code == NAK and number - 1 < len(blocks):
+            dev.write(packet(number, blocks[number - 1], frame))
+    # The caller's EOT gets a plain ACK, then the device asks for the next header
+    return base
+
+
+def ymodem_receive(dev):
+    """PC side of an upload: (name, data)."""
+    dev.write(b"C")
+    start = dev.read(1)[0]
+    block = dev.read(2 + FRAME_SIZE[start] + 2)
+    fields = block[2:-2].split(b"\0")
+    name, size = fields[0].decode(), int(fields[1].split()[0])
+    dev.write(bytes([ACK]))
+    dev.write(b"C")
+    data = bytearray()
+    while True:
+        start = dev.read(1)[0]
+        if start == EOT:
+            dev.write(bytes([ACK]))
+            break
+        block = dev.read(2 + FRAME_SIZE[start] + 2)
+        if crc16(block[2:-2]) != int.from_bytes(block[-2:], "big"):
+            dev.write(bytes([NAK]))
+            continue
+        data += block[2:-2]
+        dev.write(bytes([ACK]))
+    dev.write(b"C")
+    dev.read(1 + 2 + 128 + 2)
+    dev.write(bytes([ACK]))
+    return name, bytes(data[:size])
+
+
+def inactive_bank(flash):
+    """The image bank written by a download, as the file holds it."""
+    swapped = False
+    if os.path.exists(flash + ".ob"):
+        with open(flash + ".ob") as f:
+            swapped = f.read().strip() == "SWAP_BANK=1"
+    with open(flash, "rb") as f:
+        image = f.read()
+    return image[:BANK_SIZE] if swapped else image[BANK_SIZE:]
+
+
+def download(flash, data, mode="raw", ext="", sim_args=(), swap=False, image=None):
+    """One download session: the device record and the wall time. The
+    inactive bank must then hold image, the file itself by default."""
+    dev = Device(flash, sim_args)
+    dev.write(MENU_KEY[mode])
+    start = time.time()
+    negotiated = ymodem_send(dev, "image.bin", data, ext, streaming=(mode == "stream"))
+    summary = dev.until(MENU_END)
+    elapsed = time.time() - start
+    record = dev.record()
+    if swap:
+        dev.exit()
+    else:
+        dev.proc.kill()
+        dev.proc.wait()
+    if b"Completed Successfully" not in summary:
+        raise RuntimeError(summary.decode(errors="replace").strip())
+    image = data if image is None else image
+    if inactive_bank(flash)[:len(image)] != image:
+        raise RuntimeError("the bank does not hold the image")
+    return negotiated, record, elapsed
+
+
+def extension_text(args, data):
+    ext = ""
+    for key in ("blk", "baud", "win"):
+        if getattr(args, key):
+            ext += " @%s=%d" % (key, getattr(args, key))
+    if getattr(args, "hash", False):
+        ext += " @hash=%d" % zlib.crc32(data)
+    return ext
+
+
+def report(name, size, negotiated, record, elapsed):
+    print("%-28s %7d bytes %6.2f s  device %5d ms %6d B/s  %s" %
+          (name, size, elapsed, record["time_ms"], record["throughput"],
+           " ".join("%s=%d" % kv for kv in sorted(negotiated.items())) or "-"))
+    print("  " + " ".join("%s=%d" % kv for kv in record.items()))
+
+
+def test(keep=None):
+    directory = keep or tempfile.mkdtemp(prefix="sim")
+    os.makedirs(directory, exist_ok=True)
+    flash = os.path.join(directory, "flash.bin")
+    for path in (flash, flash + ".ob"):
+        if os.path.exists(path):
+            os.remove(path)
+    rng = random.Random(25)
+    # The running image, as a programmer leaves it: bank 1, banks not swapped
+    running = rng.randbytes(40 * 1024)
+    with open(flash, "wb") as f:
+        f.write(running + b"\xff" * (FLASH_SIZE - len(running)))
+    image = rng.randbytes(100 * 1024)
+    update = bytearray(image)
+    update[20000:20016] = rng.randbytes(16)
+
+    # Stop-and-wait at the console rate, then the faster variants
+    sessions = [
+        ("raw 1K 115200", "raw", bytes(image[:24 * 1024]), ""),
+        ("raw 8K 921600 hash", "raw", bytes(image), " @blk=8192 @baud=921600 @hash=%d" % zlib.crc32(image)),
+        ("windowed 4K x3 921600", "raw", bytes(image), " @blk=4096 @win=4 @baud=921600"),
+        ("YMODEM-g 8K 921600", "stream", bytes(update), " @blk=8192 @baud=921600"),
+        ("compare, same image", "compare", bytes(update), " @blk=8192 @baud=921600"),
+    ]
+    for name, mode, data, ext in sessions:
+        negotiated, record, elapsed = download(flash, data, mode, ext)
+        report(name, len(data), negotiated, record, elapsed)
+        assert record["result"] == 0 and record["bytes"] == len(data), record
+        if "@blk" in ext:
+            assert negotiated.get("blk") == int(ext.split("@blk=")[1].split()[0]), negotiated
+        if "@win" in ext:
+            assert negotiated.get("win") == 3, negotiated   # 4K frames in the 16K RX ring
+        if "@baud" in ext:
+            assert negotiated.get("baud") == 921600, negotiated
+        if mode == "compare":
+            assert record["pages_written"] == 0 and record["pages_skipped"] > 0, record
+    # Paged update: the page hashes of both banks, then only the changed pages
+    new = bytearray(running[:2 * pages.PAGE_SIZE] + update[2 * pages.PAGE_SIZE:])
+    new[50000:50004] = b"\x00\x01\x02\x03"
+    dev = Device(flash)
+    dev.write(MENU_KEY["raw"])
+    answer = []
+    ymodem_send(dev, "pagehash.bin", b"", " @pagehash=0", answer=answer)
+    dev.until(MENU_END)
+    dev.proc.kill()
+    dev.proc.wait()
+    paged, send, copy = pages.plan(bytes(new), *pages.parse_hashes("\n".join(answer)))
+    assert (bin(send).count("1"), bin(copy).count("1")) == (1, 2), (send, copy)
+    negotiated, record, elapsed = download(flash, paged, "raw", " @pages=%d @send=%d @copy=%d @blk=8192" % (len(new), send, copy),
+                                           image=bytes(new))
+    report("pages, 1 sent 2 copied", len(paged), negotiated, record, elapsed)
+    assert record["result"] == 0 and record["bytes"] == len(paged), record
+    # A patch of the running image, applied by delta.c
+    new = bytearray(running)
+    new[1000:1000] = rng.randbytes(300)
+    new[30000:30016] = rng.randbytes(16)
+    new += rng.randbytes(2000)
+    base = delta.base_image(running)
+    patch = delta.diff(base, bytes(new))
+    negotiated, record, elapsed = download(flash, patch, "raw", " @delta=%d @base=%d @blk=1024" % (len(new), zlib.crc32(base)),
+                                           image=bytes(new))
+    report("delta patch", len(patch), negotiated, record, elapsed)
+    assert record["result"] == 0 and record["bytes"] == len(patch), record
+    # The running image reads back, the download left it alone
+    dev = Device(flash)
+    dev.write(b"2")
+    dev.until(b"to abort)\n\r")
+    name, data = ymodem_receive(dev)
+    dev.until(MENU_END)
+    assert name == "bank1.bin" and data == running, (name, len(data))
+    print("upload of %s: %d bytes" % (name, len(data)))
+    # Leaving the menu swaps the banks
+    dev.exit()
+    with open(flash + ".ob") as f:
+        assert f.read().strip() == "SWAP_BANK=1"
+    dev = Device(flash)
+    assert b"Program running from Bank 2" in dev.banner
+    dev.proc.kill()
+    print("bank swap: the next start runs from bank 2")
+    print("whole sessions on the simulation: OK")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="cmd", required=True)
+    p = sub.add_parser("send")
+    p.add_argument("image")
+    p.add_argument("--mode", choices=sorted(MENU_KEY), default="raw")
+    p.add_argument("--blk", type=int)
+    p.add_argument("--baud", type=int)
+    p.add_argument("--win", type=int)
+    p.add_argument("--hash", action="store_true")
+    p.add_argument("--swap", action="store_true", help="leave the menu: the banks are swapped")
+    p.add_argument("--flash", default="sim_flash.bin")
+    p.add_argument("--sim-args", default="")
+    p = sub.add_parser("upload")
+    p.add_argument("output")
+    p.add_argument("--flash", default="sim_flash.bin")
+    p.add_argument("--sim-args", default="")
+    p = sub.add_parser("test")
+    p.add_argument("--keep", help="directory of the flash image, kept after the run")
+    args = parser.parse_args()
+
+    if not os.path.exists(SIM):
+        sys.exit("%s missing, run: make -C Sim" % SIM)
+    if args.cmd == "test":
+        test(args.keep)
+    elif args.cmd == "send":
+        with open(args.image, "rb") as f:
+            data = f.read()
+        negotiated, record, elapsed = download(args.flash, data, args.mode, extension_text(args, data),
+                                               shlex.split(args.sim_args), args.swap)
+        report(os.path.basename(args.image), len(data), negotiated, record, elapsed)
+    else:
+        dev = Device(args.flash, shlex.split(args.sim_args))
+        dev.write(b"2")
+        dev.until(b"to abort)\n\r")
+        name, data = ymodem_receive(dev)
+        dev.until(MENU_END)
+        dev.proc.kill()
+        with open(args.output, "wb") as f:
+            f.write(data)
+        print("%s: %d bytes" % (name, len(data)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""Decoder of the event trace kept in SRAM4 by Core/Src/trace.c.
+
+The ring is a 32-byte header followed by 12-byte records, little-endian:
+
+  header: magic "TACE", version u16, record size u16, capacity u32,
+          records written u32, clock in Hz u32, 12 reserved bytes
+  record: DWT cycle counter u32, event u16, arg16 u16, arg u32
+
+The ring keeps the last <capacity> records; the next one to write is at
+index written % capacity. Get a dump with the 't' entry of the menu (a YMODEM
+upload of trace.bin, its 0x1A padding is ignored) or from a debugger:
+  dump binary memory trace.bin 0x28000000 0x28004000
+
+Usage:
+  trace.py decode <trace.bin> [--clock HZ]
+  trace.py test
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = 0x45434154          # TRACE_MAGIC
+VERSION = 1                 # TRACE_VERSION
+HEADER = struct.Struct("<IHHIII12x")
+RECORD = struct.Struct("<IHHI")
+SIZE = 16 * 1024            # TRACE_SIZE
+
+# Event names, and how to print arg16 / arg (None: not used)
+EVENTS = {
+    0x01: ("session", "options", "bank"),
+    0x02: ("end", None, "result"),
+    0x03: ("packet", "block", "length"),
+    0x04: ("ack", "block", None),
+    0x05: ("nak", "block", None),
+    0x06: ("bad packet", "first", "status"),
+    0x07: ("retry", "errors", None),
+    0x08: ("baud", None, "rate"),
+    0x10: ("erase", "pages", "page"),
+    0x11: ("program", "quadwords", "address"),
+    0x12: ("flash done", "type", "status"),
+    0x20: ("error", None, "status"),
+}
+FLASH_OPS = {0: "erase", 1: "program"}
+COM_STATUS = {0: "OK", 1: "ERROR", 2: "ABORT", 3: "TIMEOUT", 4: "DATA", 5: "LIMIT", 6: "BASE"}
+
+
+def parse(dump: bytes):
+    """Header fields and the records, oldest first."""
+    if len(dump) < HEADER.size:
+        sys.exit("dump too short")
+    magic, version, record_size, capacity, written, clock = HEADER.unpack_from(dump)
+    if magic != MAGIC or version != VERSION or record_size != RECORD.size:
+        sys.exit("not a trace (magic 0x%08x, version %d, record %d bytes)" % (magic, version, record_size))
+    if HEADER.size + capacity * RECORD.size > len(dump):
+        sys.exit("dump shorter than the ring")
+    count = min(written, capacity)
+    first = written - count
+    records = []
+    for n in range(first, written):
+        records.append(RECORD.unpack_from(dump, HEADER.size + (n % capacity) * RECORD.size))
+    return {"capacity": capacity, "written": written, "clock": clock}, records
+
+
+def describe(event, arg16, arg):
+    name, key16, key = EVENTS.get(event, ("event 0x%02x" % event, "arg16", "arg"))
+    fields = []
+    if key16 is not None:
+        value = FLASH_OPS.get(arg16, arg16) if event == 0x12 else arg16
+        fields.append("%s=%s" % (key16, value))
+    if key is not None:
+        if key == "address":
+            value = "0x%08x" % arg
+        elif event == 0x02:
+            value = COM_STATUS.get(arg, arg)
+        else:
+            value = arg
+        fields.append("%s=%s" % (key, value))
+    return "%-11s %s" % (name, " ".join(fields))
+
+
+def timeline(header, records, clock=None):
+    """Lines of the timeline, times in us from the first record."""
+    clock = clock or header["clock"] or 1
+    lines = ["%d records of %d written, %d kept, clock %d Hz" %
+             (len(records), header["written"], header["capacity"], clock)]
+    elapsed = 0
+    last = None
+    for time, event, arg16, arg in records:
+        # The cycle counter wraps: gaps are below one turn
+        delta = 0 if last is None else (time - last) & 0xFFFFFFFF
+        elapsed += delta
+        last = time
+        lines.append("%12.1f us %+10.1f  %s" % (elapsed * 1e6 / clock, delta * 1e6 / clock, describe(event, arg16, arg)))
+    return lines
+
+
+def build(events, capacity=None, clock=4000000, start=0xFFFFF000):
+    """A ring as the device writes it, for the test."""
+    capacity = capacity or (SIZE - HEADER.size) // RECORD.size
+    ring = bytearray(HEADER.size + capacity * RECORD.size)
+    time = start
+    for n, (step, event, arg16, arg) in enumerate(events):
+        time = (time + step) & 0xFFFFFFFF
+        RECORD.pack_into(ring, HEADER.size + (n % capacity) * RECORD.size, time, event, arg16, arg)
+    HEADER.pack_into(ring, 0, MAGIC, VERSION, RECORD.size, capacity, len(events), clock)
+    return bytes(ring)
+
+
+def test():
+    events = [(0, 0x01, 0, 0x08040000)]
+    for block in range(1, 41):
+        events += [(40000, 0x03, block, 1024), (400, 0x04, block, 0),
+                   (100, 0x11, 64, 0x08040000 + (block - 1) * 1024), (2000, 0x12, 1, 0)]
+    events += [(500, 0x02, 0, 0)]
+    # Small ring: it wraps, the cycle counter wraps too
+    header, records = parse(build(events, capacity=50) + b"\x1a" * 100)
+    assert len(records) == 50 and header["written"] == len(events)
+    assert records[-1][1] == 0x02 and records[0][1:] == events[-50][1:]
+    lines = timeline(header, records)
+    total = sum(step for step, _, _, _ in events[-49:])
+    assert lines[-1].split()[0] == "%.1f" % (total * 1e6 / 4000000), lines[-1]
+    print("\n".join(lines[:6] + ["..."] + lines[-3:]))
+    print("decode of a wrapped ring: OK")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="cmd", required=True)
+    p = sub.add_parser("decode")
+    p.add_argument("dump")
+    p.add_argument("--clock", type=int, help="timestamp rate in Hz, if not the recorded one")
+    sub.add_parser("test")
+    args = parser.parse_args()
+
+    if args.cmd == "test":
+        test()
+        return
+    with open(args.dump, "rb") as f:
+        header, records = parse(f.read())
+    print("\n".join(timeline(header, records, args.clock)))
+
+
+if __name__ == "__main__":
+    main()